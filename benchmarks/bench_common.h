@@ -0,0 +1,26 @@
+#pragma once
+
+#if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    include <Windows.h>
+#else
+#    if !defined(_POSIX_C_SOURCE)
+#        define _POSIX_C_SOURCE 200809L
+#    endif
+#    include <time.h>
+#endif
+
+/* Monotonic wall clock in seconds */
+static double now(void)
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
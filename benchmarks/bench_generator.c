@@ -0,0 +1,185 @@
+/*
+ * Runs c_ini_generator over synthetic headers of increasing size and reports
+ * how long it takes. Scaling should be roughly linear in the input size. With
+ * --stats, the generator is run once more per input size to print how the time
+ * is split up between its phases.
+ *
+ * Usage: c_ini_generator_bench [generator] [jobs] [--stats]
+ */
+#include "bench_common.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INPUT_FILES 8
+#define REPETITIONS 3
+
+struct scale
+{
+    int structs;
+    int fields_per_struct;
+};
+
+static const struct scale scales[] = {
+    {100, 10},
+    {1000, 10},
+    {10000, 10},
+    {10, 10000},
+};
+
+static void write_field(FILE* fp, int i)
+{
+    switch (i % 5)
+    {
+        case 0:
+            fprintf(fp, "    int f%d DEFAULT(%d) CONSTRAIN(0, 9999);\n", i, i);
+            break;
+        case 1: fprintf(fp, "    float f%d DEFAULT(%d.5);\n", i, i); break;
+        case 2: fprintf(fp, "    char* f%d DEFAULT(\"v%d\");\n", i, i); break;
+        case 3: fprintf(fp, "    char f%d[32];\n", i); break;
+        case 4: fprintf(fp, "    uint16_t f%d : 4;\n", i); break;
+    }
+}
+
+/* Mixes in the kind of code and comments real headers contain, which the
+ * generator has to skip over */
+static long write_inputs(const struct scale* scale)
+{
+    int  file, s, f;
+    long bytes = 0;
+
+    for (file = 0; file != INPUT_FILES; ++file)
+    {
+        char  filename[64];
+        FILE* fp;
+        sprintf(filename, "bench_generator_input_%d.h", file);
+        fp = fopen(filename, "wb");
+        if (fp == NULL)
+        {
+            perror(filename);
+            return -1;
+        }
+
+        fprintf(fp, "#pragma once\n\n");
+        fprintf(fp, "#include \"c-ini.h\"\n#include <stdint.h>\n\n");
+        for (s = file; s < scale->structs; s += INPUT_FILES)
+        {
+            fprintf(fp, "/* Documentation for struct s%d.\n", s);
+            fprintf(fp, " * It has %d fields. */\n", scale->fields_per_struct);
+            fprintf(fp, "SECTION(\"s%d\")\nstruct s%d\n{\n", s, s);
+            for (f = 0; f != scale->fields_per_struct; ++f)
+            {
+                if (f % 8 == 0)
+                    fprintf(fp, "    // Field group %d\n", f / 8);
+                write_field(fp, f);
+            }
+            fprintf(fp, "    struct s%d* next IGNORE();\n};\n\n", s);
+            fprintf(
+                fp,
+                "static inline int s%d_count(const struct s%d* s)\n"
+                "{\n    return s->next ? 1 + s%d_count(s->next) : 1;\n}\n\n",
+                s,
+                s,
+                s);
+        }
+
+        bytes += ftell(fp);
+        fclose(fp);
+    }
+
+    return bytes;
+}
+
+static void remove_files(void)
+{
+    int file;
+    for (file = 0; file != INPUT_FILES; ++file)
+    {
+        char filename[64];
+        sprintf(filename, "bench_generator_input_%d.h", file);
+        remove(filename);
+    }
+    remove("bench_generator_output.c");
+    remove("bench_generator_output.h");
+}
+
+static int run_generator(const char* generator, const char* jobs, int stats)
+{
+    char command[1024];
+    int  file, len;
+
+    len = sprintf(
+        command,
+        "\"%s\" --jobs %s%s --input",
+        generator,
+        jobs,
+        stats ? " --stats" : "");
+    for (file = 0; file != INPUT_FILES; ++file)
+        len += sprintf(command + len, " bench_generator_input_%d.h", file);
+    sprintf(
+        command + len,
+        " --output-source bench_generator_output.c"
+        " --output-header bench_generator_output.h");
+
+    remove("bench_generator_output.c");
+    remove("bench_generator_output.h");
+    return system(command);
+}
+
+int main(int argc, char** argv)
+{
+    const char* generator = argc > 1 ? argv[1] : C_INI_GENERATOR;
+    const char* jobs = argc > 2 ? argv[2] : "1";
+    int         stats = argc > 3 && strcmp(argv[3], "--stats") == 0;
+    int         i, rep;
+
+    printf(
+        "%8s %8s %12s %10s %10s %12s\n",
+        "structs",
+        "fields",
+        "input bytes",
+        "seconds",
+        "MB/s",
+        "ns/field");
+    for (i = 0; i != (int)(sizeof(scales) / sizeof(*scales)); ++i)
+    {
+        double best = 1e30;
+        long   fields = (long)scales[i].structs * scales[i].fields_per_struct;
+        long   bytes = write_inputs(&scales[i]);
+        if (bytes < 0)
+            return EXIT_FAILURE;
+
+        for (rep = 0; rep != REPETITIONS; ++rep)
+        {
+            double elapsed, start = now();
+            if (run_generator(generator, jobs, 0) != 0)
+            {
+                fprintf(stderr, "Generator failed\n");
+                remove_files();
+                return EXIT_FAILURE;
+            }
+            elapsed = now() - start;
+            if (best > elapsed)
+                best = elapsed;
+        }
+
+        printf(
+            "%8d %8ld %12ld %10.4f %10.2f %12.1f\n",
+            scales[i].structs,
+            fields,
+            bytes,
+            best,
+            (double)bytes / best / 1e6,
+            best * 1e9 / (double)fields);
+
+        if (stats)
+        {
+            fflush(stdout);
+            run_generator(generator, jobs, 1);
+        }
+    }
+
+    remove_files();
+    return EXIT_SUCCESS;
+}
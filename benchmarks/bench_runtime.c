@@ -0,0 +1,771 @@
+/*
+ * Measures the generated parser functions on synthetic INI corpora.
+ *
+ * Every workload is a schema from bench_runtime.h paired with a corpus that is
+ * built in memory. Each operation is repeated until it has run for at least
+ * --min-time seconds. Throughput is reported relative to the bytes the
+ * operation works on: the corpus for _parse and _parse_all, the written text
+ * for _fwrite and the struct itself for _init and _deinit.
+ *
+ * The repeated workload also loads every section into its own record, once
+ * with a malloc per record as in example3 ("_records") and once into the slab
+ * pool ("_pool"), including the _deinit of all records. "_columns" only loads
+ * the id and weight of every section into two arrays.
+ *
+ * Usage: c_ini_bench [--format table|csv|json] [--min-time <seconds>]
+ *                    [--filter <workload>] [--label <text>]
+ */
+#include "bench_common.h"
+#include "bench_runtime.h"
+#include "bench_runtime_schema.h"
+#include "bench_runtime_ini.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#    define NULL_DEVICE "NUL"
+#else
+#    define NULL_DEVICE "/dev/null"
+#endif
+
+#define BATCH 64
+
+/* ----------------------------------------------------------------------------
+ * Corpus construction
+ * ------------------------------------------------------------------------- */
+
+struct corpus
+{
+    char* data;
+    int   len;
+    int   capacity;
+    int   keys;
+};
+
+static void corpus_fmt(struct corpus* c, const char* fmt, ...)
+{
+    va_list ap;
+    int     len;
+
+    va_start(ap, fmt);
+    len = vsnprintf(NULL, 0, fmt, ap);
+    va_end(ap);
+
+    if (c->len + len + 1 > c->capacity)
+    {
+        c->capacity = (c->len + len + 1) * 2;
+        c->data = realloc(c->data, c->capacity);
+        if (c->data == NULL)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    va_start(ap, fmt);
+    c->len += vsnprintf(c->data + c->len, len + 1, fmt, ap);
+    va_end(ap);
+}
+
+static void corpus_value(struct corpus* c, enum bench_type type, int i)
+{
+    switch (type)
+    {
+        case BENCH_INT: corpus_fmt(c, "%d\n", i * 7919 - 500000); break;
+        case BENCH_FLOAT: corpus_fmt(c, "%d.%04d\n", i * 31 - 2000, i); break;
+        case BENCH_BOOL: corpus_fmt(c, "%s\n", i & 1 ? "true" : "false"); break;
+        case BENCH_STR_FIXED: corpus_fmt(c, "\"fixed string %d\"\n", i); break;
+        case BENCH_STR_DYNAMIC:
+            corpus_fmt(c, "\"a longer, dynamically allocated string %d\"\n", i);
+            break;
+    }
+    c->keys++;
+}
+
+static void build_wide(struct corpus* c)
+{
+    int i;
+    corpus_fmt(c, "[wide]\n");
+    for (i = 0; i != BENCH_WIDE_FIELDS; ++i)
+    {
+        corpus_fmt(c, "w%d = ", i);
+        corpus_value(c, bench_wide_type(i), i);
+    }
+}
+
+/* Like a hand-edited file, no key follows the one declared before it */
+static void build_reversed(struct corpus* c)
+{
+    int i;
+    corpus_fmt(c, "[wide]\n");
+    for (i = BENCH_WIDE_FIELDS; i--;)
+    {
+        corpus_fmt(c, "w%d = ", i);
+        corpus_value(c, bench_wide_type(i), i);
+    }
+}
+
+static void build_comments(struct corpus* c)
+{
+    int i;
+    corpus_fmt(c, "; Generated configuration file\n[wide]\n");
+    for (i = 0; i != BENCH_WIDE_FIELDS; ++i)
+    {
+        corpus_fmt(
+            c,
+            "\n# Documentation for w%d. Explains what the value does, which\n"
+            "# values are sensible and what happens when it is changed.\n"
+            "; Last changed by the deployment scripts, do not edit by hand\n"
+            "w%d = ",
+            i,
+            i);
+        corpus_value(c, bench_wide_type(i), i);
+    }
+}
+
+static void build_numeric(struct corpus* c)
+{
+    int i;
+    corpus_fmt(c, "[numeric]\n");
+    for (i = 0; i != BENCH_NUMERIC_FIELDS; ++i)
+    {
+        corpus_fmt(c, "n%d = ", i);
+        corpus_value(c, bench_numeric_type(i), i);
+    }
+}
+
+static void build_lists(struct corpus* c)
+{
+    int l, i;
+    corpus_fmt(c, "[lists]\n");
+    for (l = 0; l != BENCH_LISTS; ++l)
+    {
+        corpus_fmt(c, "l%d = ", l);
+        for (i = 0; i != BENCH_LIST_ITEMS; ++i)
+            corpus_fmt(c, "%s\"list %d item %d\"", i ? ", " : "", l, i);
+        corpus_fmt(c, "\n");
+        c->keys++;
+    }
+    corpus_fmt(c, "fixed = ");
+    for (i = 0; i != BENCH_FIXED_LIST_SIZE; ++i)
+        corpus_fmt(c, "%s\"fixed item %d\"", i ? ", " : "", i);
+    corpus_fmt(c, "\n");
+    c->keys++;
+}
+
+static void build_items(struct corpus* c)
+{
+    int i;
+    for (i = 0; i != BENCH_ITEMS; ++i)
+    {
+        corpus_fmt(
+            c,
+            "[item]\nid = %d\nweight = %d.25\nname = \"item %d\"\n"
+            "tag = \"tag for item %d\"\nenabled = %s\n\n",
+            i,
+            i % 1000,
+            i,
+            i,
+            i & 1 ? "true" : "false");
+        c->keys += 5;
+    }
+}
+
+/* ----------------------------------------------------------------------------
+ * Type-erased access to the generated functions
+ * ------------------------------------------------------------------------- */
+
+struct schema
+{
+    int size;
+    int fields;
+    int (*init)(void* s);
+    void (*deinit)(void* s);
+    int (*parse)(void* s, const char* data, int len);
+    int (*parse_all)(void* s, const char* data, int len);
+    int (*parse_fields)(void* s, const char* data, int len);
+    int (*parse_lazy)(void* s, const char* data, int len);
+    int (*validate)(void* s, const char* data, int len);
+    int (*write)(const void* s, FILE* fp);
+};
+
+#define SCHEMA(name, fields)                                                   \
+    static int name##_init_(void* s)                                           \
+    {                                                                          \
+        return name##_init(s);                                                 \
+    }                                                                          \
+    static void name##_deinit_(void* s)                                        \
+    {                                                                          \
+        name##_deinit(s);                                                      \
+    }                                                                          \
+    static int name##_parse_(void* s, const char* data, int len)               \
+    {                                                                          \
+        return name##_parse(s, "<bench>", data, len);                          \
+    }                                                                          \
+    static int name##_on_section_(struct c_ini_parser* p, void* s)             \
+    {                                                                          \
+        return name##_parse_section(s, p);                                     \
+    }                                                                          \
+    static int name##_parse_all_(void* s, const char* data, int len)           \
+    {                                                                          \
+        return name##_parse_all("<bench>", data, len, name##_on_section_, s);  \
+    }                                                                          \
+    /* Only the first four fields */                                           \
+    static int name##_parse_fields_(void* s, const char* data, int len)        \
+    {                                                                          \
+        uint32_t mask[C_INI_FIELD_WORDS(fields)] = {0x0F};                     \
+        return name##_parse_fields(s, mask, "<bench>", data, len);             \
+    }                                                                          \
+    /* Only finds the values, nothing is decoded */                            \
+    static int name##_parse_lazy_(void* s, const char* data, int len)          \
+    {                                                                          \
+        struct name##_lazy lazy;                                               \
+        return name##_parse_lazy(&lazy, s, "<bench>", data, len);              \
+    }                                                                          \
+    static int name##_validate_(void* s, const char* data, int len)            \
+    {                                                                          \
+        struct c_ini_error error;                                              \
+        (void)s;                                                               \
+        return name##_validate(data, len, &error);                             \
+    }                                                                          \
+    static int name##_fwrite_(const void* s, FILE* fp)                         \
+    {                                                                          \
+        return name##_fwrite(s, fp);                                           \
+    }                                                                          \
+    static const struct schema name##_schema = {                               \
+        sizeof(struct name),                                                   \
+        fields,                                                                \
+        name##_init_,                                                          \
+        name##_deinit_,                                                        \
+        name##_parse_,                                                         \
+        name##_parse_all_,                                                     \
+        name##_parse_fields_,                                                  \
+        name##_parse_lazy_,                                                    \
+        name##_validate_,                                                      \
+        name##_fwrite_}
+
+SCHEMA(bench_wide, BENCH_WIDE_FIELDS);
+SCHEMA(bench_numeric, BENCH_NUMERIC_FIELDS);
+SCHEMA(bench_lists, BENCH_LISTS + 1);
+SCHEMA(bench_item, 5);
+
+/* ----------------------------------------------------------------------------
+ * Measurements
+ * ------------------------------------------------------------------------- */
+
+enum op
+{
+    OP_INIT = 0x01,
+    OP_PARSE = 0x02,
+    OP_PARSE_ALL = 0x04,
+    OP_FWRITE = 0x08,
+    OP_DEINIT = 0x10,
+    OP_ALL = 0x1F,
+    OP_RECORDS = 0x20,
+    OP_PARSE_FIELDS = 0x40,
+    OP_PARSE_LAZY = 0x80,
+    OP_VALIDATE = 0x100
+};
+
+struct workload
+{
+    const char*          name;
+    const struct schema* schema;
+    void (*build)(struct corpus* c);
+    int ops;
+};
+
+static const struct workload workloads[] = {
+    {"wide",
+     &bench_wide_schema,
+     build_wide,
+     OP_ALL | OP_PARSE_FIELDS | OP_PARSE_LAZY | OP_VALIDATE},
+    {"lists",
+     &bench_lists_schema,
+     build_lists,
+     OP_ALL | OP_PARSE_LAZY | OP_VALIDATE},
+    {"repeated",
+     &bench_item_schema,
+     build_items,
+     (OP_ALL & ~OP_PARSE) | OP_RECORDS},
+    {"reversed", &bench_wide_schema, build_reversed, OP_PARSE},
+    {"comments", &bench_wide_schema, build_comments, OP_ALL},
+    {"numeric",
+     &bench_numeric_schema,
+     build_numeric,
+     OP_ALL | OP_PARSE_FIELDS | OP_PARSE_LAZY | OP_VALIDATE},
+};
+
+enum format
+{
+    FORMAT_TABLE,
+    FORMAT_CSV,
+    FORMAT_JSON
+};
+
+struct cfg
+{
+    enum format format;
+    double      min_time;
+    const char* filter;
+    const char* label;
+};
+
+struct result
+{
+    const char* workload;
+    const char* op;
+    long        iterations;
+    double      seconds;
+    double      bytes;
+    double      keys;
+};
+
+static int results_printed = 0;
+
+static void print_result(const struct cfg* cfg, const struct result* r)
+{
+    double mb_per_s = r->bytes / r->seconds / 1e6;
+    double ns_per_key = r->seconds * 1e9 / r->keys;
+
+    switch (cfg->format)
+    {
+        case FORMAT_TABLE:
+            if (results_printed == 0)
+                printf(
+                    "%-10s %-11s %10s %10s %10s %12s\n",
+                    "workload",
+                    "op",
+                    "iterations",
+                    "seconds",
+                    "MB/s",
+                    "ns/key");
+            printf(
+                "%-10s %-11s %10ld %10.4f %10.2f %12.2f\n",
+                r->workload,
+                r->op,
+                r->iterations,
+                r->seconds,
+                mb_per_s,
+                ns_per_key);
+            break;
+        case FORMAT_CSV:
+            if (results_printed == 0)
+                printf("label,workload,op,iterations,seconds,bytes,keys,"
+                       "mb_per_s,ns_per_key\n");
+            printf(
+                "%s,%s,%s,%ld,%.6f,%.0f,%.0f,%.3f,%.3f\n",
+                cfg->label,
+                r->workload,
+                r->op,
+                r->iterations,
+                r->seconds,
+                r->bytes,
+                r->keys,
+                mb_per_s,
+                ns_per_key);
+            break;
+        case FORMAT_JSON:
+            printf(
+                "%s\n    {\"workload\": \"%s\", \"op\": \"%s\", "
+                "\"iterations\": %ld, \"seconds\": %.6f, \"bytes\": %.0f, "
+                "\"keys\": %.0f, \"mb_per_s\": %.3f, \"ns_per_key\": %.3f}",
+                results_printed ? "," : "",
+                r->workload,
+                r->op,
+                r->iterations,
+                r->seconds,
+                r->bytes,
+                r->keys,
+                mb_per_s,
+                ns_per_key);
+            break;
+    }
+    results_printed++;
+    fflush(stdout);
+}
+
+static void report(
+    const struct cfg*      cfg,
+    const struct workload* w,
+    const char*            op,
+    long                   iterations,
+    double                 seconds,
+    double                 bytes,
+    double                 keys)
+{
+    struct result r;
+    r.workload = w->name;
+    r.op = op;
+    r.iterations = iterations;
+    r.seconds = seconds;
+    r.bytes = bytes;
+    r.keys = keys;
+    print_result(cfg, &r);
+}
+
+/* _init and _deinit are measured together on a batch of structs, since every
+ * struct that is initialized has to be deinitialized again */
+static int bench_init_deinit(const struct cfg* cfg, const struct workload* w)
+{
+    const struct schema* schema = w->schema;
+    char*                structs = malloc((size_t)schema->size * BATCH);
+    double               init_time = 0.0, deinit_time = 0.0, start;
+    long                 iterations = 0;
+    int                  i;
+
+    if (structs == NULL)
+        return -1;
+
+    while (init_time + deinit_time < cfg->min_time)
+    {
+        start = now();
+        for (i = 0; i != BATCH; ++i)
+            if (schema->init(structs + i * schema->size) != 0)
+                goto fail;
+        init_time += now() - start;
+
+        start = now();
+        for (i = 0; i != BATCH; ++i)
+            schema->deinit(structs + i * schema->size);
+        deinit_time += now() - start;
+
+        iterations += BATCH;
+    }
+
+    if (w->ops & OP_INIT)
+        report(
+            cfg,
+            w,
+            "_init",
+            iterations,
+            init_time,
+            (double)iterations * schema->size,
+            (double)iterations * schema->fields);
+    if (w->ops & OP_DEINIT)
+        report(
+            cfg,
+            w,
+            "_deinit",
+            iterations,
+            deinit_time,
+            (double)iterations * schema->size,
+            (double)iterations * schema->fields);
+
+    free(structs);
+    return 0;
+
+fail:
+    while (i--)
+        schema->deinit(structs + i * schema->size);
+    free(structs);
+    return -1;
+}
+
+static int bench_parse(
+    const struct cfg*      cfg,
+    const struct workload* w,
+    const struct corpus*   c,
+    enum op                op)
+{
+    int (*parse)(void*, const char*, int) =
+        op == OP_PARSE_ALL      ? w->schema->parse_all
+        : op == OP_PARSE_FIELDS ? w->schema->parse_fields
+        : op == OP_PARSE_LAZY   ? w->schema->parse_lazy
+        : op == OP_VALIDATE     ? w->schema->validate
+                                : w->schema->parse;
+    const char* name = op == OP_PARSE_ALL      ? "_parse_all"
+                       : op == OP_PARSE_FIELDS ? "_parse_fields"
+                       : op == OP_PARSE_LAZY   ? "_parse_lazy"
+                       : op == OP_VALIDATE     ? "_validate"
+                                               : "_parse";
+    void*       s = malloc(w->schema->size);
+    double start, elapsed = 0.0;
+    long   iterations = 0;
+
+    if (s == NULL || w->schema->init(s) != 0)
+    {
+        free(s);
+        return -1;
+    }
+
+    while (elapsed < cfg->min_time)
+    {
+        start = now();
+        if (parse(s, c->data, c->len) != 0)
+        {
+            w->schema->deinit(s);
+            free(s);
+            return -1;
+        }
+        elapsed += now() - start;
+        iterations++;
+    }
+
+    report(
+        cfg,
+        w,
+        name,
+        iterations,
+        elapsed,
+        (double)iterations * c->len,
+        (double)iterations * c->keys);
+
+    w->schema->deinit(s);
+    free(s);
+    return 0;
+}
+
+static int bench_fwrite(
+    const struct cfg* cfg, const struct workload* w, const struct corpus* c)
+{
+    void*  s = malloc(w->schema->size);
+    FILE*  fp;
+    double start, elapsed = 0.0;
+    long   iterations = 0, written;
+
+    if (s == NULL || w->schema->init(s) != 0)
+    {
+        free(s);
+        return -1;
+    }
+    if (w->schema->parse_all(s, c->data, c->len) != 0)
+        goto fail;
+
+    /* Find out how many bytes are written once, then measure against the null
+     * device so that the disk doesn't factor into it */
+    fp = tmpfile();
+    if (fp == NULL || w->schema->write(s, fp) != 0)
+        goto fail;
+    written = ftell(fp);
+    fclose(fp);
+
+    fp = fopen(NULL_DEVICE, "wb");
+    if (fp == NULL)
+        goto fail;
+    while (elapsed < cfg->min_time)
+    {
+        start = now();
+        w->schema->write(s, fp);
+        fflush(fp);
+        elapsed += now() - start;
+        iterations++;
+    }
+    fclose(fp);
+
+    report(
+        cfg,
+        w,
+        "_fwrite",
+        iterations,
+        elapsed,
+        (double)iterations * written,
+        (double)iterations * w->schema->fields);
+
+    w->schema->deinit(s);
+    free(s);
+    return 0;
+
+fail:
+    w->schema->deinit(s);
+    free(s);
+    return -1;
+}
+
+static int on_item_record(struct c_ini_parser* p, void* user_ptr)
+{
+    struct bench_item** tail = user_ptr;
+    struct bench_item*  item = malloc(sizeof *item);
+    if (item == NULL || bench_item_init(item) != 0)
+    {
+        free(item);
+        return -1;
+    }
+    item->next = *tail;
+    *tail = item;
+    return bench_item_parse_section(item, p);
+}
+
+static int load_records(const struct corpus* c)
+{
+    struct bench_item* items = NULL;
+    struct bench_item* next;
+    int                result = bench_item_parse_all(
+        "<bench>", c->data, c->len, on_item_record, &items);
+    for (; items; items = next)
+    {
+        next = items->next;
+        bench_item_deinit(items);
+        free(items);
+    }
+    return result;
+}
+
+static int load_pool(const struct corpus* c)
+{
+    struct bench_item_pool pool;
+    int                    result;
+    bench_item_pool_init(&pool, NULL);
+    result = bench_item_parse_all_into_pool(
+        &pool, "<bench>", c->data, c->len, NULL);
+    bench_item_pool_deinit(&pool);
+    return result;
+}
+
+static int load_columns(const struct corpus* c)
+{
+    uint32_t fields[C_INI_FIELD_WORDS(BENCH_ITEM_FIELDS_COUNT)] = {0};
+    struct bench_item_columns columns;
+    int                       result;
+    C_INI_FIELD_SET(fields, BENCH_ITEM_FIELD_ID);
+    C_INI_FIELD_SET(fields, BENCH_ITEM_FIELD_WEIGHT);
+    bench_item_columns_init(&columns, fields, NULL);
+    result = bench_item_parse_all_into_columns(
+        &columns, "<bench>", c->data, c->len, NULL);
+    bench_item_columns_deinit(&columns);
+    return result;
+}
+
+static int bench_records(
+    const struct cfg* cfg, const struct workload* w, const struct corpus* c)
+{
+    int (*load[3])(const struct corpus*) = {
+        load_records, load_pool, load_columns};
+    const char* names[3] = {"_records", "_pool", "_columns"};
+    int         i;
+
+    for (i = 0; i != 3; ++i)
+    {
+        double start, elapsed = 0.0;
+        long   iterations = 0;
+        while (elapsed < cfg->min_time)
+        {
+            start = now();
+            if (load[i](c) != 0)
+                return -1;
+            elapsed += now() - start;
+            iterations++;
+        }
+        report(
+            cfg,
+            w,
+            names[i],
+            iterations,
+            elapsed,
+            (double)iterations * c->len,
+            (double)iterations * c->keys);
+    }
+    return 0;
+}
+
+static int run_workload(const struct cfg* cfg, const struct workload* w)
+{
+    struct corpus c = {NULL, 0, 0, 0};
+    int           result = -1;
+
+    w->build(&c);
+
+    if (w->ops & (OP_INIT | OP_DEINIT))
+        if (bench_init_deinit(cfg, w) != 0)
+            goto out;
+    if (w->ops & OP_PARSE)
+        if (bench_parse(cfg, w, &c, OP_PARSE) != 0)
+            goto out;
+    if (w->ops & OP_PARSE_ALL)
+        if (bench_parse(cfg, w, &c, OP_PARSE_ALL) != 0)
+            goto out;
+    if (w->ops & OP_PARSE_FIELDS)
+        if (bench_parse(cfg, w, &c, OP_PARSE_FIELDS) != 0)
+            goto out;
+    if (w->ops & OP_PARSE_LAZY)
+        if (bench_parse(cfg, w, &c, OP_PARSE_LAZY) != 0)
+            goto out;
+    if (w->ops & OP_VALIDATE)
+        if (bench_parse(cfg, w, &c, OP_VALIDATE) != 0)
+            goto out;
+    if (w->ops & OP_FWRITE)
+        if (bench_fwrite(cfg, w, &c) != 0)
+            goto out;
+    if (w->ops & OP_RECORDS)
+        if (bench_records(cfg, w, &c) != 0)
+            goto out;
+    result = 0;
+
+out:
+    if (result != 0)
+        fprintf(stderr, "Workload \"%s\" failed\n", w->name);
+    free(c.data);
+    return result;
+}
+
+static int parse_cmdline(int argc, char** argv, struct cfg* cfg)
+{
+    int i;
+
+    cfg->format = FORMAT_TABLE;
+    cfg->min_time = 0.25;
+    cfg->filter = NULL;
+    cfg->label = "";
+
+    for (i = 1; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "table") == 0)
+                cfg->format = FORMAT_TABLE;
+            else if (strcmp(argv[i], "csv") == 0)
+                cfg->format = FORMAT_CSV;
+            else if (strcmp(argv[i], "json") == 0)
+                cfg->format = FORMAT_JSON;
+            else
+                goto usage;
+        }
+        else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+            cfg->min_time = atof(argv[++i]);
+        else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+            cfg->filter = argv[++i];
+        else if (strcmp(argv[i], "--label") == 0 && i + 1 < argc)
+            cfg->label = argv[++i];
+        else
+            goto usage;
+    }
+
+    return 0;
+
+usage:
+    fprintf(
+        stderr,
+        "Usage: %s [--format table|csv|json] [--min-time <seconds>]\n"
+        "          [--filter <workload>] [--label <text>]\n",
+        argv[0]);
+    return -1;
+}
+
+int main(int argc, char** argv)
+{
+    struct cfg cfg;
+    int        i, result = EXIT_SUCCESS;
+
+    if (parse_cmdline(argc, argv, &cfg) != 0)
+        return EXIT_FAILURE;
+
+    if (cfg.format == FORMAT_JSON)
+        printf("{\n  \"label\": \"%s\",\n  \"results\": [", cfg.label);
+
+    for (i = 0; i != (int)(sizeof(workloads) / sizeof(*workloads)); ++i)
+    {
+        if (cfg.filter && strcmp(cfg.filter, workloads[i].name) != 0)
+            continue;
+        if (run_workload(&cfg, &workloads[i]) != 0)
+            result = EXIT_FAILURE;
+    }
+
+    if (cfg.format == FORMAT_JSON)
+        printf("\n  ]\n}\n");
+
+    return result;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+ * Shape of the synthetic schemas used by c_ini_bench. The schema header is
+ * written at build time by c_ini_bench_schema and the corpora are built in
+ * memory by c_ini_bench, so both need to agree on field names and types.
+ */
+
+/* One section with many keys of mixed types */
+#define BENCH_WIDE_FIELDS 256
+/* One section with only integers, floats and booleans */
+#define BENCH_NUMERIC_FIELDS 192
+/* Dynamic string lists with many elements, plus one fixed list */
+#define BENCH_LISTS           4
+#define BENCH_LIST_ITEMS      256
+#define BENCH_FIXED_LIST_SIZE 16
+/* Many small sections with the same name */
+#define BENCH_ITEMS 20000
+
+enum bench_type
+{
+    BENCH_INT,
+    BENCH_FLOAT,
+    BENCH_BOOL,
+    BENCH_STR_FIXED,
+    BENCH_STR_DYNAMIC
+};
+
+static enum bench_type bench_wide_type(int field)
+{
+    switch (field % 5)
+    {
+        case 0: return BENCH_INT;
+        case 1: return BENCH_FLOAT;
+        case 2: return BENCH_STR_FIXED;
+        case 3: return BENCH_STR_DYNAMIC;
+    }
+    return BENCH_BOOL;
+}
+
+static enum bench_type bench_numeric_type(int field)
+{
+    switch (field % 3)
+    {
+        case 0: return BENCH_INT;
+        case 1: return BENCH_FLOAT;
+    }
+    return BENCH_BOOL;
+}
@@ -0,0 +1,88 @@
+/*
+ * Writes the schema header that c_ini_bench is generated from.
+ *
+ * Usage: c_ini_bench_schema <output.h>
+ */
+#include "bench_runtime.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static void write_field(FILE* fp, enum bench_type type, char prefix, int i)
+{
+    switch (type)
+    {
+        case BENCH_INT:
+            fprintf(fp, "    int %c%d DEFAULT(%d);\n", prefix, i, i);
+            break;
+        case BENCH_FLOAT:
+            fprintf(fp, "    float %c%d DEFAULT(%d.5);\n", prefix, i, i);
+            break;
+        case BENCH_BOOL: fprintf(fp, "    bool %c%d;\n", prefix, i); break;
+        case BENCH_STR_FIXED:
+            fprintf(fp, "    char %c%d[32] DEFAULT(\"v%d\");\n", prefix, i, i);
+            break;
+        case BENCH_STR_DYNAMIC:
+            fprintf(fp, "    char* %c%d DEFAULT(\"v%d\");\n", prefix, i, i);
+            break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    FILE* fp;
+    int   i;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s <output.h>\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    fp = fopen(argv[1], "wb");
+    if (fp == NULL)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(fp, "#pragma once\n\n");
+    fprintf(fp, "#include \"c-ini.h\"\n");
+    fprintf(fp, "#include <stdbool.h>\n#include <stdint.h>\n\n");
+
+    fprintf(fp, "SECTION(\"wide\") WITH(lazy)\nstruct bench_wide\n{\n");
+    for (i = 0; i != BENCH_WIDE_FIELDS; ++i)
+        write_field(fp, bench_wide_type(i), 'w', i);
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "SECTION(\"numeric\") WITH(lazy)\nstruct bench_numeric\n{\n");
+    for (i = 0; i != BENCH_NUMERIC_FIELDS; ++i)
+        write_field(fp, bench_numeric_type(i), 'n', i);
+    fprintf(fp, "};\n\n");
+
+    fprintf(fp, "SECTION(\"lists\") WITH(lazy)\nstruct bench_lists\n{\n");
+    for (i = 0; i != BENCH_LISTS; ++i)
+        fprintf(fp, "    char** l%d;\n", i);
+    fprintf(fp, "    char fixed[%d][32];\n", BENCH_FIXED_LIST_SIZE);
+    fprintf(fp, "};\n\n");
+
+    fprintf(
+        fp,
+        "SECTION(\"item\") WITH(lazy) WITH(columns)\n"
+        "struct bench_item\n"
+        "{\n"
+        "    int   id;\n"
+        "    float weight;\n"
+        "    char  name[32];\n"
+        "    char* tag;\n"
+        "    bool  enabled;\n"
+        "    struct bench_item* next IGNORE();\n"
+        "};\n");
+
+    if (fclose(fp) != 0)
+    {
+        perror(argv[1]);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -4,9 +4,11 @@
 #else
 #    define _GNU_SOURCE
 #    include <errno.h>
+#    include <pthread.h>
 #    include <sys/fcntl.h>
 #    include <sys/mman.h>
 #    include <sys/stat.h>
+#    include <time.h>
 #    include <unistd.h>
 #endif
 
@@ -74,6 +76,28 @@ static const char* reset_style(void)
     return disable_colors ? "" : "\033[0m";
 }
 
+/*! Input files are parsed on several threads. Locking stderr keeps error
+ * messages printed by different threads from interleaving. */
+#if defined(WIN32)
+static void lock_stderr(void)
+{
+    _lock_file(stderr);
+}
+static void unlock_stderr(void)
+{
+    _unlock_file(stderr);
+}
+#else
+static void lock_stderr(void)
+{
+    flockfile(stderr);
+}
+static void unlock_stderr(void)
+{
+    funlockfile(stderr);
+}
+#endif
+
 static void print_vflc(
     const char*    filename,
     const char*    source,
@@ -246,8 +270,10 @@ static int print_error(const char* fmt, ...)
 {
     va_list ap;
     va_start(ap, fmt);
+    lock_stderr();
     fprintf(stderr, "%serror:%s ", error_style(), reset_style());
     vfprintf(stderr, fmt, ap);
+    unlock_stderr();
     va_end(ap);
 
     return -1;
@@ -693,6 +719,83 @@ static int file_is_source_file(const char* filename)
            strcmp(&filename[len - 3], ".cc") == 0;
 }
 
+/*! Monotonic wall clock in seconds */
+static double clock_seconds(void)
+{
+#if defined(WIN32)
+    LARGE_INTEGER freq, count;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (double)count.QuadPart / (double)freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+#endif
+}
+
+enum stats_phase
+{
+    PHASE_MAP,
+    PHASE_SCAN,
+    PHASE_PARSE,
+    PHASE_EMIT,
+    PHASE_COMPARE,
+    PHASE_COUNT
+};
+
+/*!
+ * Numbers collected with --stats. Input files are parsed on several threads,
+ * so each file gets its own instance, which are summed up once all threads
+ * are done. Times of the map, scan and parse phases are therefore the sum over
+ * all threads and not wall time.
+ */
+struct stats
+{
+    double time[PHASE_COUNT];
+    long   input_bytes;
+    long   tokens;
+    long   emitted_bytes;
+    int    files_written;
+    int    files_unchanged;
+};
+
+/*! Points to the stats being collected, or is NULL without --stats */
+static struct stats* global_stats = NULL;
+
+static double stats_start(const struct stats* stats)
+{
+    return stats ? clock_seconds() : 0.0;
+}
+
+/*!
+ * \brief Adds the time since "start" to a phase.
+ * \return Returns the current time, which can be used as the start of the
+ * next phase.
+ */
+static double
+stats_lap(struct stats* stats, enum stats_phase phase, double start)
+{
+    double now;
+    if (stats == NULL)
+        return 0.0;
+    now = clock_seconds();
+    stats->time[phase] += now - start;
+    return now;
+}
+
+static void stats_add(struct stats* total, const struct stats* stats)
+{
+    int phase;
+    for (phase = 0; phase != PHASE_COUNT; ++phase)
+        total->time[phase] += stats->time[phase];
+    total->input_bytes += stats->input_bytes;
+    total->tokens += stats->tokens;
+    total->emitted_bytes += stats->emitted_bytes;
+    total->files_written += stats->files_written;
+    total->files_unchanged += stats->files_unchanged;
+}
+
 /*! A memory buffer that grows as data is added. */
 struct mstream
 {
@@ -767,7 +870,8 @@ static void mstream_write_int(struct mstream* ms, int in)
 static void mstream_write_float(struct mstream* ms, double value)
 {
     mstream_grow(ms, 32);
-    ms->write_ptr += sprintf((char*)ms->address + ms->write_ptr, "%.9g", value);
+    ms->write_ptr +=
+        sprintf((char*)ms->address + ms->write_ptr, "%.17g", value);
 }
 /*! Write a C-string to the mstream buffer */
 static void mstream_cstr(struct mstream* ms, const char* cstr)
@@ -786,6 +890,19 @@ static void mstream_str(struct mstream* ms, struct strview str)
     ms->write_ptr += str.len;
 }
 
+/*! Write the contents of another mstream, with every line indented once more */
+static void mstream_indented(struct mstream* ms, const struct mstream* src)
+{
+    const char* data = (const char*)src->address;
+    int         i;
+    for (i = 0; i != src->write_ptr; ++i)
+    {
+        if ((i == 0 || data[i - 1] == '\n') && data[i] != '\n')
+            mstream_cstr(ms, "    ");
+        mstream_putc(ms, data[i]);
+    }
+}
+
 /*!
  * \brief Write a formatted string to the mstream buffer.
  * This function is similar to printf() but only implements a subset of the
@@ -794,6 +911,7 @@ static void mstream_str(struct mstream* ms, struct strview str)
  *   %d - Write an integer (int)
  *   %s - Write a c-string (const char*)
  *   %S - Write a string view (struct strview, const char*)
+ *   %U - Write a string view in upper case
  * \param[in] ms Pointer to mstream structure.
  * \param[in] fmt Format string.
  * \param[in] ... Additional parameters.
@@ -818,6 +936,14 @@ static void mstream_fmt(struct mstream* ms, const char* fmt, ...)
                     mstream_str(ms, str);
                     continue;
                 }
+                case 'U': {
+                    struct strview str = va_arg(va, struct strview);
+                    int            c;
+                    for (c = 0; c != str.len; ++c)
+                        mstream_putc(
+                            ms, (char)toupper((unsigned char)str.source[str.off + c]));
+                    continue;
+                }
             }
         mstream_putc(ms, fmt[i]);
     }
@@ -827,6 +953,10 @@ static void mstream_fmt(struct mstream* ms, const char* fmt, ...)
 static int write_if_different(const struct mstream* ms, const char* filename)
 {
     struct mfile mf;
+    double       start = stats_start(global_stats);
+
+    if (global_stats)
+        global_stats->emitted_bytes += ms->write_ptr;
 
     /* Don't write resource if it is identical to the existing one -- causes
      * less rebuilds */
@@ -834,7 +964,13 @@ static int write_if_different(const struct mstream* ms, const char* filename)
     {
         if (mf.size == ms->write_ptr &&
             memcmp(mf.address, ms->address, mf.size) == 0)
+        {
+            mfile_unmap(&mf);
+            if (global_stats)
+                global_stats->files_unchanged++;
+            stats_lap(global_stats, PHASE_COMPARE, start);
             return 0;
+        }
         mfile_unmap(&mf);
     }
 
@@ -844,6 +980,17 @@ static int write_if_different(const struct mstream* ms, const char* filename)
     memcpy(mf.address, ms->address, ms->write_ptr);
     mfile_unmap(&mf);
 
+    if (global_stats)
+        global_stats->files_written++;
+    stats_lap(global_stats, PHASE_COMPARE, start);
+    return 0;
+}
+
+static int write_stdout(const struct mstream* ms)
+{
+    if (global_stats)
+        global_stats->emitted_bytes += ms->write_ptr;
+    fwrite(ms->address, ms->write_ptr, 1, stdout);
     return 0;
 }
 
@@ -862,10 +1009,16 @@ struct cfg
 {
     char**             input_fnames;
     char**             c_includes;
+    char**             shards;
     const char*        output_header;
     const char*        output_source;
+    const char*        output_shard_dir;
+    const char*        shard_prefix;
     int                input_count;
     int                c_includes_count;
+    int                shard_count;
+    int                jobs;
+    int                stats;
     enum output_format output_format;
 };
 
@@ -902,6 +1055,33 @@ static int print_help(const char* prog_name)
     fprintf(stderr,
 "  --c-includes <additional files to include...>\n"
 "        Prepend additional header files to include in the generated C file.\n");
+    fprintf(stderr,
+"  --output-shards <directory>\n"
+"        Instead of a single C file, write one C file per section named\n"
+"        <struct name>.c, plus a shared c_ini_runtime.c and c_ini_runtime.h.\n"
+"        The shards can be compiled in parallel, and only shards of sections\n"
+"        that changed are rewritten.\n");
+    fprintf(stderr,
+"  --shard-prefix <prefix>\n"
+"        Prefix for the symbols shared between shards. Use a unique prefix\n"
+"        for every sharded parser linked into the same program. The default\n"
+"        is \"c_ini_\".\n");
+    fprintf(stderr,
+"  --shards <struct name...>\n"
+"        The shards that the build system expects. Fails if they don't match\n"
+"        the struct names of the sections that were found.\n");
+    fprintf(stderr,
+"  -j, --jobs <count>\n"
+"        Number of threads used to scan the input files. The default is the\n"
+"        number of CPUs.\n");
+    fprintf(stderr,
+"  --stats\n"
+"        Print how much time was spent mapping, scanning and parsing input\n"
+"        files, emitting code and comparing it with existing output files,\n"
+"        as well as the number of tokens, sections, keys and emitted bytes.\n");
+    fprintf(stderr,
+"  --input, --output-source, --output-header, --include-files\n"
+"        Long forms of -i, -o <file.c>, -o <file.h> and --c-includes.\n");
     /* clang-format on */
     return 1;
 }
@@ -912,12 +1092,14 @@ static int parse_cmdline(int argc, char** argv, struct cfg* cfg)
 
     /* defaults */
     cfg->output_format = OUTPUT_C;
+    cfg->shard_prefix = "c_ini_";
 
     for (i = 1; i < argc; ++i)
     {
         if (strcmp(argv[i], "-h") == 0 || strcmp(argv[i], "--help") == 0)
             return print_help(argv[0]);
-        else if (strcmp(argv[i], "-i") == 0)
+        else if (
+            strcmp(argv[i], "-i") == 0 || strcmp(argv[i], "--input") == 0)
         {
             cfg->input_fnames = &argv[i + 1];
             cfg->input_count = 0;
@@ -955,7 +1137,54 @@ static int parse_cmdline(int argc, char** argv, struct cfg* cfg)
                 return print_error(
                     "Unknown format \"%s\" to option -f\n", argv[i]);
         }
-        else if (strcmp(argv[i], "--c-includes") == 0)
+        else if (strcmp(argv[i], "--output-source") == 0)
+        {
+            if (++i >= argc)
+                return print_error(
+                    "Missing filename to option --output-source\n");
+            cfg->output_source = argv[i];
+        }
+        else if (strcmp(argv[i], "--output-header") == 0)
+        {
+            if (++i >= argc)
+                return print_error(
+                    "Missing filename to option --output-header\n");
+            cfg->output_header = argv[i];
+        }
+        else if (strcmp(argv[i], "-j") == 0 || strcmp(argv[i], "--jobs") == 0)
+        {
+            if (++i >= argc)
+                return print_error("Missing thread count to option --jobs\n");
+            cfg->jobs = atoi(argv[i]);
+            if (cfg->jobs < 1)
+                return print_error(
+                    "Invalid thread count \"%s\" to option --jobs\n", argv[i]);
+        }
+        else if (strcmp(argv[i], "--stats") == 0)
+            cfg->stats = 1;
+        else if (strcmp(argv[i], "--output-shards") == 0)
+        {
+            if (++i >= argc)
+                return print_error(
+                    "Missing directory to option --output-shards\n");
+            cfg->output_shard_dir = argv[i];
+        }
+        else if (strcmp(argv[i], "--shard-prefix") == 0)
+        {
+            if (++i >= argc)
+                return print_error("Missing prefix to option --shard-prefix\n");
+            cfg->shard_prefix = argv[i];
+        }
+        else if (strcmp(argv[i], "--shards") == 0)
+        {
+            cfg->shards = &argv[i + 1];
+            cfg->shard_count = 0;
+            for (; i + 1 < argc && argv[i + 1][0] != '-'; i++)
+                cfg->shard_count++;
+        }
+        else if (
+            strcmp(argv[i], "--c-includes") == 0 ||
+            strcmp(argv[i], "--include-files") == 0)
         {
             cfg->c_includes = &argv[i + 1];
             cfg->c_includes_count = 0;
@@ -1013,11 +1242,13 @@ struct parser
         int64_t        integer;
         double         floating;
     } value;
-    const char* filename;
-    const char* data;
-    int         tail;
-    int         head;
-    int         end;
+    const char*   filename;
+    const char*   data;
+    struct stats* stats;
+    long          tokens;
+    int           tail;
+    int           head;
+    int           end;
 };
 
 static void
@@ -1025,6 +1256,8 @@ parser_init(struct parser* p, const struct mfile* mf, const char* filename)
 {
     p->filename = filename;
     p->data = (char*)mf->address;
+    p->stats = NULL;
+    p->tokens = 0;
     p->end = mf->size;
     p->head = 0;
     p->tail = 0;
@@ -1038,16 +1271,19 @@ static int parser_error(const struct parser* p, const char* fmt, ...)
     loc.off = p->tail;
     loc.len = p->head - p->tail;
 
+    lock_stderr();
     va_start(ap, fmt);
     print_vflc(p->filename, p->data, loc, fmt, ap);
     va_end(ap);
     print_excerpt(p->data, loc);
+    unlock_stderr();
 
     return -1;
 }
 
 enum token scan_next(struct parser* p)
 {
+    p->tokens++;
     p->tail = p->head;
     while (p->head != p->end)
     {
@@ -1181,16 +1417,132 @@ enum token scan_next(struct parser* p)
     return TOK_END;
 }
 
+/*! memmem() is a GNU extension */
+static const char*
+find_bytes(const char* data, int len, const char* needle, int needle_len)
+{
+#if defined(WIN32)
+    const char* end = data + len - needle_len + 1;
+    while (data < end)
+    {
+        data = memchr(data, needle[0], end - data);
+        if (data == NULL)
+            return NULL;
+        if (memcmp(data, needle, needle_len) == 0)
+            return data;
+        data++;
+    }
+    return NULL;
+#else
+    return memmem(data, len, needle, needle_len);
+#endif
+}
+
+static int is_identifier_char(char c)
+{
+    return isalnum(c) || c == '_' || c == '-';
+}
+
+/*!
+ * \brief Advances p->head to the offset "until", skipping over comments and
+ * string literals the same way scan_next() does. If "until" lies within a
+ * comment or string literal, then p->head will end up past it.
+ */
+static int skip_comments_and_strings(struct parser* p, int until)
+{
+    const char* slash = NULL;
+    const char* quote = NULL;
+
+    while (p->head < until)
+    {
+        const char* next;
+        if (slash < p->data + p->head)
+            slash = memchr(p->data + p->head, '/', until - p->head);
+        if (quote < p->data + p->head)
+            quote = memchr(p->data + p->head, '"', until - p->head);
+        next = slash && (quote == NULL || slash < quote) ? slash : quote;
+        if (next == NULL)
+        {
+            p->head = until;
+            break;
+        }
+
+        p->tail = p->head = (int)(next - p->data);
+        if (*next == '"')
+        {
+            for (p->head++; p->head != p->end; ++p->head)
+                if (p->data[p->head] == '"' && p->data[p->head - 1] != '\\')
+                    break;
+            if (p->head == p->end)
+                return parser_error(p, "Missing closing quote on string\n");
+            p->head++;
+        }
+        else if (p->head + 1 < p->end && p->data[p->head + 1] == '*')
+        {
+            for (p->head += 2; p->head != p->end; p->head++)
+                if (p->data[p->head] == '*' && p->head + 1 != p->end &&
+                    p->data[p->head + 1] == '/')
+                {
+                    p->head += 2;
+                    break;
+                }
+            if (p->head == p->end)
+                return parser_error(p, "Missing closing comment\n");
+        }
+        else if (p->head + 1 < p->end && p->data[p->head + 1] == '/')
+        {
+            for (p->head += 2; p->head != p->end; p->head++)
+                if (p->data[p->head] == '\n')
+                {
+                    p->head++;
+                    break;
+                }
+        }
+        else
+            p->head++;
+    }
+
+    return 0;
+}
+
+/*!
+ * \brief Finds the next SECTION identifier.
+ * Tokenizing all of the C code in between is wasted effort, so memmem() (which
+ * is vectorized in most C libraries) is used to jump from candidate to
+ * candidate instead. Only comments and string literals between candidates
+ * need to be looked at, because a SECTION inside of those doesn't count.
+ */
 enum token scan_until_section(struct parser* p)
 {
-    enum token tok;
+    static const char section[] = "SECTION";
+    const int         len = (int)sizeof(section) - 1;
+    const char*       candidate;
+    int               off;
+
     while (1)
     {
-        tok = scan_next(p);
-        if (tok == TOK_END || tok == TOK_ERROR)
-            return tok;
-        if (tok == TOK_IDENTIFIER && cstr_equal("SECTION", p->value.str))
-            return tok;
+        candidate =
+            find_bytes(p->data + p->head, p->end - p->head, section, len);
+        if (candidate == NULL)
+        {
+            p->tail = p->head = p->end;
+            return TOK_END;
+        }
+
+        off = (int)(candidate - p->data);
+        if (skip_comments_and_strings(p, off) != 0)
+            return TOK_ERROR;
+        if (p->head > off)
+            continue; /* Was in a comment or string literal */
+
+        if ((off > 0 && is_identifier_char(p->data[off - 1])) ||
+            (off + len < p->end && is_identifier_char(p->data[off + len])))
+        {
+            p->head = off + len; /* Part of a longer identifier */
+            continue;
+        }
+
+        return scan_next(p);
     }
 }
 
@@ -1206,6 +1558,18 @@ static void ll_append(struct ll** head, struct ll* node)
     *head = node;
 }
 
+/*!
+ * \brief Appends in O(1) by remembering where the next pointer of the last node
+ * is. A NULL tail means the list is empty.
+ */
+static void ll_append_tail(struct ll** head, struct ll*** tail, struct ll* node)
+{
+    if (*tail == NULL)
+        *tail = head;
+    **tail = node;
+    *tail = &node->next;
+}
+
 static void ll_remove(struct ll** node)
 {
     *node = (*node)->next;
@@ -1285,6 +1649,8 @@ struct attributes
     struct value   min, max;
     struct strview str_api_prefix;
     struct strview strlist_api_prefix;
+    /* Set by MEMORY(). The custom string API provides a _memory() function */
+    int has_memory_api;
 };
 
 struct key
@@ -1295,6 +1661,23 @@ struct key
     enum c_data_type  type;
 };
 
+/*!
+ * Functions that only some structs need, enabled with WITH(<name>) after
+ * SECTION(). Each of them adds a lot of generated code per struct.
+ */
+enum feature
+{
+    FEATURE_COLUMNS = 1,
+    FEATURE_LAZY = 2,
+    FEATURE_LAYERS = 4,
+    FEATURE_WATCH = 8,
+    FEATURE_HANDLE = 16,
+    FEATURE_SHM = 32
+};
+
+static const char* feature_names[] = {
+    "columns", "lazy", "layers", "watch", "handle", "shm"};
+
 struct section
 {
     struct section* next;
@@ -1302,11 +1685,17 @@ struct section
     struct strview  struct_name;
     struct strview  struct_def;
     struct key*     keys;
+    struct key**    keys_tail;
+    /* Set if the struct has IGNORE()d members of unknown types, which have no
+     * key, so the keys don't describe every member */
+    int has_unknown_members;
+    int features;
 };
 
 struct root
 {
-    struct section* sections;
+    struct section*  sections;
+    struct section** sections_tail;
 };
 
 static struct strlist* strlist_create(struct strview str)
@@ -1326,7 +1715,13 @@ static struct section* section_create(
     section->struct_name = struct_name;
     section->struct_def = empty_strview();
     section->keys = NULL;
-    ll_append((struct ll**)&root->sections, (struct ll*)section);
+    section->keys_tail = NULL;
+    section->has_unknown_members = 0;
+    section->features = 0;
+    ll_append_tail(
+        (struct ll**)&root->sections,
+        (struct ll***)&root->sections_tail,
+        (struct ll*)section);
     return section;
 }
 
@@ -1338,7 +1733,10 @@ key_create(struct section* section, struct strview name, enum c_data_type type)
     key->name = name;
     key->type = type;
     memset(&key->attr, 0, sizeof(key->attr));
-    ll_append((struct ll**)&section->keys, (struct ll*)key);
+    ll_append_tail(
+        (struct ll**)&section->keys,
+        (struct ll***)&section->keys_tail,
+        (struct ll*)key);
     return key;
 }
 
@@ -1790,6 +2188,31 @@ parse_custom_strlist(struct parser* p, struct attributes* attr)
     return scan_next(p);
 }
 
+static enum token parse_attribute_memory(
+    struct parser* p, enum c_data_type type, struct attributes* attr)
+{
+    if (scan_next(p) != '(')
+        return parser_error(p, "Expected '(' after 'MEMORY'\n");
+    if (scan_next(p) != ')')
+        return parser_error(p, "Missing closing ')' for 'MEMORY()'\n");
+
+    switch (type)
+    {
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM: break;
+        default:
+            return parser_error(
+                p,
+                "MEMORY() can only be used on dynamic strings and string "
+                "lists\n");
+    }
+
+    attr->has_memory_api = 1;
+    return scan_next(p);
+}
+
 static enum token parse_attributes(
     struct parser* p, enum token tok, enum c_data_type type, struct key** key)
 {
@@ -1808,6 +2231,8 @@ static enum token parse_attributes(
             tok = parse_custom_string(p, &(*key)->attr);
         else if (cstr_equal("STRINGLIST", p->value.str))
             tok = parse_custom_strlist(p, &(*key)->attr);
+        else if (cstr_equal("MEMORY", p->value.str))
+            tok = parse_attribute_memory(p, type, &(*key)->attr);
         else
             return parser_error(
                 p,
@@ -1949,9 +2374,10 @@ static enum token parse_struct_unknown_data_type(
         }
         else if (tok == ';' || tok == ',')
         {
-            if (ignore_attr)
-                return tok;
-            break;
+            if (!ignore_attr)
+                break;
+            section->has_unknown_members = 1;
+            return tok;
         }
 
         tok = scan_next(p);
@@ -1993,13 +2419,38 @@ static enum token parse_struct(struct parser* p, struct section* section)
     }
 }
 
+static int parse_feature(struct parser* p)
+{
+    int i;
+    if (scan_next(p) != '(')
+        return parser_error(p, "Expected '(' after 'WITH'\n");
+    if (scan_next(p) != TOK_IDENTIFIER)
+        return parser_error(
+            p, "Expected the name of a feature. Example: WITH(columns)\n");
+    for (i = 0; i != (int)(sizeof(feature_names) / sizeof(*feature_names)); ++i)
+        if (cstr_equal(feature_names[i], p->value.str))
+            break;
+    if (i == (int)(sizeof(feature_names) / sizeof(*feature_names)))
+        return parser_error(
+            p,
+            "Unknown feature \"%.*s\". Expected columns, lazy, layers, watch, "
+            "handle or shm\n",
+            p->value.str.len,
+            p->value.str.source + p->value.str.off);
+    if (scan_next(p) != ')')
+        return parser_error(p, "Missing closing ')' for 'WITH()'\n");
+    return 1 << i;
+}
+
 static int
 parse(struct parser* p, struct root* root, int input_is_a_source_file)
 {
     enum token tok;
+    double     start = stats_start(p->stats);
     while (1)
     {
         tok = scan_until_section(p);
+        start = stats_lap(p->stats, PHASE_SCAN, start);
         switch (tok)
         {
             case TOK_ERROR: return -1;
@@ -2008,6 +2459,7 @@ parse(struct parser* p, struct root* root, int input_is_a_source_file)
             case TOK_IDENTIFIER: {
                 struct section* section;
                 struct strview  section_name, struct_name, struct_def;
+                int             features;
                 if (scan_next(p) != '(')
                     return parser_error(p, "Expected '(' after SECTION name\n");
                 if (scan_next(p) != TOK_STRING)
@@ -2018,7 +2470,18 @@ parse(struct parser* p, struct root* root, int input_is_a_source_file)
                 if (scan_next(p) != ')')
                     return parser_error(p, "Missing closing ')'\n");
 
-                if (scan_next(p) != TOK_IDENTIFIER ||
+                features = 0;
+                tok = scan_next(p);
+                while (tok == TOK_IDENTIFIER &&
+                       cstr_equal("WITH", p->value.str))
+                {
+                    int feature = parse_feature(p);
+                    if (feature < 0)
+                        return -1;
+                    features |= feature;
+                    tok = scan_next(p);
+                }
+                if (tok != TOK_IDENTIFIER ||
                     !cstr_equal("struct", p->value.str))
                     return parser_error(
                         p, "Expected 'struct' after SECTION name\n");
@@ -2030,6 +2493,7 @@ parse(struct parser* p, struct root* root, int input_is_a_source_file)
                 if (scan_next(p) != '{')
                     return parser_error(p, "Expected '{' after struct name\n");
                 section = section_create(root, section_name, struct_name);
+                section->features = features;
                 tok = parse_struct(p, section);
                 if (tok == TOK_ERROR)
                     return -1;
@@ -2042,6 +2506,7 @@ parse(struct parser* p, struct root* root, int input_is_a_source_file)
                     section->struct_def = struct_def;
                 }
 
+                start = stats_lap(p->stats, PHASE_PARSE, start);
                 break;
             }
 
@@ -2051,1094 +2516,6708 @@ parse(struct parser* p, struct root* root, int input_is_a_source_file)
 }
 
 /* ----------------------------------------------------------------------------
- * Generate header in-memory
+ * Parallel input scanning
  * ------------------------------------------------------------------------- */
 
-#if defined(_WIN32)
-#    define NL "\r\n"
+/*!
+ * Input files are independent of each other, so each one is mapped and parsed
+ * into its own root by whichever worker thread claims it next. Threads that
+ * finish early simply claim more files, which balances uneven file sizes.
+ * Afterwards the roots are concatenated in the order the files were given on
+ * the command line, so the output does not depend on the number of threads.
+ */
+struct parse_job
+{
+    const struct cfg* cfg;
+    struct root*      roots;
+    struct stats*     stats;
+    int               next_input;
+    int               failed;
+#if defined(WIN32)
+    CRITICAL_SECTION lock;
 #else
-#    define NL "\n"
+    pthread_mutex_t lock;
 #endif
+};
 
-static int gen_header(const char* filename, const struct root* root)
+static int cpu_count(void)
 {
-    const struct section* section;
-    struct mstream        ms = mstream_init_writeable();
+#if defined(WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int)info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+#endif
+}
 
-    mstream_cstr(&ms, "#pragma once\n\n");
+static int
+parse_input(const char* filename, struct root* root, struct stats* stats)
+{
+    struct mfile  mf;
+    struct parser parser;
+    int           result;
+    double        start = stats_start(stats);
 
-    mstream_cstr(&ms, "#include \"c-ini.h\"\n");
-    mstream_cstr(&ms, "#include <stdio.h>\n");
-    mstream_cstr(&ms, "#include <stdint.h>\n\n");
+    if (mfile_map_read(&mf, filename, 0) != 0)
+        return -1;
+    stats_lap(stats, PHASE_MAP, start);
 
-    mstream_cstr(&ms, "#if defined(__cplusplus)\n");
-    mstream_cstr(&ms, "extern \"C\" {\n");
-    mstream_cstr(&ms, "#endif\n\n");
+    parser_init(&parser, &mf, filename);
+    parser.stats = stats;
+    result = parse(&parser, root, file_is_source_file(filename));
 
-    mstream_cstr(&ms, "struct c_ini_parser;\n\n");
+    if (stats)
+    {
+        stats->input_bytes += mf.size;
+        stats->tokens += parser.tokens;
+    }
+    return result;
+}
 
-    for (section = root->sections; section; section = section->next)
+/*! Returns the index of the next input file to parse, or -1 if there is no
+ * work left. */
+static int parse_job_claim(struct parse_job* job, int prev_failed)
+{
+    int input;
+#if defined(WIN32)
+    EnterCriticalSection(&job->lock);
+#else
+    pthread_mutex_lock(&job->lock);
+#endif
+    if (prev_failed)
+        job->failed = 1;
+    input = -1;
+    if (!job->failed && job->next_input != job->cfg->input_count)
+        input = job->next_input++;
+#if defined(WIN32)
+    LeaveCriticalSection(&job->lock);
+#else
+    pthread_mutex_unlock(&job->lock);
+#endif
+    return input;
+}
+
+static void parse_job_run(struct parse_job* job)
+{
+    int input;
+    int failed = 0;
+    while ((input = parse_job_claim(job, failed)) >= 0)
+        failed = parse_input(
+            job->cfg->input_fnames[input],
+            &job->roots[input],
+            job->stats ? &job->stats[input] : NULL);
+}
+
+#if defined(WIN32)
+static DWORD WINAPI parse_worker(LPVOID job)
+{
+    parse_job_run(job);
+    return 0;
+}
+#else
+static void* parse_worker(void* job)
+{
+    parse_job_run(job);
+    return NULL;
+}
+#endif
+
+static int parse_inputs(const struct cfg* cfg, struct root* root)
+{
+    struct parse_job job;
+    int              i, thread_count, started;
+#if defined(WIN32)
+    HANDLE* threads = NULL;
+#else
+    pthread_t* threads = NULL;
+#endif
+
+    thread_count = cfg->jobs ? cfg->jobs : cpu_count();
+    if (thread_count > cfg->input_count)
+        thread_count = cfg->input_count;
+
+    job.cfg = cfg;
+    job.roots = calloc(cfg->input_count, sizeof(*job.roots));
+    job.stats = NULL;
+    if (global_stats)
+        job.stats = calloc(cfg->input_count, sizeof(*job.stats));
+    job.next_input = 0;
+    job.failed = 0;
+    if (thread_count > 1)
+        threads = malloc(sizeof(*threads) * thread_count);
+    if (job.roots == NULL || (global_stats && job.stats == NULL) ||
+        (thread_count > 1 && threads == NULL))
     {
-        mstream_fmt(&ms, "struct %S;\n", section->struct_name);
-        mstream_fmt(
-            &ms,
-            "int %S_init(struct %S* s);\n",
-            section->struct_name,
-            section->struct_name);
-        mstream_fmt(
-            &ms,
-            "void %S_deinit(struct %S* s);\n",
-            section->struct_name,
-            section->struct_name);
-        mstream_fmt(
-            &ms,
-            "int %S_parse(struct %S* s, const char* filename, const char* "
-            "data, "
-            "int len);\n",
-            section->struct_name,
-            section->struct_name);
-        mstream_fmt(
-            &ms,
-            "int %S_parse_all(const char* filename, const char* data, int len, "
-            "int (*on_section)(struct c_ini_parser* parser, void* user_ptr),"
-            "void* user_ptr);\n",
-            section->struct_name,
-            section->struct_name);
-        mstream_fmt(
-            &ms,
-            "int %S_parse_section(struct %S* s, struct c_ini_parser* p);\n",
-            section->struct_name,
-            section->struct_name);
-        mstream_fmt(
-            &ms,
-            "int %S_fwrite(const struct %S* s, FILE* f);\n",
-            section->struct_name,
-            section->struct_name);
-        mstream_fmt(
-            &ms,
-            "int %S_for_each_value(struct %S* s, int (*on_value)(void* value, "
-            "int type, void*), void* user_ptr);\n",
-            section->struct_name,
-            section->struct_name,
-            section->struct_name);
-        mstream_cstr(&ms, "\n");
+        free(threads);
+        free(job.roots);
+        free(job.stats);
+        return print_error("Out of memory\n");
     }
 
-    mstream_cstr(&ms, "#if defined(__cplusplus)\n");
-    mstream_cstr(&ms, "}\n");
-    mstream_cstr(&ms, "#endif\n\n");
+    /* The calling thread is one of the workers. If a thread can't be
+     * started, the ones that did (and this one) claim its share of files */
+#if defined(WIN32)
+    InitializeCriticalSection(&job.lock);
+    for (started = 1; started < thread_count; ++started)
+    {
+        threads[started] =
+            CreateThread(NULL, 0, parse_worker, &job, 0, NULL);
+        if (threads[started] == NULL)
+            break;
+    }
+    parse_job_run(&job);
+    for (i = 1; i < started; ++i)
+    {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+    DeleteCriticalSection(&job.lock);
+#else
+    pthread_mutex_init(&job.lock, NULL);
+    for (started = 1; started < thread_count; ++started)
+        if (pthread_create(&threads[started], NULL, parse_worker, &job) != 0)
+            break;
+    parse_job_run(&job);
+    for (i = 1; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&job.lock);
+#endif
 
-    if (filename)
-        return write_if_different(&ms, filename);
-    fwrite(ms.address, ms.write_ptr, 1, stdout);
-    return 0;
+    /* Merge sections in command line order */
+    for (i = 0; i != cfg->input_count; ++i)
+    {
+        if (job.stats)
+            stats_add(global_stats, &job.stats[i]);
+        if (job.roots[i].sections == NULL)
+            continue;
+        if (root->sections_tail == NULL)
+            root->sections_tail = &root->sections;
+        *root->sections_tail = job.roots[i].sections;
+        root->sections_tail = job.roots[i].sections_tail;
+    }
+
+    free(threads);
+    free(job.roots);
+    free(job.stats);
+    return job.failed ? -1 : 0;
 }
 
 /* ----------------------------------------------------------------------------
- * Generate source in-memory
+ * Generate header in-memory
  * ------------------------------------------------------------------------- */
 
-static void gen_source_includes(struct mstream* ms, const struct cfg* cfg)
-{
-    int i;
-
-    for (i = 0; i != cfg->c_includes_count; ++i)
-        mstream_fmt(ms, "#include \"%s\"\n", cfg->c_includes[i]);
-
-    mstream_cstr(ms, "#include <stdlib.h>\n");
-    mstream_cstr(ms, "#include <ctype.h>\n");
-    mstream_cstr(ms, "#include <string.h>\n");
-    mstream_cstr(ms, "#include <stdarg.h>\n");
-    mstream_cstr(ms, "#include <stdio.h>\n\n");
-    mstream_cstr(ms, "#include <stdbool.h>\n\n");
-}
+#if defined(_WIN32)
+#    define NL "\r\n"
+#else
+#    define NL "\n"
+#endif
 
-static void gen_source_ini_parser(struct mstream* ms)
+/*!
+ * \brief Defines the slab pool types of a struct. The slabs are part of the
+ * API so that the records can be iterated over as plain arrays. The generated
+ * source doesn't include the generated header, so both contain these, with a
+ * guard in case a user include pulls in the header anyway.
+ */
+static void gen_pool_types(struct mstream* ms, const struct section* section)
 {
-    mstream_cstr(
+    mstream_fmt(
         ms,
-        "struct c_ini_strspan\n"
-        "{\n"
-        "    int off, len;\n"
-        "};\n\n");
-    mstream_cstr(
+        "#if !defined(C_INI_%S_POOL)\n"
+        "#define C_INI_%S_POOL\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
         ms,
-        "static struct c_ini_strspan c_ini_strspan(int off, int len)\n"
+        "struct %S_pool_slab\n"
         "{\n"
-        "    struct c_ini_strspan sv;\n"
-        "    sv.off = off;\n"
-        "    sv.len = len;\n"
-        "    return sv;\n"
-        "}\n\n");
-    mstream_cstr(
+        "    struct %S_pool_slab* next;\n"
+        "    struct %S*           records; /* Cache line aligned */\n"
+        "    int                  count;\n"
+        "    int                  capacity;\n"
+        "};\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
         ms,
-        "static int cstr_equal(const char* s1, struct c_ini_strspan s2, const "
-        "char* "
-        "data)\n"
+        "struct %S_pool\n"
         "{\n"
-        "    if ((int)strlen(s1) != s2.len)\n"
-        "        return 0;\n"
-        "    return memcmp(s1, data + s2.off, s2.len) == 0;\n"
-        "}\n\n");
-    mstream_cstr(ms, "static int disable_colors = 0;\n\n");
-    mstream_cstr(
+        "    struct %S_pool_slab*          first;\n"
+        "    struct %S_pool_slab*          last;\n"
+        "    int                           count;\n"
+        "    const struct c_ini_allocator* allocator;\n"
+        "};\n"
+        "#endif\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+}
+
+static void gen_header_pool(struct mstream* ms, const struct section* section)
+{
+    gen_pool_types(ms, section);
+    mstream_fmt(
         ms,
-        "static const char* emph_style(void)\n"
-        "{\n"
-        "    return disable_colors ? \"\" : \"\\033[1;37m\";\n"
-        "}\n"
-        "static const char* error_style(void)\n"
-        "{\n"
-        "    return disable_colors ? \"\" : \"\\033[1;31m\";\n"
-        "}\n"
-        "static const char* underline_style(void)\n"
-        "{\n"
-        "    return disable_colors ? \"\" : \"\\033[1;31m\";\n"
-        "}\n"
-        "static const char* reset_style(void)\n"
-        "{\n"
-        "    return disable_colors ? \"\" : \"\\033[0m\";\n"
-        "}\n\n");
-    mstream_cstr(
+        "void %S_pool_init(struct %S_pool* pool, "
+        "const struct c_ini_allocator* allocator);\n"
+        "void %S_pool_deinit(struct %S_pool* pool);\n"
+        "struct %S* %S_pool_add(struct %S_pool* pool);\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
         ms,
-        "static void print_vflc(\n"
-        "    const char*          filename,\n"
-        "    const char*          source,\n"
-        "    struct c_ini_strspan loc,\n"
-        "    const char*          fmt,\n"
-        "    va_list              ap)\n"
-        "{\n"
-        "    int i;\n"
-        "    int l1, c1;\n"
-        "\n"
-        "    l1 = 1, c1 = 1;\n"
-        "    for (i = 0; i != loc.off; i++)\n"
-        "    {\n"
-        "        c1++;\n"
-        "        if (source[i] == '\\n')\n"
-        "            l1++, c1 = 1;\n"
-        "    }\n\n");
-    mstream_cstr(
+        "int %S_pool_for_each(struct %S_pool* pool, "
+        "int (*on_record)(struct %S* s, void* user_ptr), void* user_ptr);\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
         ms,
-        "    fprintf(\n"
-        "        stderr,\n"
-        "        \"%s%s:%d:%d:%s \",\n"
-        "        emph_style(),\n"
-        "        filename,\n"
-        "        l1,\n"
-        "        c1,\n"
-        "        reset_style());\n"
-        "    fprintf(stderr, \"%serror:%s \", error_style(), "
-        "reset_style());\n"
-        "    vfprintf(stderr, fmt, ap);\n"
-        "}\n\n");
-    mstream_cstr(
+        "int %S_parse_all_into_pool(struct %S_pool* pool, const char* filename, "
+        "const char* data, int len, const struct c_ini_options* opts);\n",
+        section->struct_name,
+        section->struct_name);
+}
+
+/*! Keys that hold a single number or boolean, so they fit into a column */
+static int key_is_scalar(const struct key* key)
+{
+    cdt_switch(key->type)
+    {
+        case CDT_UNKNOWN:
+        case CDT_STR_FIXED:
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+        case CDT_STRLIST_FIXED:
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM: return 0;
+        case CDT_BOOL:
+        case CDT_I8:
+        case CDT_U8:
+        case CDT_I16:
+        case CDT_U16:
+        case CDT_I32:
+        case CDT_U32:
+        case CDT_FLOAT: return 1;
+        case CDT_BITFIELD: break;
+    }
+    return 0;
+}
+
+static int key_is_list(const struct key* key)
+{
+    cdt_switch(key->type)
+    {
+        case CDT_STRLIST_FIXED:
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM: return 1;
+        default: return 0;
+    }
+}
+
+static const char* column_type(const struct key* key)
+{
+    cdt_switch(key->type)
+    {
+        case CDT_UNKNOWN:
+        case CDT_STR_FIXED:
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+        case CDT_STRLIST_FIXED:
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM: break;
+        case CDT_BOOL: return "uint8_t";
+        case CDT_I8: return "int8_t";
+        case CDT_U8: return "uint8_t";
+        case CDT_I16: return "int16_t";
+        case CDT_U16: return "uint16_t";
+        case CDT_I32: return "int32_t";
+        case CDT_U32: return "uint32_t";
+        /* float and double both map to CDT_FLOAT */
+        case CDT_FLOAT: return "double";
+        case CDT_BITFIELD: break;
+    }
+    return NULL;
+}
+
+static int section_has_columns(const struct section* section)
+{
+    const struct key* key;
+    if (!(section->features & FEATURE_COLUMNS))
+        return 0;
+    for (key = section->keys; key; key = key->next)
+        if (key_is_scalar(key))
+            return 1;
+    return 0;
+}
+
+static void gen_field_types(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    mstream_fmt(
         ms,
-        "static int num_digits(int value)\n{\n"
-        "    int digits = 0;\n"
-        "    while (value)\n"
-        "        digits++, value /= 10;\n"
-        "    return digits ? digits : 1;\n"
-        "}\n\n");
-    mstream_cstr(
+        "#if !defined(C_INI_%S_FIELDS)\n"
+        "#define C_INI_%S_FIELDS\n"
+        "enum %S_field\n"
+        "{\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    for (key = section->keys; key; key = key->next)
+        mstream_fmt(
+            ms, "    %U_FIELD_%U,\n", section->struct_name, key->name);
+    mstream_fmt(
+        ms, "    %U_FIELDS_COUNT\n};\n#endif\n", section->struct_name);
+}
+
+static void
+gen_columns_types(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    mstream_fmt(
         ms,
-        "static void print_excerpt(const char* source, struct c_ini_strspan "
-        "loc)\n"
+        "#if !defined(C_INI_%S_COLUMNS)\n"
+        "#define C_INI_%S_COLUMNS\n"
+        "struct %S_columns\n"
         "{\n"
-        "    int                  i;\n"
-        "    int                  l1, c1, l2, c2;\n"
-        "    int                  indent, max_indent;\n"
-        "    int                  gutter_indent;\n"
-        "    int                  line;\n"
-        "    struct c_ini_strspan block;\n\n");
-    mstream_cstr(
-        ms,
-        "    /* Calculate line column as well as beginning of block. The goal "
-        "is to make\n"
-        "     * \"block\" point to the first character in the line that "
-        "contains the\n"
-        "     * location. */\n"
-        "    l1 = 1, c1 = 1, block.off = 0;\n"
-        "    for (i = 0; i != loc.off; i++)\n"
-        "    {\n"
-        "        c1++;\n"
-        "        if (source[i] == '\\n')\n"
-        "            l1++, c1 = 1, block.off = i + 1;\n"
-        "    }\n\n");
-    mstream_cstr(
+        "    struct\n"
+        "    {\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    for (key = section->keys; key; key = key->next)
+        if (key_is_scalar(key))
+            mstream_fmt(ms, "        %s* %S;\n", column_type(key), key->name);
+    mstream_fmt(
         ms,
-        "    /* Calculate line/column of where the location ends */\n"
-        "    l2 = l1, c2 = c1;\n"
-        "    for (i = 0; i != loc.len; i++)\n"
-        "    {\n"
-        "        c2++;\n"
-        "        if (source[loc.off + i] == '\\n')\n"
-        "            l2++, c2 = 1;\n"
-        "    }\n"
-        "\n"
-        "    /* Find the end of the line for block */\n"
-        "    block.len = loc.off - block.off + loc.len;\n"
-        "    for (; source[loc.off + i]; block.len++, i++)\n"
-        "        if (source[loc.off + i] == '\\n')\n"
-        "            break;\n\n");
-    mstream_cstr(
-        ms,
-        "    /* We also keep track of the minimum indentation. This is used to "
-        "unindent\n"
-        "     * the block of code as much as possible when printing out the "
-        "excerpt. */\n"
-        "    max_indent = 10000;\n"
-        "    for (i = 0; i != block.len;)\n"
-        "    {\n"
-        "        indent = 0;\n"
-        "        for (; i != block.len; ++i, ++indent)\n"
-        "        {\n"
-        "            if (source[block.off + i] != ' ' && source[block.off + i] "
-        "!= '\\t')\n"
-        "                break;\n"
-        "        }\n");
-    mstream_cstr(
-        ms,
-        "        if (max_indent > indent)\n"
-        "            max_indent = indent;\n"
-        "\n"
-        "        while (i != block.len)\n"
-        "            if (source[block.off + i++] == '\\n')\n"
-        "                break;\n"
-        "    }\n\n");
-    mstream_cstr(
+        "    } column; /* NULL unless the field was requested */\n"
+        "    int                           count;\n"
+        "    int                           capacity;\n"
+        "    uint32_t fields[C_INI_FIELD_WORDS(%U_FIELDS_COUNT)];\n"
+        "    const struct c_ini_allocator* allocator;\n"
+        "};\n"
+        "#endif\n",
+        section->struct_name);
+}
+
+static void
+gen_header_columns(struct mstream* ms, const struct section* section)
+{
+    if (!section_has_columns(section))
+        return;
+    gen_columns_types(ms, section);
+    mstream_fmt(
         ms,
-        "    /* Unindent columns */\n"
-        "    c1 -= max_indent;\n"
-        "    c2 -= max_indent;\n"
-        "\n"
-        "    gutter_indent = num_digits(l2);\n"
-        "    gutter_indent += 2; /* Padding on either side of the line number "
-        "*/\n\n");
-    mstream_cstr(
+        "void %S_columns_init(struct %S_columns* c, const uint32_t* fields, "
+        "const struct c_ini_allocator* allocator);\n"
+        "void %S_columns_deinit(struct %S_columns* c);\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
         ms,
-        "    /* Print line number, gutter, and block of code */\n"
-        "    line = l1;\n"
-        "    for (i = 0; i != block.len;)\n"
-        "    {\n"
-        "        fprintf(stderr, \"%*d | \", gutter_indent - 1, line);\n"
-        "\n"
-        "        if (i >= loc.off - block.off && i <= loc.off - block.off + "
-        "loc.len)\n"
-        "            fprintf(stderr, \"%s\", underline_style());\n\n");
-    mstream_cstr(
+        "int %S_parse_all_into_columns(struct %S_columns* c, "
+        "const char* filename, const char* data, int len, "
+        "const struct c_ini_options* opts);\n",
+        section->struct_name,
+        section->struct_name);
+}
+
+static void gen_lazy_types(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
         ms,
-        "        indent = 0;\n"
-        "        while (i != block.len)\n"
-        "        {\n"
-        "            if (i == loc.off - block.off)\n"
-        "                fprintf(stderr, \"%s\", underline_style());\n"
-        "            if (i == loc.off - block.off + loc.len)\n"
-        "                fprintf(stderr, \"%s\", reset_style());\n"
-        "\n"
-        "            if (indent++ >= max_indent)\n"
-        "                putc(source[block.off + i], stderr);\n\n");
-    mstream_cstr(
+        "#if !defined(C_INI_%S_LAZY)\n"
+        "#define C_INI_%S_LAZY\n"
+        "struct %S_lazy\n"
+        "{\n"
+        "    struct %S*  s;\n"
+        "    const char* filename;\n"
+        "    const char* data;\n"
+        "    int         len;\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
         ms,
-        "            if (source[block.off + i++] == '\\n')\n"
-        "            {\n"
-        "                if (i >= loc.off - block.off &&\n"
-        "                    i <= loc.off - block.off + loc.len)\n"
-        "                    fprintf(stderr, \"%s\", reset_style());\n"
-        "                break;\n"
-        "            }\n"
-        "        }\n"
-        "        line++;\n"
-        "    }\n"
-        "    fprintf(stderr, \"%s\\n\", reset_style());\n");
-    mstream_cstr(
+        "    /* Where the value of each field starts, or -1 */\n"
+        "    int      offsets[%U_FIELDS_COUNT];\n"
+        "    uint32_t decoded[C_INI_FIELD_WORDS(%U_FIELDS_COUNT)];\n"
+        "};\n"
+        "#endif\n",
+        section->struct_name,
+        section->struct_name);
+}
+
+static void gen_header_lazy(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    if (section->keys == NULL || !(section->features & FEATURE_LAZY))
+        return;
+    gen_lazy_types(ms, section);
+    mstream_fmt(
         ms,
-        "    /* print underline */\n"
-        "    if (c2 > c1)\n"
-        "    {\n"
-        "        fprintf(stderr, \"%*s|%*s\", gutter_indent, \"\", c1, \"\");\n"
-        "        fprintf(stderr, \"%s\", underline_style());\n"
-        "        putc('^', stderr);\n"
-        "        for (i = c1 + 1; i < c2; ++i)\n"
-        "            putc('~', stderr);\n"
-        "        fprintf(stderr, \"%s\", reset_style());\n"
-        "    }\n"
-        "    else\n\n");
-    mstream_cstr(
+        "int %S_parse_lazy(struct %S_lazy* lazy, struct %S* s, "
+        "const char* filename, const char* data, int len);\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    for (key = section->keys; key; key = key->next)
+        mstream_fmt(
+            ms,
+            "int %S_get_%S(struct %S_lazy* lazy);\n",
+            section->struct_name,
+            key->name,
+            section->struct_name);
+}
+
+static void gen_header_layers(struct mstream* ms, const struct section* section)
+{
+    if (section->keys == NULL || !(section->features & FEATURE_LAYERS))
+        return;
+    mstream_fmt(
         ms,
-        "    {\n"
-        "        int col, max_col;\n"
-        "\n"
-        "        fprintf(stderr, \"%*s| \", gutter_indent, \"\");\n"
-        "        fprintf(stderr, \"%s\", underline_style());\n"
-        "        for (i = 1; i < c2; ++i)\n"
-        "            putc('~', stderr);\n"
-        "        for (; i < c1; ++i)\n"
-        "            putc(' ', stderr);\n"
-        "        putc('^', stderr);\n\n");
-    mstream_cstr(
+        "int %S_parse_layers(\n"
+        "    struct %S* s,\n"
+        "    const char** filenames,\n"
+        "    const char** data,\n"
+        "    const int* lens,\n"
+        "    int n);\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
         ms,
-        "        /* Have to find length of the longest line */\n"
-        "        col = 1, max_col = 1;\n"
-        "        for (i = 0; i != block.len; ++i)\n"
-        "        {\n"
-        "            if (max_col < col)\n"
-        "                max_col = col;\n"
-        "            col++;\n"
-        "            if (source[block.off + i] == '\\n')\n"
-        "                col = 1;\n"
-        "        }\n"
-        "        max_col -= max_indent;\n"
-        "\n"
-        "        for (i = c1 + 1; i < max_col; ++i)\n"
-        "            putc('~', stderr);\n"
-        "        fprintf(stderr, \"%s\", reset_style());\n"
-        "    }\n"
-        "\n"
-        "    putc('\\n', stderr);\n"
-        "}\n\n");
-    mstream_cstr(
+        "int %S_parse_layers_opts(\n"
+        "    struct %S* s,\n"
+        "    const char** filenames,\n"
+        "    const char** data,\n"
+        "    const int* lens,\n"
+        "    int n,\n"
+        "    const struct c_ini_options* opts);\n",
+        section->struct_name,
+        section->struct_name);
+}
+
+static void gen_watch_types(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
         ms,
-        "enum token\n"
-        "{\n"
-        "    TOK_ERROR = -1,\n"
-        "    TOK_END = 0,\n"
-        "    TOK_LBRACKET = '[',\n"
-        "    TOK_RBRACKET = ']',\n"
-        "    TOK_EQUALS = '=',\n"
-        "    TOK_COMMA = ',',\n"
-        "    TOK_INTEGER = 256,\n"
-        "    TOK_FLOAT,\n"
-        "    TOK_STRING,\n"
-        "    TOK_KEY\n"
-        "};\n\n"
-        "struct c_ini_parser\n"
+        "#if !defined(C_INI_%S_WATCH)\n"
+        "#define C_INI_%S_WATCH\n"
+        "struct %S_subscription\n"
         "{\n"
-        "    const char* filename;\n"
-        "    const char* source;\n"
-        "    int         head, tail, end;\n"
-        "    union\n"
-        "    {\n"
-        "        struct c_ini_strspan string;\n"
-        "        double               float_literal;\n"
-        "        int64_t              integer_literal;\n"
-        "    } value;\n"
-        "};\n\n");
-    mstream_cstr(
+        "    uint32_t fields[C_INI_FIELD_WORDS(%U_FIELDS_COUNT)];\n"
+        "    void (*on_change)(struct %S* s, const uint32_t* dirty, "
+        "void* user_ptr);\n"
+        "    void* user_ptr;\n"
+        "    struct %S_subscription* next;\n"
+        "};\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
         ms,
-        "static void\n"
-        "parser_init(struct c_ini_parser* p, const char* filename, const char* "
-        "data, int len)\n"
+        "struct %S_watch\n"
         "{\n"
-        "    p->filename = filename;\n"
-        "    p->source = data;\n"
-        "    p->end = len;\n"
-        "    p->head = 0;\n"
-        "    p->tail = 0;\n"
-        "}\n\n");
-    mstream_cstr(
+        "    struct %S* s;\n"
+        "    /* Fields assigned since the last _watch_notify() */\n"
+        "    uint32_t dirty[C_INI_FIELD_WORDS(%U_FIELDS_COUNT)];\n"
+        "    struct %S_subscription* subscriptions;\n"
+        "};\n"
+        "#endif\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+}
+
+static void gen_header_watch(struct mstream* ms, const struct section* section)
+{
+    struct strview name = section->struct_name;
+    if (section->keys == NULL || !(section->features & FEATURE_WATCH))
+        return;
+    gen_watch_types(ms, section);
+    mstream_fmt(
         ms,
-        "static int parser_error(struct c_ini_parser* p, const char* fmt, "
-        "...)\n"
-        "{\n"
-        "    va_list              ap;\n"
-        "    struct c_ini_strspan loc;\n"
-        "    loc.off = p->tail;\n"
-        "    loc.len = p->head - p->tail;\n"
-        "    va_start(ap, fmt);\n"
-        "    print_vflc(p->filename, p->source, loc, fmt, ap);\n"
-        "    va_end(ap);\n"
-        "    print_excerpt(p->source, loc);\n"
-        "    return -1;\n"
-        "}\n\n");
-    mstream_cstr(
+        "void %S_watch_init(struct %S_watch* w, struct %S* s);\n"
+        "void %S_subscribe(struct %S_watch* w, struct %S_subscription* sub, "
+        "const uint32_t* fields, void (*on_change)(struct %S* s, "
+        "const uint32_t* dirty, void* user_ptr), void* user_ptr);\n"
+        "void %S_unsubscribe(struct %S_watch* w, "
+        "struct %S_subscription* sub);\n",
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "void %S_watch_notify(struct %S_watch* w);\n"
+        "int %S_watch_parse(struct %S_watch* w, const char* filename, "
+        "const char* data, int len);\n"
+        "int %S_watch_parse_opts(struct %S_watch* w, const char* filename, "
+        "const char* data, int len, const struct c_ini_options* opts);\n",
+        name,
+        name,
+        name,
+        name,
+        name,
+        name);
+}
+
+static void gen_handle_types(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
         ms,
-        "static enum token scan_next(struct c_ini_parser* p)\n"
+        "#if !defined(C_INI_%S_HANDLE)\n"
+        "#define C_INI_%S_HANDLE\n"
+        "struct %S_snapshot;\n"
+        "struct %S_handle\n"
         "{\n"
-        "    p->tail = p->head;\n"
-        "    while (p->head != p->end)\n"
-        "    {\n"
-        "        /* Skip comments */\n"
-        "        if (p->source[p->head] == '#' || p->source[p->head] == ';')\n"
-        "        {\n"
-        "            for (p->head++; p->head != p->end; p->head++)\n"
-        "                if (p->source[p->head] == '\\n')\n"
-        "                {\n"
-        "                    p->head++;\n"
-        "                    break;\n"
-        "                }\n"
-        "            p->tail = p->head;\n"
-        "            continue;\n"
-        "        }\n\n");
-    mstream_cstr(
+        "    struct %S_snapshot* current;\n"
+        "    /* Replaced snapshots that readers may still hold */\n"
+        "    struct %S_snapshot* retired;\n"
+        "    uint32_t            epoch;\n"
+        "    struct c_ini_reader readers[C_INI_MAX_READERS];\n"
+        "};\n"
+        "#endif\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+}
+
+static void gen_header_handle(struct mstream* ms, const struct section* section)
+{
+    struct strview name = section->struct_name;
+    if (section->keys == NULL || !(section->features & FEATURE_HANDLE))
+        return;
+    gen_handle_types(ms, section);
+    mstream_fmt(
         ms,
-        "        /* Special characters */\n"
-        "        if (p->source[p->head] == '[')\n"
-        "            return p->source[p->head++];\n"
-        "        if (p->source[p->head] == ']')\n"
-        "            return p->source[p->head++];\n"
-        "        if (p->source[p->head] == '=')\n"
-        "            return p->source[p->head++];\n"
-        "        if (p->source[p->head] == ',')\n"
-        "            return p->source[p->head++];\n\n");
-    mstream_cstr(
+        "int %S_handle_init(struct %S_handle* h);\n"
+        "void %S_handle_deinit(struct %S_handle* h);\n"
+        "int %S_handle_publish(struct %S_handle* h, struct %S* s);\n"
+        "int %S_handle_parse(struct %S_handle* h, const char* filename, "
+        "const char* data, int len);\n",
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
         ms,
-        "        /* Boolean */\n"
-        "        if (p->end - p->head >= (int)sizeof(\"true\") - 1 &&\n"
-        "            memcmp(p->source + p->head, \"true\", sizeof(\"true\") - "
-        "1) == 0)\n"
-        "        {\n"
-        "            p->head += sizeof(\"true\") - 1;\n"
-        "            p->value.integer_literal = 1;\n"
-        "            return TOK_INTEGER;\n"
-        "        }\n");
-    mstream_cstr(
-        ms,
-        "        if (p->end - p->head >= (int)sizeof(\"false\") - 1 &&\n"
-        "            memcmp(p->source + p->head, \"false\", sizeof(\"false\") "
-        "- "
-        "1) == 0)\n"
-        "        {\n"
-        "            p->head += sizeof(\"false\") - 1;\n"
-        "            p->value.integer_literal = 0;\n"
-        "            return TOK_INTEGER;\n"
-        "        }\n\n");
-    mstream_cstr(
-        ms,
-        "        /* Number */\n"
-        "        if (isdigit(p->source[p->head]) || p->source[p->head] == "
-        "'-')\n"
-        "        {\n"
-        "            char is_neg = p->source[p->head] == '-';\n"
-        "            if (p->source[p->head] == '-')\n"
-        "                p->head++;\n\n");
-    mstream_cstr(
-        ms,
-        "            p->value.integer_literal = 0;\n"
-        "            for (; p->head != p->end && isdigit(p->source[p->head]); "
-        "++p->head)\n"
-        "            {\n"
-        "                p->value.integer_literal *= 10;\n"
-        "                p->value.integer_literal += p->source[p->head] - "
-        "'0';\n"
-        "            }\n");
-    mstream_cstr(
-        ms,
-        "            /* It is actually a float */\n"
-        "            if (p->head != p->end && p->source[p->head] == '.')\n"
-        "            {\n"
-        "                double fraction = 1.0;\n"
-        "                p->value.float_literal = "
-        "(double)p->value.integer_literal;\n"
-        "                for (p->head++; p->head != p->end && "
-        "isdigit(p->source[p->head]);\n"
-        "                     ++p->head)\n");
-    mstream_cstr(
-        ms,
-        "                {\n"
-        "                    fraction *= 0.1;\n"
-        "                    p->value.float_literal +=\n"
-        "                        fraction * (double)(p->source[p->head] - "
-        "'0');\n"
-        "                }\n"
-        "                if (p->head != p->end && p->source[p->head] == 'f')\n"
-        "                    ++p->head;\n\n");
-    mstream_cstr(
-        ms,
-        "                if (is_neg)\n"
-        "                    p->value.float_literal = "
-        "-p->value.float_literal;\n"
-        "                return TOK_FLOAT;\n"
-        "            }\n"
-        "\n"
-        "            if (is_neg)\n"
-        "                p->value.integer_literal = "
-        "-p->value.integer_literal;\n"
-        "            return TOK_INTEGER;\n"
-        "        }\n");
-    mstream_cstr(
-        ms,
-        "        /* String literal \".*?\" (spans over newlines)*/\n"
-        "        if (p->source[p->head] == '\"')\n"
-        "        {\n"
-        "            int tail = ++p->head;\n"
-        "            for (; p->head != p->end; ++p->head)\n"
-        "                if (p->source[p->head] == '\"' && p->source[p->head - "
-        "1] != '\\\\')\n");
-    mstream_cstr(
-        ms,
-        "                    break;\n"
-        "            if (p->head == p->end)\n"
-        "                return parser_error(p, \"Missing closing quote on "
-        "string\\n\");\n"
-        "            p->value.string = c_ini_strspan(tail, p->head++ - tail);\n"
-        "            return TOK_STRING;\n"
-        "        }\n\n");
-    mstream_cstr(
-        ms,
-        "        /* Key */\n"
-        "        if (isalpha(p->source[p->head]))\n"
-        "        {\n"
-        "            while (p->head != p->end &&\n"
-        "                   (isalnum(p->source[p->head]) || p->source[p->head] "
-        "== '_'))\n"
-        "            {\n"
-        "                p->head++;\n"
-        "            }\n"
-        "            p->value.string = c_ini_strspan(p->tail, p->head - "
-        "p->tail);\n"
-        "            return TOK_KEY;\n"
-        "        }\n\n");
-    mstream_cstr(
+        "int %S_handle_parse_opts(struct %S_handle* h, const char* filename, "
+        "const char* data, int len, const struct c_ini_options* opts);\n"
+        "int %S_handle_reclaim(struct %S_handle* h);\n"
+        "int %S_handle_register(struct %S_handle* h);\n"
+        "void %S_handle_unregister(struct %S_handle* h, int reader);\n",
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
         ms,
-        "        /* Ignore everything else */\n"
-        "        p->tail = ++p->head;\n"
-        "    }\n"
-        "\n"
-        "    return TOK_END;\n"
-        "}\n\n");
+        "const struct %S* %S_handle_read_lock(struct %S_handle* h, "
+        "int reader);\n"
+        "void %S_handle_read_unlock(struct %S_handle* h, int reader);\n",
+        name,
+        name,
+        name,
+        name,
+        name);
 }
 
-static void gen_source_c_str_dyn(struct mstream* ms)
+/*!
+ * \brief Writes the accessors that read a field straight out of a shared
+ * memory image. Lists get one to count their strings and one to get them.
+ */
+static void gen_shm_accessor(
+    struct mstream* ms, const struct section* section, const struct key* key)
 {
-    /* Built-in "custom string" functions for C-strings */
-    mstream_cstr(
-        ms,
-        "static int c_str_dyn_init(char** s)\n{    \n"
-        "    *s = malloc(1);\n"
-        "    if (*s == NULL)\n"
-        "        return -1;\n"
-        "    (*s)[0] = '\\0';\n"
-        "    return 0;\n"
-        "}\n\n");
-    mstream_cstr(
-        ms,
-        "static void c_str_dyn_deinit(char* s)\n{    \n"
-        "    free(s);\n"
-        "}\n\n");
-    mstream_cstr(
-        ms,
-        "static int c_str_dyn_set(char** s, const char* data, int len)\n{    \n"
-        "    char* ns = realloc(*s, len + 1);\n"
-        "    if (ns == NULL)\n"
-        "        return -1;\n"
-        "    memcpy(ns, data, len);\n"
-        "    ns[len] = '\\0';\n"
-        "    *s = ns;\n"
-        "    return 0;\n"
-        "}\n\n");
-    mstream_cstr(
-        ms,
-        "static const char* c_str_dyn_data(const char* s)\n{\n"
-        "    return s;\n"
-        "}\n\n");
-    mstream_cstr(
-        ms,
-        "static int c_str_dyn_len(const char* s)\n{\n"
-        "    return (int)strlen(s);\n"
-        "}\n\n");
+    struct strview name = section->struct_name;
+
+    if (key_is_scalar(key))
+        mstream_fmt(
+            ms,
+            "%s %S_shm_get_%S(const struct c_ini_shm* shm)",
+            column_type(key),
+            name,
+            key->name);
+    cdt_switch(key->type)
+    {
+        case CDT_STR_FIXED:
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            mstream_fmt(
+                ms,
+                "const char* %S_shm_get_%S(const struct c_ini_shm* shm)",
+                name,
+                key->name);
+            break;
+        case CDT_STRLIST_FIXED:
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            mstream_fmt(
+                ms,
+                "int %S_shm_count_%S(const struct c_ini_shm* shm)",
+                name,
+                key->name);
+            break;
+        default: break;
+    }
 }
 
-static void gen_source_c_strlist_dyn(struct mstream* ms)
+static void gen_shm_list_accessor(
+    struct mstream* ms, struct strview name, const struct key* key)
 {
-    /* Built-in "custom stringlist" functions for C-strings */
-    mstream_cstr(
-        ms,
-        "static int c_strlist_dyn_init(char*** l)\n{    \n"
-        "    *l = malloc(sizeof(char**));\n"
-        "    if (*l == NULL)\n"
-        "        return -1;\n"
-        "    (*l)[0] = NULL;\n"
-        "    return 0;\n"
-        "}\n\n");
-    mstream_cstr(
+    mstream_fmt(
         ms,
-        "static void c_strlist_dyn_deinit(char** l)\n{    \n"
-        "    char** p;\n"
-        "    for (p = l; *p; ++p)\n"
-        "        free(*p);\n"
-        "    free(l);\n"
-        "}\n\n");
-    mstream_cstr(
+        "const char* %S_shm_get_%S(const struct c_ini_shm* shm, int index)",
+        name,
+        key->name);
+}
+
+static void gen_header_shm(struct mstream* ms, const struct section* section)
+{
+    struct strview    name = section->struct_name;
+    const struct key* key;
+
+    if (section->keys == NULL || !(section->features & FEATURE_SHM))
+        return;
+    mstream_fmt(
         ms,
-        "static int c_strlist_dyn_add(char*** l, const char* data, int "
-        "len)\n{\n"
-        "    char** p;\n"
-        "    int list_len = 0;\n"
-        "    for (p = *l; *p; ++p)\n"
-        "        list_len++;\n"
-        "    p = realloc(*l, sizeof(char**) * (list_len + 2));\n"
-        "    if (p == NULL)\n"
-        "        return -1;\n"
-        "    *l = p;\n"
-        "    p[list_len + 1] = NULL;\n"
-        "    p[list_len] = malloc(len + 1);\n"
-        "    if (p[list_len] == NULL)\n"
-        "        return -1;\n"
-        "    memcpy(p[list_len], data, len);\n"
-        "    p[list_len][len] = '\\0';\n"
-        "    return 0;\n"
-        "}\n\n");
-    mstream_cstr(
+        "struct c_ini_shm* %S_shm_init(void* mem, size_t capacity);\n"
+        "size_t %S_shm_size(const struct %S* s);\n"
+        "int %S_shm_publish(struct c_ini_shm* shm, const struct %S* s);\n"
+        "int %S_shm_parse(struct c_ini_shm* shm, const char* filename, "
+        "const char* data, int len);\n",
+        name,
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
         ms,
-        "static void c_strlist_dyn_clear(char** l)\n{\n"
-        "    char** p;\n"
-        "    for (p = l; *p; ++p)\n"
-        "        free(*p);\n"
-        "    l[0] = NULL;\n"
-        "}\n\n");
+        "uint32_t %S_shm_read_begin(const struct c_ini_shm* shm);\n"
+        "int %S_shm_read_retry(const struct c_ini_shm* shm, "
+        "uint32_t sequence);\n"
+        "#if defined(C_INI_SHM)\n"
+        "struct c_ini_shm* %S_shm_create(const char* name, "
+        "size_t capacity);\n"
+        "const struct c_ini_shm* %S_shm_open(const char* name);\n"
+        "void %S_shm_close(const struct c_ini_shm* shm);\n"
+        "#endif\n",
+        name,
+        name,
+        name,
+        name,
+        name);
+    for (key = section->keys; key; key = key->next)
+    {
+        gen_shm_accessor(ms, section, key);
+        mstream_cstr(ms, ";\n");
+        if (key_is_list(key))
+        {
+            gen_shm_list_accessor(ms, name, key);
+            mstream_cstr(ms, ";\n");
+        }
+    }
 }
 
-static void gen_source_helpers(struct mstream* ms, const struct root* root)
+static int gen_header(const char* filename, const struct root* root)
 {
     const struct section* section;
-    const struct key*     key;
+    struct mstream        ms = mstream_init_writeable();
 
-    /* May need to copy the entire struct definition into the source file, if
-     * the struct was originally defined in a source file */
-    for (section = root->sections; section; section = section->next)
-    {
-        if (section->struct_def.len == 0)
-            continue;
-        mstream_fmt(ms, "%S;\n\n", section->struct_def);
-    }
+    mstream_cstr(&ms, "#pragma once\n\n");
 
-    for (section = root->sections; section; section = section->next)
-        for (key = section->keys; key; key = key->next)
-            if (key->type == CDT_STR_DYNAMIC || key->type == CDT_STR_CUSTOM)
-            {
-                gen_source_c_str_dyn(ms);
-                goto found_str_dynamic;
-            }
-found_str_dynamic:;
+    mstream_cstr(&ms, "#include \"c-ini.h\"\n");
+    mstream_cstr(&ms, "#include <stdio.h>\n");
+    mstream_cstr(&ms, "#include <stdint.h>\n\n");
 
-    for (section = root->sections; section; section = section->next)
-        for (key = section->keys; key; key = key->next)
-            if (key->type == CDT_STRLIST_DYNAMIC ||
-                key->type == CDT_STRLIST_CUSTOM)
-            {
-                gen_source_c_strlist_dyn(ms);
-                goto found_strlist_dynamic;
-            }
-found_strlist_dynamic:;
-}
+    mstream_cstr(&ms, "#if defined(__cplusplus)\n");
+    mstream_cstr(&ms, "extern \"C\" {\n");
+    mstream_cstr(&ms, "#endif\n\n");
 
-static void gen_source_init(struct mstream* ms, const struct section* section)
-{
-    const struct key*     key;
-    const struct strlist* strlist;
-    int                   i;
+    mstream_cstr(&ms, "struct c_ini_parser;\n\n");
 
-    mstream_fmt(
-        ms,
-        "int %S_init(struct %S* s)\n{\n",
-        section->struct_name,
-        section->struct_name);
-    mstream_cstr(ms, "    memset(s, 0x00, sizeof *s);\n");
-    for (key = section->keys; key; key = key->next)
+    for (section = root->sections; section; section = section->next)
     {
-        cdt_switch(key->type)
-        {
-            case CDT_UNKNOWN: break;
-            case CDT_STR_FIXED:
-                mstream_fmt(
-                    ms,
-                    "    strcpy(s->%S, \"%S\");\n",
-                    key->name,
-                    key->attr.default_value.value.str);
-                break;
-            case CDT_STR_DYNAMIC:
-            case CDT_STR_CUSTOM:
-                mstream_fmt(
-                    ms,
-                    "    if (%S_init(&s->%S) != 0)\n"
-                    "        goto %S_failed;\n",
-                    key->attr.str_api_prefix,
-                    key->name,
-                    key->name);
-                if (key->attr.default_value.value.str.len > 0)
-                {
-                    mstream_fmt(
-                        ms,
-                        "    if (%S_set(&s->%S, \"%S\", %d) != 0)\n"
-                        "        goto %S_set_failed;\n",
-                        key->attr.str_api_prefix,
-                        key->name,
-                        key->attr.default_value.value.str,
-                        key->attr.default_value.value.str.len,
-                        key->name);
-                }
-                break;
+        mstream_fmt(&ms, "struct %S;\n", section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_init(struct %S* s);\n",
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_reset(struct %S* s);\n",
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "void %S_deinit(struct %S* s);\n",
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "void %S_set_allocator(const struct c_ini_allocator* allocator);\n",
+            section->struct_name);
+        if (section->keys)
+            mstream_fmt(
+                &ms,
+                "int %S_copy(struct %S* dst, const struct %S* src);\n"
+                "int %S_move(struct %S* dst, struct %S* src);\n"
+                "int %S_equal(const struct %S* a, const struct %S* b);\n"
+                "uint64_t %S_hash(const struct %S* s);\n",
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_parse(struct %S* s, const char* filename, const char* "
+            "data, "
+            "int len);\n",
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_parse_opts(struct %S* s, const char* filename, "
+            "const char* data, int len, const struct c_ini_options* opts);\n",
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_parse_all(const char* filename, const char* data, int len, "
+            "int (*on_section)(struct c_ini_parser* parser, void* user_ptr),"
+            "void* user_ptr);\n",
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_parse_all_opts(const char* filename, const char* data, "
+            "int len, int (*on_section)(struct c_ini_parser* parser, "
+            "void* user_ptr), void* user_ptr, "
+            "const struct c_ini_options* opts);\n",
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "void %S_cursor_init(struct c_ini_cursor* c, const char* filename, "
+            "const char* data, int len, const struct c_ini_options* opts);\n"
+            "int %S_cursor_next(struct c_ini_cursor* c, struct %S* s);\n"
+            "int %S_cursor_next_batch(struct c_ini_cursor* c, struct %S* s, "
+            "int n);\n",
+            section->struct_name,
+            section->struct_name,
+            section->struct_name,
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_parse_tail(struct c_ini_tail* tail, const char* filename, "
+            "const char* data, int len, int (*on_section)(struct c_ini_parser* "
+            "parser, void* user_ptr), void* user_ptr);\n",
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_parse_tail_opts(struct c_ini_tail* tail, "
+            "const char* filename, const char* data, int len, "
+            "int (*on_section)(struct c_ini_parser* parser, void* user_ptr), "
+            "void* user_ptr, const struct c_ini_options* opts);\n",
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_parse_section(struct %S* s, struct c_ini_parser* p);\n",
+            section->struct_name,
+            section->struct_name);
+        gen_field_types(&ms, section);
+        mstream_fmt(
+            &ms,
+            "int %S_parse_fields(struct %S* s, const uint32_t* fields, "
+            "const char* filename, const char* data, int len);\n"
+            "int %S_parse_fields_opts(struct %S* s, const uint32_t* fields, "
+            "const char* filename, const char* data, int len, "
+            "const struct c_ini_options* opts);\n",
+            section->struct_name,
+            section->struct_name,
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_parse_section_fields(struct %S* s, const uint32_t* fields, "
+            "struct c_ini_parser* p);\n",
+            section->struct_name,
+            section->struct_name);
+        if (section->keys)
+            mstream_fmt(
+                &ms,
+                "int %S_validate(const char* data, int len, "
+                "struct c_ini_error* error);\n",
+                section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_fwrite(const struct %S* s, FILE* f);\n",
+            section->struct_name,
+            section->struct_name);
+        if (section->keys)
+            mstream_fmt(
+                &ms,
+                "int %S_diff(const struct %S* a, const struct %S* b, "
+                "int (*on_change)(enum %S_field field, const void* old_value, "
+                "const void* new_value, void* user_ptr), void* user_ptr);\n"
+                "int %S_write_patch(const struct %S* base, const struct %S* s, "
+                "FILE* f);\n",
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name,
+                section->struct_name);
+        mstream_fmt(
+            &ms,
+            "int %S_for_each_value(struct %S* s, int (*on_value)(void* value, "
+            "int type, void*), void* user_ptr);\n",
+            section->struct_name,
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "size_t %S_memory_usage(const struct %S* s);\n",
+            section->struct_name,
+            section->struct_name);
+        mstream_fmt(
+            &ms,
+            "size_t %S_memory_usage_by_field(const struct %S* s, "
+            "void (*on_field)(const char* name, size_t bytes, void* user_ptr), "
+            "void* user_ptr);\n",
+            section->struct_name,
+            section->struct_name);
+        gen_header_pool(&ms, section);
+        gen_header_columns(&ms, section);
+        gen_header_lazy(&ms, section);
+        gen_header_layers(&ms, section);
+        gen_header_watch(&ms, section);
+        gen_header_handle(&ms, section);
+        gen_header_shm(&ms, section);
+        mstream_cstr(&ms, "\n");
+    }
+
+    mstream_cstr(&ms, "#if defined(__cplusplus)\n");
+    mstream_cstr(&ms, "}\n");
+    mstream_cstr(&ms, "#endif\n\n");
+
+    if (filename)
+        return write_if_different(&ms, filename);
+    return write_stdout(&ms);
+}
+
+/* ----------------------------------------------------------------------------
+ * Generate source in-memory
+ * ------------------------------------------------------------------------- */
+
+static void gen_source_includes(struct mstream* ms, const struct cfg* cfg)
+{
+    int i;
+
+    /* Shared memory segments are opened with POSIX functions, which the
+     * system headers only declare if this is defined before them */
+    mstream_cstr(
+        ms,
+        "#if defined(C_INI_SHM) && !defined(_POSIX_C_SOURCE)\n"
+        "#    define _POSIX_C_SOURCE 200112L\n"
+        "#endif\n");
+    /* Struct definitions copied from source files use the attribute macros
+     * and fixed-width integer types */
+    mstream_cstr(ms, "#include \"c-ini.h\"\n");
+    for (i = 0; i != cfg->c_includes_count; ++i)
+        mstream_fmt(ms, "#include \"%s\"\n", cfg->c_includes[i]);
+
+    mstream_cstr(ms, "#include <stdint.h>\n");
+    mstream_cstr(ms, "#include <stdlib.h>\n");
+    mstream_cstr(ms, "#include <limits.h>\n");
+    mstream_cstr(ms, "#include <ctype.h>\n");
+    mstream_cstr(ms, "#include <string.h>\n");
+    mstream_cstr(ms, "#include <stdarg.h>\n");
+    mstream_cstr(ms, "#include <stdio.h>\n\n");
+    mstream_cstr(ms, "#include <stdbool.h>\n\n");
+    mstream_cstr(
+        ms,
+        "#if defined(_MSC_VER)\n"
+        "#    include <intrin.h>\n"
+        "#endif\n"
+        "#if defined(C_INI_INSTRUMENTATION)\n"
+        "#    include <time.h>\n"
+        "#endif\n"
+        "#if defined(C_INI_SHM)\n"
+        "#    include <fcntl.h>\n"
+        "#    include <sys/mman.h>\n"
+        "#    include <sys/stat.h>\n"
+        "#    include <unistd.h>\n"
+        "#endif\n\n");
+}
+
+static void gen_source_types(struct mstream* ms)
+{
+    mstream_cstr(
+        ms,
+        "struct c_ini_strspan\n"
+        "{\n"
+        "    int off, len;\n"
+        "};\n\n");
+    mstream_cstr(
+        ms,
+        "enum token\n"
+        "{\n"
+        "    TOK_ERROR = -1,\n"
+        "    TOK_END = 0,\n"
+        "    TOK_LBRACKET = '[',\n"
+        "    TOK_RBRACKET = ']',\n"
+        "    TOK_EQUALS = '=',\n"
+        "    TOK_COMMA = ',',\n"
+        "    TOK_INTEGER = 256,\n"
+        "    TOK_FLOAT,\n"
+        "    TOK_STRING,\n"
+        "    TOK_KEY\n"
+        "};\n\n");
+    mstream_cstr(
+        ms,
+        "#if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L\n"
+        "#    define C_INI_C99\n"
+        "#endif\n"
+        "#define C_INI_CACHE_LINE 64\n\n");
+    /* Heap blocks of the built-in strings and lists start with this header.
+     * Static strings and lists (defaults and the empty sentinels) have no
+     * allocator */
+    mstream_cstr(
+        ms,
+        "struct c_ini_dyn_header\n"
+        "{\n"
+        "    const struct c_ini_allocator* allocator;\n"
+        "    size_t                        capacity;\n"
+        "    size_t                        count; /* Strings in a list */\n"
+        "};\n\n"
+        "struct c_ini_dyn_str\n"
+        "{\n"
+        "    struct c_ini_dyn_header header;\n"
+        "    char                    data[1];\n"
+        "};\n\n"
+        "struct c_ini_dyn_list\n"
+        "{\n"
+        "    struct c_ini_dyn_header header;\n"
+        "    char*                   data[1];\n"
+        "};\n\n");
+    mstream_cstr(
+        ms,
+        "struct c_ini_parser\n"
+        "{\n"
+        "    const char* filename;\n"
+        "    const char* source;\n"
+        "    int         head, tail, end;\n"
+        "    /* Offset of the \"[\" of the last section that was found */\n"
+        "    int         section_start;\n"
+        "    union\n"
+        "    {\n"
+        "        struct c_ini_strspan string;\n"
+        "        double               float_literal;\n"
+        "        int64_t              integer_literal;\n"
+        "    } value;\n");
+    mstream_cstr(
+        ms,
+        "    const struct c_ini_hooks*     hooks;\n"
+        "    struct c_ini_stats*           stats;\n"
+        "    const struct c_ini_allocator* allocator;\n"
+        "    uint64_t                      start_cycles;\n"
+        "    /* Errors are stored here instead of being printed if set */\n"
+        "    struct c_ini_error*           error;\n"
+        "    /* Fields that are assigned are added to this set, if any */\n"
+        "    uint32_t*                     dirty;\n"
+        "    FILE*                         diagnostics;\n"
+        "    int                           colors;\n");
+    mstream_cstr(
+        ms,
+        "    /* INT_MAX if there is no limit */\n"
+        "    int    max_bytes;\n"
+        "    int    max_sections, sections;\n"
+        "    int    max_keys, keys;\n"
+        "    int    max_list_elements;\n"
+        "    int    max_string_length;\n"
+        "    int    max_allocated;\n"
+        "    size_t allocated;\n"
+        "};\n\n");
+    /* Instrumentation compiles to nothing unless it is asked for */
+    mstream_cstr(
+        ms,
+        "#if defined(C_INI_INSTRUMENTATION)\n"
+        "#    define C_INI_STAT(p, counter, n) \\\n"
+        "        do { if ((p)->stats) (p)->stats->counter += (n); } while (0)\n"
+        "#    define C_INI_HOOK(p, hook, name) \\\n"
+        "        do { if ((p)->hooks && (p)->hooks->hook) \\\n"
+        "            (p)->hooks->hook((p)->hooks->user, name, c_ini_cycles()); "
+        "} while (0)\n"
+        "#else\n"
+        "#    define C_INI_STAT(p, counter, n) ((void)0)\n"
+        "#    define C_INI_HOOK(p, hook, name) ((void)0)\n"
+        "#endif\n\n");
+    /* C90 has no atomics, so the snapshot handles and shared memory images use
+     * compiler builtins. All of them are sequentially consistent. x86 doesn't
+     * reorder loads, so a compiler barrier is enough of a fence there */
+    mstream_cstr(
+        ms,
+        "#if defined(_MSC_VER)\n"
+        "#    define C_INI_LOAD_PTR(p) \\\n"
+        "        _InterlockedCompareExchangePointer((void* volatile*)(p), NULL, "
+        "NULL)\n"
+        "#    define C_INI_EXCHANGE_PTR(p, v) \\\n"
+        "        _InterlockedExchangePointer((void* volatile*)(p), (v))\n"
+        "#    define C_INI_LOAD_U32(p) \\\n"
+        "        (uint32_t)_InterlockedCompareExchange((volatile long*)(p), 0, "
+        "0)\n");
+    mstream_cstr(
+        ms,
+        "#    define C_INI_STORE_U32(p, v) \\\n"
+        "        (void)_InterlockedExchange((volatile long*)(p), (long)(v))\n"
+        "#    define C_INI_CAS_U32(p, old, v) \\\n"
+        "        (_InterlockedCompareExchange((volatile long*)(p), (long)(v), \\\n"
+        "                                     (long)(old)) == (long)(old))\n"
+        "#    if defined(_M_ARM) || defined(_M_ARM64)\n"
+        "#        define C_INI_FENCE() __dmb(0xb)\n"
+        "#    else\n"
+        "#        define C_INI_FENCE() _ReadWriteBarrier()\n"
+        "#    endif\n");
+    mstream_cstr(
+        ms,
+        "#else\n"
+        "#    define C_INI_LOAD_PTR(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)\n"
+        "#    define C_INI_EXCHANGE_PTR(p, v) \\\n"
+        "        __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)\n"
+        "#    define C_INI_LOAD_U32(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)\n"
+        "#    define C_INI_STORE_U32(p, v) \\\n"
+        "        __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)\n"
+        "#    define C_INI_CAS_U32(p, old, v) "
+        "__sync_bool_compare_and_swap((p), (old), (v))\n"
+        "#    define C_INI_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)\n"
+        "#endif\n\n");
+}
+
+/*!
+ * \brief Writes the INI tokenizer and error reporting functions.
+ * \param[in] linkage Either "static " when everything is written into a single
+ * C file, or "" when the functions are shared between several shards.
+ */
+static void gen_source_ini_parser(struct mstream* ms, const char* linkage)
+{
+    mstream_cstr(
+        ms,
+        "static struct c_ini_strspan c_ini_strspan(int off, int len)\n"
+        "{\n"
+        "    struct c_ini_strspan sv;\n"
+        "    sv.off = off;\n"
+        "    sv.len = len;\n"
+        "    return sv;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int cstr_equal(const char* s1, struct c_ini_strspan s2, const "
+        "char* "
+        "data)\n"
+        "{\n"
+        "    if ((int)strlen(s1) != s2.len)\n"
+        "        return 0;\n"
+        "    return memcmp(s1, data + s2.off, s2.len) == 0;\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "/* Diagnostics are collected here and written with one fwrite(), so "
+        "that the\n"
+        " * messages of parsers on different threads don't interleave */\n"
+        "struct c_ini_out\n"
+        "{\n"
+        "    FILE* f;\n"
+        "    int   colors;\n"
+        "    int   len;\n"
+        "    char  data[4096];\n"
+        "};\n\n");
+    mstream_cstr(
+        ms,
+        "static void out_flush(struct c_ini_out* o)\n"
+        "{\n"
+        "    if (o->f && o->len)\n"
+        "        fwrite(o->data, 1, o->len, o->f);\n"
+        "    o->len = 0;\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void out_putc(struct c_ini_out* o, char c)\n"
+        "{\n"
+        "    if (o->len == (int)sizeof(o->data))\n"
+        "    {\n"
+        "        /* Without a file the output is truncated */\n"
+        "        if (o->f == NULL)\n"
+        "            return;\n"
+        "        out_flush(o);\n"
+        "    }\n"
+        "    o->data[o->len++] = c;\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void out_str(struct c_ini_out* o, const char* str, int len)\n"
+        "{\n"
+        "    int i;\n"
+        "    for (i = 0; len < 0 ? str[i] != '\\0' : i != len; ++i)\n"
+        "        out_putc(o, str[i]);\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void out_repeat(struct c_ini_out* o, char c, int n)\n"
+        "{\n"
+        "    for (; n > 0; --n)\n"
+        "        out_putc(o, c);\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void out_int(struct c_ini_out* o, int value, int width)\n"
+        "{\n"
+        "    char num[12];\n"
+        "    int  len = sprintf(num, \"%d\", value);\n"
+        "    out_repeat(o, ' ', width - len);\n"
+        "    out_str(o, num, len);\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "/* C90 has no vsnprintf(). The messages only use %d, %s and %.*s */\n"
+        "static void out_vfmt(struct c_ini_out* o, const char* fmt, va_list "
+        "ap)\n"
+        "{\n"
+        "    int len;\n"
+        "    for (; *fmt; ++fmt)\n"
+        "    {\n"
+        "        if (*fmt != '%')\n"
+        "        {\n"
+        "            out_putc(o, *fmt);\n"
+        "            continue;\n"
+        "        }\n"
+        "        len = -1;\n"
+        "        if (fmt[1] == '.' && fmt[2] == '*')\n"
+        "        {\n"
+        "            len = va_arg(ap, int);\n"
+        "            fmt += 2;\n"
+        "        }\n"
+        "        switch (*++fmt)\n"
+        "        {\n");
+    mstream_cstr(
+        ms,
+        "            case 'd': out_int(o, va_arg(ap, int), 0); break;\n"
+        "            case 's': out_str(o, va_arg(ap, const char*), len); "
+        "break;\n"
+        "            default: out_putc(o, '%'); break;\n"
+        "        }\n"
+        "    }\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void emph_style(struct c_ini_out* o)\n"
+        "{\n"
+        "    if (o->colors) out_str(o, \"\\033[1;37m\", -1);\n"
+        "}\n"
+        "static void error_style(struct c_ini_out* o)\n"
+        "{\n"
+        "    if (o->colors) out_str(o, \"\\033[1;31m\", -1);\n"
+        "}\n"
+        "static void underline_style(struct c_ini_out* o)\n"
+        "{\n"
+        "    if (o->colors) out_str(o, \"\\033[1;31m\", -1);\n"
+        "}\n"
+        "static void reset_style(struct c_ini_out* o)\n"
+        "{\n"
+        "    if (o->colors) out_str(o, \"\\033[0m\", -1);\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void print_vflc(\n"
+        "    struct c_ini_out*    o,\n"
+        "    const char*          filename,\n"
+        "    const char*          source,\n"
+        "    struct c_ini_strspan loc,\n"
+        "    const char*          fmt,\n"
+        "    va_list              ap)\n"
+        "{\n"
+        "    int i;\n"
+        "    int l1, c1;\n\n");
+    mstream_cstr(
+        ms,
+        "    l1 = 1, c1 = 1;\n"
+        "    for (i = 0; i != loc.off; i++)\n"
+        "    {\n"
+        "        c1++;\n"
+        "        if (source[i] == '\\n')\n"
+        "            l1++, c1 = 1;\n"
+        "    }\n\n");
+    mstream_cstr(
+        ms,
+        "    emph_style(o);\n"
+        "    out_str(o, filename, -1);\n"
+        "    out_putc(o, ':');\n"
+        "    out_int(o, l1, 0);\n"
+        "    out_putc(o, ':');\n"
+        "    out_int(o, c1, 0);\n"
+        "    out_putc(o, ':');\n"
+        "    reset_style(o);\n"
+        "    out_putc(o, ' ');\n"
+        "    error_style(o);\n"
+        "    out_str(o, \"error:\", -1);\n"
+        "    reset_style(o);\n"
+        "    out_putc(o, ' ');\n"
+        "    out_vfmt(o, fmt, ap);\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static int num_digits(int value)\n"
+        "{\n"
+        "    int digits = 0;\n"
+        "    while (value)\n"
+        "        digits++, value /= 10;\n"
+        "    return digits ? digits : 1;\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void print_excerpt(\n"
+        "    struct c_ini_out* o, const char* source, struct c_ini_strspan "
+        "loc)\n"
+        "{\n"
+        "    int                  i;\n"
+        "    int                  l1, c1, l2, c2;\n"
+        "    int                  indent, max_indent;\n"
+        "    int                  gutter_indent;\n"
+        "    int                  line;\n"
+        "    struct c_ini_strspan block;\n\n");
+    mstream_cstr(
+        ms,
+        "    /* Calculate line column as well as beginning of block. The "
+        "goal is to make\n"
+        "     * \"block\" point to the first character in the line that "
+        "contains the\n"
+        "     * location. */\n"
+        "    l1 = 1, c1 = 1, block.off = 0;\n"
+        "    for (i = 0; i != loc.off; i++)\n"
+        "    {\n"
+        "        c1++;\n"
+        "        if (source[i] == '\\n')\n"
+        "            l1++, c1 = 1, block.off = i + 1;\n"
+        "    }\n\n");
+    mstream_cstr(
+        ms,
+        "    /* Calculate line/column of where the location ends */\n"
+        "    l2 = l1, c2 = c1;\n"
+        "    for (i = 0; i != loc.len; i++)\n"
+        "    {\n"
+        "        c2++;\n"
+        "        if (source[loc.off + i] == '\\n')\n"
+        "            l2++, c2 = 1;\n"
+        "    }\n\n");
+    mstream_cstr(
+        ms,
+        "    /* Find the end of the line for block */\n"
+        "    block.len = loc.off - block.off + loc.len;\n"
+        "    for (; source[loc.off + i]; block.len++, i++)\n"
+        "        if (source[loc.off + i] == '\\n')\n"
+        "            break;\n\n");
+    mstream_cstr(
+        ms,
+        "    /* We also keep track of the minimum indentation. This is used "
+        "to unindent\n"
+        "     * the block of code as much as possible when printing out the "
+        "excerpt. */\n"
+        "    max_indent = 10000;\n"
+        "    for (i = 0; i != block.len;)\n"
+        "    {\n"
+        "        indent = 0;\n"
+        "        for (; i != block.len; ++i, ++indent)\n"
+        "        {\n"
+        "            if (source[block.off + i] != ' ' && source[block.off + "
+        "i] != '\\t')\n"
+        "                break;\n"
+        "        }\n"
+        "        if (max_indent > indent)\n"
+        "            max_indent = indent;\n\n");
+    mstream_cstr(
+        ms,
+        "        while (i != block.len)\n"
+        "            if (source[block.off + i++] == '\\n')\n"
+        "                break;\n"
+        "    }\n\n");
+    mstream_cstr(
+        ms,
+        "    /* Unindent columns */\n"
+        "    c1 -= max_indent;\n"
+        "    c2 -= max_indent;\n\n");
+    mstream_cstr(
+        ms,
+        "    gutter_indent = num_digits(l2);\n"
+        "    gutter_indent += 2; /* Padding on either side of the line "
+        "number */\n\n");
+    mstream_cstr(
+        ms,
+        "    /* Print line number, gutter, and block of code */\n"
+        "    line = l1;\n"
+        "    for (i = 0; i != block.len;)\n"
+        "    {\n"
+        "        out_int(o, line, gutter_indent - 1);\n"
+        "        out_str(o, \" | \", -1);\n\n");
+    mstream_cstr(
+        ms,
+        "        if (i >= loc.off - block.off && i <= loc.off - block.off + "
+        "loc.len)\n"
+        "            underline_style(o);\n\n");
+    mstream_cstr(
+        ms,
+        "        indent = 0;\n"
+        "        while (i != block.len)\n"
+        "        {\n"
+        "            if (i == loc.off - block.off)\n"
+        "                underline_style(o);\n"
+        "            if (i == loc.off - block.off + loc.len)\n"
+        "                reset_style(o);\n\n");
+    mstream_cstr(
+        ms,
+        "            if (indent++ >= max_indent)\n"
+        "                out_putc(o, source[block.off + i]);\n\n");
+    mstream_cstr(
+        ms,
+        "            if (source[block.off + i++] == '\\n')\n"
+        "            {\n"
+        "                if (i >= loc.off - block.off &&\n"
+        "                    i <= loc.off - block.off + loc.len)\n"
+        "                    reset_style(o);\n"
+        "                break;\n"
+        "            }\n"
+        "        }\n"
+        "        line++;\n"
+        "    }\n"
+        "    reset_style(o);\n"
+        "    out_putc(o, '\\n');\n\n");
+    mstream_cstr(
+        ms,
+        "    /* print underline */\n"
+        "    if (c2 > c1)\n"
+        "    {\n"
+        "        out_repeat(o, ' ', gutter_indent);\n"
+        "        out_putc(o, '|');\n"
+        "        out_repeat(o, ' ', c1);\n"
+        "        underline_style(o);\n"
+        "        out_putc(o, '^');\n"
+        "        for (i = c1 + 1; i < c2; ++i)\n"
+        "            out_putc(o, '~');\n"
+        "        reset_style(o);\n"
+        "    }\n"
+        "    else\n"
+        "    {\n"
+        "        int col, max_col;\n\n");
+    mstream_cstr(
+        ms,
+        "        out_repeat(o, ' ', gutter_indent);\n"
+        "        out_str(o, \"| \", -1);\n"
+        "        underline_style(o);\n"
+        "        for (i = 1; i < c2; ++i)\n"
+        "            out_putc(o, '~');\n"
+        "        for (; i < c1; ++i)\n"
+        "            out_putc(o, ' ');\n"
+        "        out_putc(o, '^');\n\n");
+    mstream_cstr(
+        ms,
+        "        /* Have to find length of the longest line */\n"
+        "        col = 1, max_col = 1;\n"
+        "        for (i = 0; i != block.len; ++i)\n"
+        "        {\n"
+        "            if (max_col < col)\n"
+        "                max_col = col;\n"
+        "            col++;\n"
+        "            if (source[block.off + i] == '\\n')\n"
+        "                col = 1;\n"
+        "        }\n"
+        "        max_col -= max_indent;\n\n");
+    mstream_cstr(
+        ms,
+        "        for (i = c1 + 1; i < max_col; ++i)\n"
+        "            out_putc(o, '~');\n"
+        "        reset_style(o);\n"
+        "    }\n\n");
+    mstream_cstr(
+        ms,
+        "    out_putc(o, '\\n');\n"
+        "}\n\n");
+    mstream_cstr(ms, "#if defined(C_INI_INSTRUMENTATION)\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "uint64_t c_ini_cycles(void)\n"
+        "{\n"
+        "#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))\n"
+        "    return __rdtsc();\n"
+        "#elif defined(__GNUC__) && (defined(__x86_64__) || "
+        "defined(__i386__))\n"
+        "    return __builtin_ia32_rdtsc();\n"
+        "#elif defined(__GNUC__) && defined(__aarch64__)\n"
+        "    uint64_t cycles;\n"
+        "    __asm__ __volatile__(\"mrs %0, cntvct_el0\" : \"=r\"(cycles));\n"
+        "    return cycles;\n"
+        "#else\n"
+        "    return (uint64_t)clock();\n"
+        "#endif\n"
+        "}\n"
+        "#endif\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "void parser_init(\n"
+        "    struct c_ini_parser*        p,\n"
+        "    const char*                 filename,\n"
+        "    const char*                 data,\n"
+        "    int                         len,\n"
+        "    const struct c_ini_options* opts)\n"
+        "{\n"
+        "    p->filename = filename;\n"
+        "    p->source = data;\n"
+        "    p->end = len;\n"
+        "    p->head = 0;\n"
+        "    p->tail = 0;\n"
+        "    p->section_start = 0;\n");
+    mstream_cstr(
+        ms,
+        "    p->hooks = opts ? opts->hooks : NULL;\n"
+        "    p->stats = opts ? opts->stats : NULL;\n"
+        "    p->allocator = opts ? opts->allocator : NULL;\n"
+        "    p->dirty = opts ? opts->dirty : NULL;\n"
+        "    p->diagnostics =\n"
+        "        opts && opts->diagnostics ? opts->diagnostics : stderr;\n"
+        "    p->colors = !(opts && opts->disable_colors);\n"
+        "    p->start_cycles = 0;\n"
+        "    p->error = NULL;\n");
+    mstream_cstr(
+        ms,
+        "#define C_INI_LIMIT(name) \\\n"
+        "    (opts && opts->limits && opts->limits->name > 0 ? "
+        "opts->limits->name \\\n"
+        "                                                   : INT_MAX)\n"
+        "    p->max_bytes = C_INI_LIMIT(max_bytes);\n"
+        "    p->max_sections = C_INI_LIMIT(max_sections);\n"
+        "    p->max_keys = C_INI_LIMIT(max_keys_per_section);\n"
+        "    p->max_list_elements = C_INI_LIMIT(max_list_elements);\n"
+        "    p->max_string_length = C_INI_LIMIT(max_string_length);\n"
+        "    p->max_allocated = C_INI_LIMIT(max_allocated_bytes);\n"
+        "#undef C_INI_LIMIT\n");
+    mstream_cstr(
+        ms,
+        "    p->sections = 0;\n"
+        "    p->keys = 0;\n"
+        "    p->allocated = 0;\n"
+        "#if defined(C_INI_INSTRUMENTATION)\n"
+        "    p->start_cycles = c_ini_cycles();\n"
+        "    C_INI_HOOK(p, document_begin, filename);\n"
+        "#endif\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int parser_finish(struct c_ini_parser* p, int result)\n"
+        "{\n"
+        "#if defined(C_INI_INSTRUMENTATION)\n"
+        "    C_INI_HOOK(p, document_end, p->filename);\n"
+        "    C_INI_STAT(p, bytes, p->head);\n"
+        "    C_INI_STAT(p, cycles, c_ini_cycles() - p->start_cycles);\n"
+        "#else\n"
+        "    (void)p;\n"
+        "#endif\n"
+        "    return result;\n"
+        "}\n\n");
+    /* Strings can span lines, so a "[" at the start of a line only starts a
+     * section if it isn't within one */
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int c_ini_tail_end(const char* data, int offset, int len)\n"
+        "{\n"
+        "    int end = offset;\n"
+        "    int in_string = 0;\n"
+        "    int i;\n\n"
+        "    for (i = offset; i != len; ++i)\n"
+        "    {\n"
+        "        if (in_string)\n"
+        "            in_string = data[i] != '\"' || data[i - 1] == '\\\\';\n");
+    mstream_cstr(
+        ms,
+        "        else if (data[i] == '\"')\n"
+        "            in_string = 1;\n"
+        "        else if (data[i] == '#' || data[i] == ';')\n"
+        "            while (i + 1 != len && data[i + 1] != '\\n')\n"
+        "                ++i;\n"
+        "        else if (data[i] == '[' && i > offset && data[i - 1] == "
+        "'\\n')\n"
+        "            end = i;\n"
+        "    }\n"
+        "    return end;\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void parser_store_error(\n"
+        "    struct c_ini_parser* p,\n"
+        "    struct c_ini_strspan loc,\n"
+        "    const char*          fmt,\n"
+        "    va_list              ap)\n"
+        "{\n"
+        "    struct c_ini_error* e = p->error;\n"
+        "    struct c_ini_out    o;\n"
+        "    int                 i;\n\n");
+    mstream_cstr(
+        ms,
+        "    /* Keep the first error. Later ones are usually caused by it */\n"
+        "    if (e->offset >= 0)\n"
+        "        return;\n"
+        "    e->offset = loc.off;\n"
+        "    e->length = loc.len;\n"
+        "    e->line = 1;\n"
+        "    e->column = 1;\n"
+        "    for (i = 0; i != loc.off; ++i, ++e->column)\n"
+        "        if (p->source[i] == '\\n')\n"
+        "        {\n"
+        "            e->line++;\n"
+        "            e->column = 0;\n"
+        "        }\n\n");
+    mstream_cstr(
+        ms,
+        "    o.f = NULL;\n"
+        "    o.colors = 0;\n"
+        "    o.len = 0;\n"
+        "    out_vfmt(&o, fmt, ap);\n"
+        "    /* Messages end with a newline for the diagnostics */\n"
+        "    if (o.len > 0 && o.data[o.len - 1] == '\\n')\n"
+        "        o.len--;\n"
+        "    if (o.len > (int)sizeof(e->message) - 1)\n"
+        "        o.len = (int)sizeof(e->message) - 1;\n"
+        "    memcpy(e->message, o.data, o.len);\n"
+        "    e->message[o.len] = '\\0';\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int parser_error(struct c_ini_parser* p, const char* fmt, "
+        "...)\n"
+        "{\n"
+        "    va_list              ap;\n"
+        "    struct c_ini_strspan loc;\n"
+        "    struct c_ini_out     o;\n"
+        "    loc.off = p->tail;\n"
+        "    loc.len = p->head - p->tail;\n"
+        "    va_start(ap, fmt);\n"
+        "    if (p->error)\n"
+        "    {\n"
+        "        parser_store_error(p, loc, fmt, ap);\n"
+        "        va_end(ap);\n"
+        "        return -1;\n"
+        "    }\n");
+    mstream_cstr(
+        ms,
+        "    o.f = p->diagnostics;\n"
+        "    o.colors = p->colors;\n"
+        "    o.len = 0;\n"
+        "    print_vflc(&o, p->filename, p->source, loc, fmt, ap);\n"
+        "    va_end(ap);\n"
+        "    print_excerpt(&o, p->source, loc);\n"
+        "    out_flush(&o);\n"
+        "    return -1;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "enum token scan_next(struct c_ini_parser* p)\n"
+        "{\n"
+        "    C_INI_STAT(p, tokens, 1);\n"
+        "    p->tail = p->head;\n"
+        "    while (p->head != p->end)\n"
+        "    {\n"
+        "        /* Skip comments */\n"
+        "        if (p->source[p->head] == '#' || p->source[p->head] == ';')\n"
+        "        {\n"
+        "            for (p->head++; p->head != p->end; p->head++)\n"
+        "                if (p->source[p->head] == '\\n')\n"
+        "                {\n"
+        "                    p->head++;\n"
+        "                    break;\n"
+        "                }\n"
+        "            p->tail = p->head;\n"
+        "            continue;\n"
+        "        }\n\n");
+    mstream_cstr(
+        ms,
+        "        /* Special characters */\n"
+        "        if (p->source[p->head] == '[')\n"
+        "            return p->source[p->head++];\n"
+        "        if (p->source[p->head] == ']')\n"
+        "            return p->source[p->head++];\n"
+        "        if (p->source[p->head] == '=')\n"
+        "            return p->source[p->head++];\n"
+        "        if (p->source[p->head] == ',')\n"
+        "            return p->source[p->head++];\n\n");
+    mstream_cstr(
+        ms,
+        "        /* Boolean */\n"
+        "        if (p->end - p->head >= (int)sizeof(\"true\") - 1 &&\n"
+        "            memcmp(p->source + p->head, \"true\", sizeof(\"true\") - "
+        "1) == 0)\n"
+        "        {\n"
+        "            p->head += sizeof(\"true\") - 1;\n"
+        "            p->value.integer_literal = 1;\n"
+        "            return TOK_INTEGER;\n"
+        "        }\n");
+    mstream_cstr(
+        ms,
+        "        if (p->end - p->head >= (int)sizeof(\"false\") - 1 &&\n"
+        "            memcmp(p->source + p->head, \"false\", sizeof(\"false\") "
+        "- "
+        "1) == 0)\n"
+        "        {\n"
+        "            p->head += sizeof(\"false\") - 1;\n"
+        "            p->value.integer_literal = 0;\n"
+        "            return TOK_INTEGER;\n"
+        "        }\n\n");
+    mstream_cstr(
+        ms,
+        "        /* Number */\n"
+        "        if (isdigit(p->source[p->head]) || p->source[p->head] == "
+        "'-')\n"
+        "        {\n"
+        "            char is_neg = p->source[p->head] == '-';\n"
+        "            if (p->source[p->head] == '-')\n"
+        "                p->head++;\n\n");
+    mstream_cstr(
+        ms,
+        "            p->value.integer_literal = 0;\n"
+        "            for (; p->head != p->end && isdigit(p->source[p->head]); "
+        "++p->head)\n"
+        "            {\n"
+        "                p->value.integer_literal *= 10;\n"
+        "                p->value.integer_literal += p->source[p->head] - "
+        "'0';\n"
+        "            }\n");
+    mstream_cstr(
+        ms,
+        "            /* It is actually a float */\n"
+        "            if (p->head != p->end && p->source[p->head] == '.')\n"
+        "            {\n"
+        "                double fraction = 1.0;\n"
+        "                p->value.float_literal = "
+        "(double)p->value.integer_literal;\n"
+        "                for (p->head++; p->head != p->end && "
+        "isdigit(p->source[p->head]);\n"
+        "                     ++p->head)\n");
+    mstream_cstr(
+        ms,
+        "                {\n"
+        "                    fraction *= 0.1;\n"
+        "                    p->value.float_literal +=\n"
+        "                        fraction * (double)(p->source[p->head] - "
+        "'0');\n"
+        "                }\n"
+        "                if (p->head != p->end && p->source[p->head] == 'f')\n"
+        "                    ++p->head;\n\n");
+    mstream_cstr(
+        ms,
+        "                if (is_neg)\n"
+        "                    p->value.float_literal = "
+        "-p->value.float_literal;\n"
+        "                return TOK_FLOAT;\n"
+        "            }\n"
+        "\n"
+        "            if (is_neg)\n"
+        "                p->value.integer_literal = "
+        "-p->value.integer_literal;\n"
+        "            return TOK_INTEGER;\n"
+        "        }\n");
+    mstream_cstr(
+        ms,
+        "        /* String literal \".*?\" (spans over newlines)*/\n"
+        "        if (p->source[p->head] == '\"')\n"
+        "        {\n"
+        "            int tail = ++p->head;\n"
+        "            /* Don't look further than the longest allowed string */\n"
+        "            int end = p->end - tail > p->max_string_length\n"
+        "                          ? tail + p->max_string_length + 1\n"
+        "                          : p->end;\n"
+        "            for (; p->head != end; ++p->head)\n"
+        "                if (p->source[p->head] == '\"' && p->source[p->head - "
+        "1] != '\\\\')\n");
+    mstream_cstr(
+        ms,
+        "                    break;\n"
+        "            if (p->head == p->end)\n"
+        "                return parser_error(p, \"Missing closing quote on "
+        "string\\n\");\n"
+        "            if (p->head == end)\n"
+        "                return parser_error(\n"
+        "                    p,\n"
+        "                    \"String is longer than the limit of %d bytes\\n\",\n"
+        "                    p->max_string_length);\n"
+        "            p->value.string = c_ini_strspan(tail, p->head++ - tail);\n"
+        "            return TOK_STRING;\n"
+        "        }\n\n");
+    mstream_cstr(
+        ms,
+        "        /* Key */\n"
+        "        if (isalpha(p->source[p->head]))\n"
+        "        {\n"
+        "            while (p->head != p->end &&\n"
+        "                   (isalnum(p->source[p->head]) || p->source[p->head] "
+        "== '_'))\n"
+        "            {\n"
+        "                p->head++;\n"
+        "            }\n"
+        "            p->value.string = c_ini_strspan(p->tail, p->head - "
+        "p->tail);\n"
+        "            return TOK_KEY;\n"
+        "        }\n\n");
+    mstream_cstr(
+        ms,
+        "        /* Ignore everything else */\n"
+        "        p->tail = ++p->head;\n"
+        "    }\n"
+        "\n"
+        "    return TOK_END;\n"
+        "}\n\n");
+}
+
+static void gen_source_c_ini_allocator(struct mstream* ms)
+{
+    /* Every allocation made by the built-in string types is prefixed with a
+     * header that remembers the allocator, so it can always be freed by the
+     * allocator that made it, regardless of which one was passed to _parse */
+    mstream_cstr(
+        ms,
+        "#define C_INI_DYN_HEADER(ptr) ((struct c_ini_dyn_header*)(ptr) - 1)\n\n");
+    mstream_cstr(
+        ms,
+        "static void* c_ini_default_alloc(void* ctx, size_t size)\n{\n"
+        "    (void)ctx;\n"
+        "    return malloc(size);\n"
+        "}\n\n"
+        "static void* c_ini_default_realloc(void* ctx, void* ptr, size_t size)\n"
+        "{\n"
+        "    (void)ctx;\n"
+        "    return realloc(ptr, size);\n"
+        "}\n\n");
+    mstream_cstr(
+        ms,
+        "static void c_ini_default_free(void* ctx, void* ptr)\n{\n"
+        "    (void)ctx;\n"
+        "    free(ptr);\n"
+        "}\n\n"
+        "static const struct c_ini_allocator c_ini_default_allocator = {\n"
+        "    c_ini_default_alloc,\n"
+        "    c_ini_default_realloc,\n"
+        "    c_ini_default_free,\n"
+        "    NULL};\n\n");
+}
+
+static void gen_source_c_str_dyn(
+    struct mstream* ms, const char* linkage, int has_empty_strings)
+{
+    /* Built-in "custom string" functions for C-strings. There is no _init(),
+     * because empty strings point to a shared sentinel, so nothing is
+     * allocated until the first write. A string that owns a buffer keeps it,
+     * and its allocator, until _deinit(). If every string has a default, the
+     * sentinel would be unused */
+    if (has_empty_strings)
+    {
+        mstream_cstr(ms, linkage);
+        mstream_cstr(
+            ms,
+            "const struct c_ini_dyn_str c_str_dyn_empty = "
+            "{{NULL, 0, 0}, \"\"};\n\n");
+    }
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "void c_str_dyn_deinit(char* s)\n{\n"
+        "    struct c_ini_dyn_header* h;\n"
+        "    if (s == NULL)\n"
+        "        return;\n"
+        "    h = C_INI_DYN_HEADER(s);\n"
+        "    if (h->allocator)\n"
+        "        (h->allocator->free)(h->allocator->ctx, h);\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int c_str_dyn_set(\n"
+        "    const struct c_ini_allocator* a, char** s, const char* data, "
+        "int len)\n"
+        "{\n"
+        "    struct c_ini_dyn_header* h = C_INI_DYN_HEADER(*s);\n"
+        "    if (h->allocator == NULL)\n"
+        "    {\n"
+        "        if (a == NULL)\n"
+        "            a = &c_ini_default_allocator;\n"
+        "        h = (a->alloc)(a->ctx, sizeof *h + len + 1);\n"
+        "        if (h == NULL)\n"
+        "            return -1;\n"
+        "        h->allocator = a;\n"
+        "        h->capacity = len + 1;\n"
+        "    }\n");
+    mstream_cstr(
+        ms,
+        "    else if (h->capacity < (size_t)len + 1)\n"
+        "    {\n"
+        "        a = h->allocator;\n"
+        "        h = (a->realloc)(a->ctx, h, sizeof *h + len + 1);\n"
+        "        if (h == NULL)\n"
+        "            return -1;\n"
+        "        h->capacity = len + 1;\n"
+        "    }\n"
+        "    *s = (char*)(h + 1);\n"
+        "    memcpy(*s, data, len);\n"
+        "    (*s)[len] = '\\0';\n"
+        "    return 0;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "void c_str_dyn_reset(char** s, char* def)\n{\n"
+        "    struct c_ini_dyn_header* h = C_INI_DYN_HEADER(*s);\n"
+        "    size_t                   len = strlen(def);\n"
+        "    if (h->allocator && h->capacity > len)\n"
+        "    {\n"
+        "        memcpy(*s, def, len + 1);\n"
+        "        return;\n"
+        "    }\n"
+        "    c_str_dyn_deinit(*s);\n"
+        "    *s = def;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "const char* c_str_dyn_data(const char* s)\n{\n"
+        "    return s;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int c_str_dyn_len(const char* s)\n{\n"
+        "    return (int)strlen(s);\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "size_t c_str_dyn_memory(const char* s)\n{\n"
+        "    const struct c_ini_dyn_header* h = C_INI_DYN_HEADER(s);\n"
+        "    return h->allocator ? sizeof *h + h->capacity : 0;\n"
+        "}\n\n");
+}
+
+static void
+gen_source_c_strlist_dyn(struct mstream* ms, const char* linkage)
+{
+    /* Built-in "custom stringlist" functions for C-strings. The strings are
+     * allocated with the same allocator as the list itself. Like strings,
+     * empty lists point to a shared sentinel */
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "const struct c_ini_dyn_list c_strlist_dyn_empty = "
+        "{{NULL, 0, 0}, {NULL}};\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "void c_strlist_dyn_clear(char** l)\n{\n"
+        "    const struct c_ini_allocator* a = C_INI_DYN_HEADER(l)->allocator;\n"
+        "    char**                        p;\n"
+        "    if (a == NULL)\n"
+        "        return;\n"
+        "    for (p = l; *p; ++p)\n"
+        "        (a->free)(a->ctx, *p);\n"
+        "    l[0] = NULL;\n"
+        "    C_INI_DYN_HEADER(l)->count = 0;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "void c_strlist_dyn_deinit(char** l)\n{\n"
+        "    struct c_ini_dyn_header* h;\n"
+        "    if (l == NULL)\n"
+        "        return;\n"
+        "    c_strlist_dyn_clear(l);\n"
+        "    h = C_INI_DYN_HEADER(l);\n"
+        "    if (h->allocator)\n"
+        "        (h->allocator->free)(h->allocator->ctx, h);\n"
+        "}\n\n");
+    /* Static lists can't be cleared in place, so the list is pointed at the
+     * default instead. A list that owns a block keeps it if the default is
+     * empty */
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "void c_strlist_dyn_reset(char*** l, char** def)\n{\n"
+        "    if (C_INI_DYN_HEADER(*l)->allocator && def[0] == NULL)\n"
+        "    {\n"
+        "        c_strlist_dyn_clear(*l);\n"
+        "        return;\n"
+        "    }\n"
+        "    c_strlist_dyn_deinit(*l);\n"
+        "    *l = def;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int c_strlist_dyn_add(\n"
+        "    const struct c_ini_allocator* a, char*** l, const char* data, "
+        "int len)\n"
+        "{\n"
+        "    struct c_ini_dyn_header* h = C_INI_DYN_HEADER(*l);\n"
+        "    char**                   p;\n"
+        "    char**                   def;\n"
+        "    size_t                   list_len;\n");
+    /* Static lists are copied on the first write, so adding to a default
+     * appends to it. Capacity grows geometrically, so adding n strings is
+     * O(n) */
+    mstream_cstr(
+        ms,
+        "    if (h->allocator == NULL)\n"
+        "    {\n"
+        "        list_len = h->count;\n"
+        "        def = *l;\n"
+        "        if (a == NULL)\n"
+        "            a = &c_ini_default_allocator;\n"
+        "        h = (a->alloc)(\n"
+        "            a->ctx, sizeof *h + sizeof(char*) * (list_len + 4));\n"
+        "        if (h == NULL)\n"
+        "            return -1;\n"
+        "        h->allocator = a;\n");
+    mstream_cstr(
+        ms,
+        "        h->capacity = list_len + 4;\n"
+        "        h->count = 0;\n"
+        "        *l = (char**)(h + 1);\n"
+        "        (*l)[0] = NULL;\n"
+        "        for (p = def; *p; ++p)\n"
+        "            if (c_strlist_dyn_add(a, l, *p, (int)strlen(*p)) != 0)\n"
+        "                return -1;\n"
+        "    }\n");
+    mstream_cstr(
+        ms,
+        "    else if (h->capacity < h->count + 2)\n"
+        "    {\n"
+        "        a = h->allocator;\n"
+        "        h = (a->realloc)(\n"
+        "            a->ctx, h, sizeof *h + sizeof(char*) * h->capacity * 2);\n"
+        "        if (h == NULL)\n"
+        "            return -1;\n"
+        "        h->capacity *= 2;\n"
+        "    }\n"
+        "    a = h->allocator;\n"
+        "    list_len = h->count;\n"
+        "    *l = p = (char**)(h + 1);\n");
+    mstream_cstr(
+        ms,
+        "    p[list_len] = (a->alloc)(a->ctx, len + 1);\n"
+        "    if (p[list_len] == NULL)\n"
+        "        return -1;\n"
+        "    memcpy(p[list_len], data, len);\n"
+        "    p[list_len][len] = '\\0';\n"
+        "    p[list_len + 1] = NULL;\n"
+        "    h->count++;\n"
+        "    return 0;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int c_strlist_dyn_count(char* const* l)\n{\n"
+        "    return (int)C_INI_DYN_HEADER(l)->count;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "const char* c_strlist_dyn_cstr(char* const* l, int i)\n{\n"
+        "    return l[i];\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "size_t c_strlist_dyn_memory(char* const* l)\n{\n"
+        "    const struct c_ini_dyn_header* h = C_INI_DYN_HEADER(l);\n"
+        "    size_t bytes = sizeof *h + sizeof(char*) * h->capacity;\n"
+        "    if (h->allocator == NULL)\n"
+        "        return 0;\n"
+        "    for (; *l; ++l)\n"
+        "        bytes += strlen(*l) + 1;\n"
+        "    return bytes;\n"
+        "}\n\n");
+}
+
+/*!
+ * \brief The built-in string APIs take an allocator as their first argument,
+ * custom string APIs manage their own memory. Returns the argument to pass.
+ */
+static const char* allocator_arg(struct strview api)
+{
+    if (cstr_equal("c_str_dyn", api) || cstr_equal("c_strlist_dyn", api))
+        return "a, ";
+    return "";
+}
+
+static int key_uses_builtin_api(const struct key* key)
+{
+    cdt_switch(key->type)
+    {
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM: return *allocator_arg(key->attr.str_api_prefix);
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            return *allocator_arg(key->attr.strlist_api_prefix);
+        default: return 0;
+    }
+}
+
+static int root_has_key_type(
+    const struct root* root, enum c_data_type t1, enum c_data_type t2)
+{
+    const struct section* section;
+    const struct key*     key;
+
+    for (section = root->sections; section; section = section->next)
+        for (key = section->keys; key; key = key->next)
+            if (key->type == t1 || key->type == t2)
+                return 1;
+    return 0;
+}
+
+static int section_has_key_type(
+    const struct section* section, enum c_data_type t1, enum c_data_type t2)
+{
+    const struct key* key;
+    for (key = section->keys; key; key = key->next)
+        if ((key->type & ~CDT_BITFIELD) == t1 ||
+            (key->type & ~CDT_BITFIELD) == t2)
+            return 1;
+    return 0;
+}
+
+static int section_has_strings(const struct section* section)
+{
+    return section_has_key_type(section, CDT_STR_FIXED, CDT_STR_DYNAMIC) ||
+           section_has_key_type(section, CDT_STR_CUSTOM, CDT_STRLIST_FIXED) ||
+           section_has_key_type(
+               section, CDT_STRLIST_DYNAMIC, CDT_STRLIST_CUSTOM);
+}
+
+static int section_has_lists(const struct section* section)
+{
+    return section_has_key_type(
+               section, CDT_STRLIST_FIXED, CDT_STRLIST_DYNAMIC) ||
+           section_has_key_type(
+               section, CDT_STRLIST_CUSTOM, CDT_STRLIST_CUSTOM);
+}
+
+static void
+gen_source_struct_def(struct mstream* ms, const struct section* section)
+{
+    /* May need to copy the entire struct definition into the source file, if
+     * the struct was originally defined in a source file */
+    if (section->struct_def.len > 0)
+        mstream_fmt(ms, "%S;\n\n", section->struct_def);
+}
+
+/*!
+ * \brief Returns 1 if CONSTRAIN() narrowed the range of a scalar key below
+ * what its type can hold. Columns check these ranges after parsing.
+ */
+static int key_has_column_check(const struct key* key)
+{
+    struct attributes type_range;
+    if (!key_is_scalar(key) || (key->type & CDT_BITFIELD))
+        return 0;
+    attributes_set_default_for_type(&type_range, key->type);
+    if (key->type == CDT_FLOAT)
+        return key->attr.min.value.floating !=
+                   type_range.min.value.floating ||
+               key->attr.max.value.floating != type_range.max.value.floating;
+    return key->attr.min.value.integer != type_range.min.value.integer ||
+           key->attr.max.value.integer != type_range.max.value.integer;
+}
+
+static int root_has_keys(const struct root* root)
+{
+    const struct section* section;
+    for (section = root->sections; section; section = section->next)
+        if (section->keys)
+            return 1;
+    return 0;
+}
+
+static int root_has_column_checks(const struct root* root)
+{
+    const struct section* section;
+    const struct key*     key;
+    for (section = root->sections; section; section = section->next)
+        if (section->features & FEATURE_COLUMNS)
+            for (key = section->keys; key; key = key->next)
+                if (key_has_column_check(key))
+                    return 1;
+    return 0;
+}
+
+/*!
+ * \brief FNV-1a. The generated key_hash() must return the same values, so
+ * that the generator can sort keys into the buckets of the key lookup.
+ */
+static uint32_t key_hash(struct strview str)
+{
+    uint32_t hash = 2166136261u;
+    int      i;
+    for (i = 0; i != str.len; ++i)
+        hash = (hash ^ (unsigned char)str.source[str.off + i]) * 16777619u;
+    return hash;
+}
+
+static void gen_source_key_hash(struct mstream* ms, const char* linkage)
+{
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "uint32_t key_hash(const char* data, int len)\n"
+        "{\n"
+        "    uint32_t hash = 2166136261u;\n"
+        "    int      i;\n"
+        "    for (i = 0; i != len; ++i)\n"
+        "        hash = (hash ^ (unsigned char)data[i]) * 16777619u;\n"
+        "    return hash;\n"
+        "}\n\n");
+}
+
+/*! Returns 1 if a built-in string without a default value exists */
+static int root_has_empty_strings(const struct root* root)
+{
+    const struct section* section;
+    const struct key*     key;
+
+    for (section = root->sections; section; section = section->next)
+        for (key = section->keys; key; key = key->next)
+            if (((key->type & ~CDT_BITFIELD) == CDT_STR_DYNAMIC ||
+                 (key->type & ~CDT_BITFIELD) == CDT_STR_CUSTOM) &&
+                key_uses_builtin_api(key) &&
+                key->attr.default_value.value.str.len == 0)
+                return 1;
+    return 0;
+}
+
+static int root_has_strings(const struct root* root)
+{
+    return root_has_key_type(root, CDT_STR_FIXED, CDT_STR_DYNAMIC) ||
+           root_has_key_type(root, CDT_STR_CUSTOM, CDT_STRLIST_FIXED) ||
+           root_has_key_type(root, CDT_STRLIST_DYNAMIC, CDT_STRLIST_CUSTOM);
+}
+
+/*!
+ * \brief Writes the functions _hash() combines the fields with. The FNV-1a
+ * prime is built from two halves because C90 has no 64-bit constants.
+ */
+static void gen_source_struct_hash(
+    struct mstream* ms, const struct root* root, const char* linkage)
+{
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "uint64_t c_ini_hash_u64(uint64_t h, uint64_t v)\n"
+        "{\n"
+        "    h = (h ^ v) * ((uint64_t)0x100 << 32 | 0x1b3);\n"
+        "    return h ^ (h >> 29);\n"
+        "}\n\n");
+    if (!root_has_strings(root))
+        return;
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "uint64_t c_ini_hash_str(uint64_t h, const char* data, int len)\n"
+        "{\n"
+        "    int i;\n"
+        "    h = c_ini_hash_u64(h, (uint64_t)len);\n"
+        "    for (i = 0; i != len; ++i)\n"
+        "        h = (h ^ (unsigned char)data[i]) * ((uint64_t)0x100 << 32 | "
+        "0x1b3);\n"
+        "    return h;\n"
+        "}\n\n");
+}
+
+/*!
+ * \brief Strings and lists in structs WITH(shm) need the runtime functions
+ * that read and write them in shared memory images.
+ */
+static int root_has_shm_strings(const struct root* root)
+{
+    const struct section* section;
+    for (section = root->sections; section; section = section->next)
+        if ((section->features & FEATURE_SHM) && section_has_strings(section))
+            return 1;
+    return 0;
+}
+
+static int root_has_shm_lists(const struct root* root)
+{
+    const struct section* section;
+    for (section = root->sections; section; section = section->next)
+        if ((section->features & FEATURE_SHM) && section_has_lists(section))
+            return 1;
+    return 0;
+}
+
+/*!
+ * \brief Writes the functions that put strings into shared memory images and
+ * read them back. Readers may see offsets of an image that is being replaced,
+ * so everything they read is checked to stay inside of the segment. The last
+ * byte of a segment is never written, so every string ends in it.
+ */
+static void gen_source_shm_helpers(
+    struct mstream* ms, const struct root* root, const char* linkage)
+{
+    if (!root_has_shm_strings(root))
+        return;
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "void c_ini_shm_put(\n"
+        "    struct c_ini_shm* shm,\n"
+        "    uint32_t*         off,\n"
+        "    uint32_t*         dst,\n"
+        "    const char*       data,\n"
+        "    int               len)\n"
+        "{\n"
+        "    memcpy((char*)shm + *off, data, len);\n"
+        "    ((char*)shm)[*off + len] = '\\0';\n"
+        "    *dst = *off;\n"
+        "    *off += (uint32_t)len + 1;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "const char* c_ini_shm_str(const struct c_ini_shm* shm, uint32_t off)\n"
+        "{\n"
+        "    if (off < sizeof(*shm) || off >= shm->capacity)\n"
+        "        return \"\";\n"
+        "    return (const char*)shm + off;\n"
+        "}\n\n");
+    if (!root_has_shm_lists(root))
+        return;
+    /* Lists are a table of the count followed by the offsets of the strings */
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "uint32_t* c_ini_shm_table(\n"
+        "    struct c_ini_shm* shm, uint32_t* off, uint32_t* dst, int count)\n"
+        "{\n"
+        "    uint32_t* table;\n"
+        "    *dst = (*off + 3) & ~(uint32_t)3;\n"
+        "    table = (uint32_t*)((char*)shm + *dst);\n"
+        "    table[0] = (uint32_t)count;\n"
+        "    *off = *dst + 4 * ((uint32_t)count + 1);\n"
+        "    return table + 1;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int c_ini_shm_count(const struct c_ini_shm* shm, uint32_t off)\n"
+        "{\n"
+        "    uint32_t count;\n"
+        "    if (off < sizeof(*shm) || off > shm->capacity - 4 || off % 4)\n"
+        "        return 0;\n"
+        "    count = *(const uint32_t*)((const char*)shm + off);\n"
+        "    if (count > (shm->capacity - off) / 4 - 1)\n"
+        "        return 0;\n"
+        "    return (int)count;\n"
+        "}\n\n");
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "const char* c_ini_shm_item(\n"
+        "    const struct c_ini_shm* shm, uint32_t off, int index)\n"
+        "{\n"
+        "    if (index < 0 || index >= c_ini_shm_count(shm, off))\n"
+        "        return NULL;\n"
+        "    return c_ini_shm_str(\n"
+        "        shm, ((const uint32_t*)((const char*)shm + off))"
+        "[index + 1]);\n"
+        "}\n\n");
+}
+
+static void gen_source_skip_value(struct mstream* ms, const char* linkage)
+{
+    /* Values of fields nobody asked for are only scanned for where they end.
+     * This finds the same values and errors as scan_next(), but nothing is
+     * converted and no tokens are built. Whitespace and digits are compared
+     * directly, because they are most of what is skipped */
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "enum token skip_value(struct c_ini_parser* p)\n"
+        "{\n"
+        "    const char* s = p->source;\n"
+        "    int         n = 0;\n"
+        "    int         expect_value = 1;\n"
+        "    while (p->head != p->end)\n"
+        "    {\n"
+        "        char c = s[p->head];\n"
+        "        if (c == ' ' || c == '\\n' || c == '\\t' || c == '\\r')\n"
+        "        {\n"
+        "            p->head++;\n"
+        "            continue;\n"
+        "        }\n");
+    mstream_cstr(
+        ms,
+        "        if (c == '#' || c == ';')\n"
+        "        {\n"
+        "            const char* nl =\n"
+        "                memchr(s + p->head, '\\n', p->end - p->head);\n"
+        "            p->head = nl ? (int)(nl - s) + 1 : p->end;\n"
+        "            continue;\n"
+        "        }\n");
+    mstream_cstr(
+        ms,
+        "        if (!expect_value)\n"
+        "        {\n"
+        "            /* Anything but a comma ends the value */\n"
+        "            if (c == ',')\n"
+        "                expect_value = 1;\n"
+        "            else if (\n"
+        "                c == '[' || c == ']' || c == '=' || c == '\"' ||\n"
+        "                c == '-' || isalnum(c))\n"
+        "                break;\n"
+        "            p->head++;\n"
+        "            continue;\n"
+        "        }\n\n"
+        "        p->tail = p->head;\n");
+    mstream_cstr(
+        ms,
+        "        if ((c >= '0' && c <= '9') || c == '-')\n"
+        "        {\n"
+        "            for (p->head++; p->head != p->end; p->head++)\n"
+        "                if (s[p->head] < '0' || s[p->head] > '9')\n"
+        "                    break;\n");
+    mstream_cstr(
+        ms,
+        "            if (p->head != p->end && s[p->head] == '.')\n"
+        "            {\n"
+        "                for (p->head++; p->head != p->end; p->head++)\n"
+        "                    if (s[p->head] < '0' || s[p->head] > '9')\n"
+        "                        break;\n"
+        "                if (p->head != p->end && s[p->head] == 'f')\n"
+        "                    p->head++;\n"
+        "            }\n"
+        "        }\n");
+    mstream_cstr(
+        ms,
+        "        else if (c == '\"')\n"
+        "        {\n"
+        "            /* Same limits as scan_next() */\n"
+        "            int         tail = ++p->head;\n"
+        "            int         end = p->end - tail > p->max_string_length\n"
+        "                              ? tail + p->max_string_length + 1\n"
+        "                              : p->end;\n");
+    mstream_cstr(
+        ms,
+        "            const char* q = s + tail - 1;\n"
+        "            do\n"
+        "                q = memchr(q + 1, '\"', end - (int)(q + 1 - s));\n"
+        "            while (q && q[-1] == '\\\\');\n"
+        "            p->head = q ? (int)(q - s) : end;\n");
+    mstream_cstr(
+        ms,
+        "            if (p->head == p->end)\n"
+        "                return parser_error(p, \"Missing closing quote on "
+        "string\\n\");\n"
+        "            if (p->head == end)\n"
+        "                return parser_error(\n"
+        "                    p,\n"
+        "                    \"String is longer than the limit of %d "
+        "bytes\\n\",\n"
+        "                    p->max_string_length);\n"
+        "            p->head++;\n"
+        "        }\n");
+    mstream_cstr(
+        ms,
+        "        else if (\n"
+        "            c == 't' && p->end - p->head >= 4 &&\n"
+        "            memcmp(s + p->head, \"true\", 4) == 0)\n"
+        "            p->head += 4;\n"
+        "        else if (\n"
+        "            c == 'f' && p->end - p->head >= 5 &&\n"
+        "            memcmp(s + p->head, \"false\", 5) == 0)\n"
+        "            p->head += 5;\n");
+    mstream_cstr(
+        ms,
+        "        else if (\n"
+        "            c == '[' || c == ']' || c == '=' || c == ',' || "
+        "isalpha(c))\n"
+        "            break;\n"
+        "        else\n"
+        "        {\n"
+        "            /* Ignored, like scan_next() does */\n"
+        "            p->head++;\n"
+        "            continue;\n"
+        "        }\n\n");
+    mstream_cstr(
+        ms,
+        "        if (++n > p->max_list_elements)\n"
+        "            return parser_error(\n"
+        "                p, \"More than %d elements in list\\n\", "
+        "p->max_list_elements);\n"
+        "        expect_value = 0;\n"
+        "    }\n\n"
+        "    if (expect_value)\n"
+        "    {\n"
+        "        scan_next(p);\n"
+        "        return parser_error(p, \"Expected a value\\n\");\n"
+        "    }\n"
+        "    return scan_next(p);\n"
+        "}\n\n");
+}
+
+/*!
+ * \brief Columns are checked after the whole document was parsed, when the
+ * parser no longer knows where a value came from. This rescans the document
+ * for the value of "key" in the "index"-th matching section to point the
+ * error at it. Errors are rare, so the rescan costs nothing in practice.
+ */
+static void
+gen_source_parser_error_in_section(struct mstream* ms, const char* linkage)
+{
+    mstream_cstr(ms, linkage);
+    mstream_cstr(
+        ms,
+        "int parser_error_in_section(\n"
+        "    struct c_ini_parser* p,\n"
+        "    const char*          section,\n"
+        "    int                  index,\n"
+        "    const char*          key,\n"
+        "    const char*          fmt,\n"
+        "    ...)\n"
+        "{\n"
+        "    va_list              ap;\n"
+        "    struct c_ini_strspan loc;\n"
+        "    struct c_ini_out     o;\n"
+        "    enum token           tok;\n"
+        "    int                  in_section = 0;\n\n");
+    mstream_cstr(
+        ms,
+        "    loc.off = 0;\n"
+        "    loc.len = 0;\n"
+        "    p->head = 0;\n"
+        "    tok = scan_next(p);\n"
+        "    while (tok != TOK_END && tok != TOK_ERROR)\n"
+        "    {\n"
+        "        if (tok == '[')\n"
+        "        {\n"
+        "            tok = scan_next(p);\n"
+        "            in_section = tok == TOK_KEY &&\n"
+        "                         cstr_equal(section, p->value.string, "
+        "p->source) &&\n"
+        "                         index-- == 0;\n"
+        "            continue;\n"
+        "        }\n");
+    mstream_cstr(
+        ms,
+        "        /* The last value of a key is the one that was kept */\n"
+        "        if (in_section && tok == TOK_KEY &&\n"
+        "            cstr_equal(key, p->value.string, p->source) &&\n"
+        "            scan_next(p) == '=')\n"
+        "        {\n"
+        "            scan_next(p);\n"
+        "            loc.off = p->tail;\n"
+        "            loc.len = p->head - p->tail;\n"
+        "        }\n"
+        "        tok = scan_next(p);\n"
+        "    }\n\n");
+    mstream_cstr(
+        ms,
+        "    va_start(ap, fmt);\n"
+        "    o.f = p->diagnostics;\n"
+        "    o.colors = p->colors;\n"
+        "    o.len = 0;\n"
+        "    print_vflc(&o, p->filename, p->source, loc, fmt, ap);\n"
+        "    va_end(ap);\n"
+        "    print_excerpt(&o, p->source, loc);\n"
+        "    out_flush(&o);\n"
+        "    return -1;\n"
+        "}\n\n");
+}
+
+static void gen_source_helpers(
+    struct mstream* ms, const struct root* root, const char* linkage)
+{
+    if (root_has_keys(root))
+    {
+        gen_source_key_hash(ms, linkage);
+        gen_source_skip_value(ms, linkage);
+        gen_source_struct_hash(ms, root, linkage);
+        gen_source_shm_helpers(ms, root, linkage);
+    }
+    if (root_has_column_checks(root))
+        gen_source_parser_error_in_section(ms, linkage);
+    if (root_has_key_type(root, CDT_STR_DYNAMIC, CDT_STR_CUSTOM) ||
+        root_has_key_type(root, CDT_STRLIST_DYNAMIC, CDT_STRLIST_CUSTOM))
+        gen_source_c_ini_allocator(ms);
+    if (root_has_key_type(root, CDT_STR_DYNAMIC, CDT_STR_CUSTOM))
+        gen_source_c_str_dyn(ms, linkage, root_has_empty_strings(root));
+    if (root_has_key_type(root, CDT_STRLIST_DYNAMIC, CDT_STRLIST_CUSTOM))
+        gen_source_c_strlist_dyn(ms, linkage);
+}
+
+/*!
+ * \brief Writes the declarations of all runtime functions that are shared
+ * between shards. The symbols are renamed with a prefix so that several
+ * sharded parsers can be linked into the same program.
+ */
+static void gen_source_runtime_decls(
+    struct mstream* ms, const struct root* root, const char* prefix)
+{
+    static const char* shared[] = {
+        "cstr_equal",
+        "c_ini_cycles",
+        "parser_init",
+        "parser_finish",
+        "c_ini_tail_end",
+        "parser_error",
+        "parser_error_in_section",
+        "scan_next",
+        "key_hash",
+        "skip_value",
+        "c_ini_hash_u64",
+        "c_ini_hash_str",
+        "c_ini_shm_put",
+        "c_ini_shm_str",
+        "c_ini_shm_table",
+        "c_ini_shm_count",
+        "c_ini_shm_item",
+        "c_str_dyn_empty",
+        "c_str_dyn_deinit",
+        "c_str_dyn_set",
+        "c_str_dyn_reset",
+        "c_str_dyn_data",
+        "c_str_dyn_len",
+        "c_str_dyn_memory",
+        "c_strlist_dyn_empty",
+        "c_strlist_dyn_deinit",
+        "c_strlist_dyn_add",
+        "c_strlist_dyn_clear",
+        "c_strlist_dyn_reset",
+        "c_strlist_dyn_count",
+        "c_strlist_dyn_cstr",
+        "c_strlist_dyn_memory"};
+    int i;
+
+    for (i = 0; i != (int)(sizeof(shared) / sizeof(*shared)); ++i)
+        mstream_fmt(ms, "#define %s %s%s\n", shared[i], prefix, shared[i]);
+    mstream_cstr(ms, "\n");
+
+    mstream_cstr(
+        ms,
+        "int cstr_equal(const char* s1, struct c_ini_strspan s2, const char* "
+        "data);\n"
+        "#if defined(C_INI_INSTRUMENTATION)\n"
+        "uint64_t c_ini_cycles(void);\n"
+        "#endif\n");
+    mstream_cstr(
+        ms,
+        "void parser_init(\n"
+        "    struct c_ini_parser*        p,\n"
+        "    const char*                 filename,\n"
+        "    const char*                 data,\n"
+        "    int                         len,\n"
+        "    const struct c_ini_options* opts);\n"
+        "int parser_finish(struct c_ini_parser* p, int result);\n"
+        "int c_ini_tail_end(const char* data, int offset, int len);\n"
+        "int parser_error(struct c_ini_parser* p, const char* fmt, ...);\n"
+        "enum token scan_next(struct c_ini_parser* p);\n\n");
+    if (root_has_keys(root))
+        mstream_cstr(
+            ms,
+            "uint32_t key_hash(const char* data, int len);\n"
+            "enum token skip_value(struct c_ini_parser* p);\n"
+            "uint64_t c_ini_hash_u64(uint64_t h, uint64_t v);\n");
+    if (root_has_strings(root))
+        mstream_cstr(
+            ms,
+            "uint64_t c_ini_hash_str(uint64_t h, const char* data, "
+            "int len);\n");
+    if (root_has_shm_strings(root))
+        mstream_cstr(
+            ms,
+            "void c_ini_shm_put(struct c_ini_shm* shm, uint32_t* off, "
+            "uint32_t* dst, const char* data, int len);\n"
+            "const char* c_ini_shm_str(const struct c_ini_shm* shm, "
+            "uint32_t off);\n");
+    if (root_has_shm_lists(root))
+        mstream_cstr(
+            ms,
+            "uint32_t* c_ini_shm_table(struct c_ini_shm* shm, uint32_t* off, "
+            "uint32_t* dst, int count);\n"
+            "int c_ini_shm_count(const struct c_ini_shm* shm, uint32_t off);\n"
+            "const char* c_ini_shm_item(const struct c_ini_shm* shm, "
+            "uint32_t off, int index);\n");
+    if (root_has_column_checks(root))
+        mstream_cstr(
+            ms,
+            "int parser_error_in_section(\n"
+            "    struct c_ini_parser* p,\n"
+            "    const char*          section,\n"
+            "    int                  index,\n"
+            "    const char*          key,\n"
+            "    const char*          fmt,\n"
+            "    ...);\n");
+    if (root_has_keys(root) || root_has_column_checks(root))
+        mstream_cstr(ms, "\n");
+    if (root_has_key_type(root, CDT_STR_DYNAMIC, CDT_STR_CUSTOM))
+        mstream_cstr(
+            ms,
+            "extern const struct c_ini_dyn_str c_str_dyn_empty;\n"
+            "void c_str_dyn_deinit(char* s);\n"
+            "int c_str_dyn_set(\n"
+            "    const struct c_ini_allocator* a, char** s, const char* data, "
+            "int len);\n"
+            "void c_str_dyn_reset(char** s, char* def);\n"
+            "const char* c_str_dyn_data(const char* s);\n"
+            "int c_str_dyn_len(const char* s);\n"
+            "size_t c_str_dyn_memory(const char* s);\n\n");
+    if (root_has_key_type(root, CDT_STRLIST_DYNAMIC, CDT_STRLIST_CUSTOM))
+        mstream_cstr(
+            ms,
+            "extern const struct c_ini_dyn_list c_strlist_dyn_empty;\n"
+            "void c_strlist_dyn_deinit(char** l);\n"
+            "int c_strlist_dyn_add(\n"
+            "    const struct c_ini_allocator* a, char*** l, const char* data, "
+            "int len);\n"
+            "void c_strlist_dyn_clear(char** l);\n"
+            "void c_strlist_dyn_reset(char*** l, char** def);\n"
+            "int c_strlist_dyn_count(char* const* l);\n"
+            "const char* c_strlist_dyn_cstr(char* const* l, int i);\n"
+            "size_t c_strlist_dyn_memory(char* const* l);\n\n");
+}
+
+static void
+gen_source_set_allocator(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
+        ms,
+        "static const struct c_ini_allocator* %S_allocator = NULL;\n\n",
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "void %S_set_allocator(const struct c_ini_allocator* allocator)\n{\n"
+        "    %S_allocator = allocator;\n"
+        "}\n\n",
+        section->struct_name,
+        section->struct_name);
+}
+
+/*!
+ * \brief Built-in strings and lists with a default value point to a static
+ * copy of it, which has the same layout as a heap allocated string or list,
+ * but no allocator.
+ */
+static void
+gen_source_default_strings(struct mstream* ms, const struct section* section)
+{
+    const struct key*     key;
+    const struct strlist* strlist;
+    int                   count;
+    for (key = section->keys; key; key = key->next)
+    {
+        if ((key->type & ~CDT_BITFIELD) == CDT_STRLIST_DYNAMIC &&
+            key_uses_builtin_api(key) && key->attr.default_value.value.strlist)
+        {
+            count = 0;
+            strlist = key->attr.default_value.value.strlist;
+            for (; strlist; strlist = strlist->next)
+                count++;
+            mstream_fmt(
+                ms,
+                "static const struct\n"
+                "{\n"
+                "    struct c_ini_dyn_header header;\n"
+                "    char*                   data[%d];\n"
+                "} %S_default_%S = {\n"
+                "    {NULL, 0, %d}, {",
+                count + 1,
+                section->struct_name,
+                key->name,
+                count);
+            strlist = key->attr.default_value.value.strlist;
+            for (; strlist; strlist = strlist->next)
+                mstream_fmt(ms, "(char*)\"%S\", ", strlist->str);
+            mstream_cstr(ms, "NULL}};\n\n");
+        }
+        if ((key->type & ~CDT_BITFIELD) != CDT_STR_DYNAMIC ||
+            !key_uses_builtin_api(key) ||
+            key->attr.default_value.value.str.len == 0)
+            continue;
+        mstream_fmt(
+            ms,
+            "static const struct\n"
+            "{\n"
+            "    struct c_ini_dyn_header header;\n"
+            "    char                    data[sizeof(\"%S\")];\n"
+            "} %S_default_%S = {{NULL, 0, 0}, \"%S\"};\n\n",
+            key->attr.default_value.value.str,
+            section->struct_name,
+            key->name,
+            key->attr.default_value.value.str);
+    }
+}
+
+static void gen_source_default_str_ref(
+    struct mstream* ms, const struct section* section, const struct key* key)
+{
+    if (key->attr.default_value.value.str.len > 0)
+        mstream_fmt(
+            ms, "(char*)%S_default_%S.data", section->struct_name, key->name);
+    else
+        mstream_cstr(ms, "(char*)c_str_dyn_empty.data");
+}
+
+static void gen_source_default_strlist_ref(
+    struct mstream* ms, const struct section* section, const struct key* key)
+{
+    if (key->attr.default_value.value.strlist)
+        mstream_fmt(
+            ms, "(char**)%S_default_%S.data", section->struct_name, key->name);
+    else
+        mstream_cstr(ms, "(char**)c_strlist_dyn_empty.data");
+}
+
+/*!
+ * \brief Writes the default value of a key that can be set without calling
+ * any functions, either as a designated initializer of the default image, or
+ * as an assignment. Returns 0 if the key has no such default.
+ */
+static int gen_source_default_value(
+    struct mstream*       ms,
+    const struct section* section,
+    const struct key*     key,
+    int                   designated)
+{
+    const struct strlist* strlist;
+    const char*           lhs = designated ? "    ." : "    s->";
+    const char*           end = designated ? ",\n" : ";\n";
+
+    cdt_switch(key->type)
+    {
+        case CDT_UNKNOWN: return 0;
+        case CDT_STR_FIXED:
+            if (key->attr.default_value.value.str.len == 0)
+                return 0;
+            if (designated)
+                mstream_fmt(
+                    ms,
+                    "    .%S = \"%S\",\n",
+                    key->name,
+                    key->attr.default_value.value.str);
+            else
+                mstream_fmt(
+                    ms,
+                    "    strcpy(s->%S, \"%S\");\n",
+                    key->name,
+                    key->attr.default_value.value.str);
+            return 1;
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            if (!key_uses_builtin_api(key))
+                return 0;
+            mstream_fmt(ms, "%s%S = ", lhs, key->name);
+            gen_source_default_str_ref(ms, section, key);
+            mstream_cstr(ms, end);
+            return 1;
+        case CDT_STRLIST_FIXED:
+            strlist = key->attr.default_value.value.strlist;
+            if (strlist == NULL)
+                return 0;
+            if (designated)
+            {
+                mstream_fmt(ms, "    .%S = {", key->name);
+                for (; strlist; strlist = strlist->next)
+                    mstream_fmt(
+                        ms, "\"%S\"%s", strlist->str, strlist->next ? ", " : "");
+                mstream_cstr(ms, "},\n");
+            }
+            else
+            {
+                int i;
+                for (i = 0; strlist; strlist = strlist->next, i++)
+                    mstream_fmt(
+                        ms,
+                        "    strcpy(s->%S[%d], \"%S\");\n",
+                        key->name,
+                        i,
+                        strlist->str);
+            }
+            return 1;
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            if (!key_uses_builtin_api(key))
+                return 0;
+            mstream_fmt(ms, "%s%S = ", lhs, key->name);
+            gen_source_default_strlist_ref(ms, section, key);
+            mstream_cstr(ms, end);
+            return 1;
+        case CDT_BOOL:
+        case CDT_I8:
+        case CDT_U8:
+        case CDT_I16:
+        case CDT_U16:
+        case CDT_I32:
+        case CDT_U32:
+            if (key->attr.default_value.value.integer == 0)
+                return 0;
+            mstream_fmt(
+                ms,
+                "%s%S = %d%s",
+                lhs,
+                key->name,
+                (int)key->attr.default_value.value.integer,
+                end);
+            return 1;
+        case CDT_FLOAT:
+            if (key->attr.default_value.value.floating == 0.0)
+                return 0;
+            mstream_fmt(
+                ms,
+                "%s%S = %f%s",
+                lhs,
+                key->name,
+                key->attr.default_value.value.floating,
+                end);
+            return 1;
+        case CDT_BITFIELD: break;
+    }
+    return 0;
+}
+
+static int section_has_default_image(const struct section* section)
+{
+    const struct key* key;
+    struct mstream    discard = mstream_init_writeable();
+    int               result = 0;
+    for (key = section->keys; key && !result; key = key->next)
+        result = gen_source_default_value(&discard, section, key, 1);
+    free(discard.address);
+    return result;
+}
+
+/*!
+ * \brief Returns 1 if every member of the struct has a key that a default
+ * value can be written for, in which case the default image can be a plain
+ * initializer list. Custom strings and lists have types the generator doesn't
+ * know.
+ */
+static int section_has_known_members(const struct section* section)
+{
+    const struct key* key;
+    if (section->has_unknown_members)
+        return 0;
+    for (key = section->keys; key; key = key->next)
+    {
+        cdt_switch(key->type)
+        {
+            case CDT_UNKNOWN: return 0;
+            case CDT_STR_DYNAMIC:
+            case CDT_STR_CUSTOM:
+            case CDT_STRLIST_DYNAMIC:
+            case CDT_STRLIST_CUSTOM:
+                if (!key_uses_builtin_api(key))
+                    return 0;
+                break;
+            default: break;
+        }
+    }
+    return 1;
+}
+
+/*! Writes the default value of a key as an element of an initializer list */
+static void gen_source_positional_value(
+    struct mstream* ms, const struct section* section, const struct key* key)
+{
+    const struct strlist* strlist;
+
+    mstream_cstr(ms, "    ");
+    cdt_switch(key->type)
+    {
+        case CDT_STR_FIXED:
+            mstream_fmt(ms, "\"%S\"", key->attr.default_value.value.str);
+            break;
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            gen_source_default_str_ref(ms, section, key);
+            break;
+        case CDT_STRLIST_FIXED:
+            strlist = key->attr.default_value.value.strlist;
+            if (strlist == NULL)
+                mstream_cstr(ms, "{\"\"}");
+            else
+            {
+                mstream_cstr(ms, "{");
+                for (; strlist; strlist = strlist->next)
+                    mstream_fmt(
+                        ms,
+                        "\"%S\"%s",
+                        strlist->str,
+                        strlist->next ? ", " : "");
+                mstream_cstr(ms, "}");
+            }
+            break;
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            gen_source_default_strlist_ref(ms, section, key);
+            break;
+        case CDT_BOOL:
+        case CDT_I8:
+        case CDT_U8:
+        case CDT_I16:
+        case CDT_U16:
+        case CDT_I32:
+        case CDT_U32:
+            mstream_fmt(
+                ms, "%d", (int)key->attr.default_value.value.integer);
+            break;
+        case CDT_FLOAT:
+            mstream_fmt(ms, "%f", key->attr.default_value.value.floating);
+            break;
+        case CDT_UNKNOWN:
+        case CDT_BITFIELD: break;
+    }
+    mstream_cstr(ms, ",\n");
+}
+
+/*!
+ * \brief Writes a "static const" image of the struct with all default values
+ * that don't need a function call, so that _init() is a single memcpy. If the
+ * generator knows every member, a plain initializer list works in C90.
+ * Otherwise designated initializers are needed, so C90 falls back to
+ * assignments.
+ */
+static void
+gen_source_default_image(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+
+    gen_source_default_strings(ms, section);
+    if (!section_has_default_image(section))
+        return;
+
+    if (section_has_known_members(section))
+    {
+        mstream_fmt(
+            ms,
+            "static const struct %S %S_defaults = {\n",
+            section->struct_name,
+            section->struct_name);
+        for (key = section->keys; key; key = key->next)
+            gen_source_positional_value(ms, section, key);
+        mstream_cstr(ms, "};\n\n");
+        return;
+    }
+
+    mstream_fmt(
+        ms,
+        "#if defined(C_INI_C99)\n"
+        "static const struct %S %S_defaults = {\n",
+        section->struct_name,
+        section->struct_name);
+    for (key = section->keys; key; key = key->next)
+        gen_source_default_value(ms, section, key, 1);
+    mstream_cstr(ms, "};\n#endif\n\n");
+}
+
+static void gen_source_init(struct mstream* ms, const struct section* section)
+{
+    const struct key*     key;
+    const struct strlist* strlist;
+    struct strview        api;
+
+    gen_source_default_image(ms, section);
+
+    mstream_fmt(
+        ms,
+        "int %S_init(struct %S* s)\n{\n",
+        section->struct_name,
+        section->struct_name);
+    if (section_has_default_image(section) &&
+        section_has_known_members(section))
+        mstream_fmt(
+            ms,
+            "    memcpy(s, &%S_defaults, sizeof *s);\n",
+            section->struct_name);
+    else if (section_has_default_image(section))
+    {
+        mstream_fmt(
+            ms,
+            "#if defined(C_INI_C99)\n"
+            "    memcpy(s, &%S_defaults, sizeof *s);\n"
+            "#else\n"
+            "    memset(s, 0x00, sizeof *s);\n",
+            section->struct_name);
+        for (key = section->keys; key; key = key->next)
+            gen_source_default_value(ms, section, key, 0);
+        mstream_cstr(ms, "#endif\n");
+    }
+    else
+        mstream_cstr(ms, "    memset(s, 0x00, sizeof *s);\n");
+
+    /* Whatever needs a function call comes after the image */
+    for (key = section->keys; key; key = key->next)
+    {
+        cdt_switch(key->type)
+        {
+            case CDT_STR_DYNAMIC:
+            case CDT_STR_CUSTOM:
+                api = key->attr.str_api_prefix;
+                if (key_uses_builtin_api(key))
+                    break;
+                mstream_fmt(
+                    ms,
+                    "    if (%S_init(&s->%S) != 0)\n"
+                    "        goto %S_failed;\n",
+                    api,
+                    key->name,
+                    key->name);
+                if (key->attr.default_value.value.str.len > 0)
+                    mstream_fmt(
+                        ms,
+                        "    if (%S_set(&s->%S, \"%S\", %d) != 0)\n"
+                        "        goto %S_set_failed;\n",
+                        api,
+                        key->name,
+                        key->attr.default_value.value.str,
+                        key->attr.default_value.value.str.len,
+                        key->name);
+                break;
+            case CDT_STRLIST_DYNAMIC:
+            case CDT_STRLIST_CUSTOM:
+                api = key->attr.strlist_api_prefix;
+                if (key_uses_builtin_api(key))
+                    break;
+                mstream_fmt(
+                    ms,
+                    "    if (%S_init(&s->%S) != 0)\n"
+                    "        goto %S_failed;\n",
+                    api,
+                    key->name,
+                    key->name);
+                strlist = key->attr.default_value.value.strlist;
+                for (; strlist; strlist = strlist->next)
+                    mstream_fmt(
+                        ms,
+                        "    if (%S_add(&s->%S, \"%S\", (int)sizeof(\"%S\") "
+                        "- 1) != 0)\n"
+                        "        goto %S_add_failed;\n",
+                        api,
+                        key->name,
+                        strlist->str,
+                        strlist->str,
+                        key->name);
+                break;
+            default: break;
+        }
+    }
+    mstream_cstr(ms, "    return 0;\n\n    ");
+
+    ll_reverse((struct ll**)&section->keys);
+    for (key = section->keys; key; key = key->next)
+    {
+        cdt_switch(key->type)
+        {
+            case CDT_STR_DYNAMIC:
+            case CDT_STR_CUSTOM:
+                if (key_uses_builtin_api(key))
+                    break;
+                if (key->attr.default_value.value.str.len > 0)
+                    mstream_fmt(ms, "%S_set_failed: ", key->name);
+                mstream_fmt(
+                    ms,
+                    "%S_deinit(s->%S);\n    ",
+                    key->attr.str_api_prefix,
+                    key->name);
+                mstream_fmt(ms, "%S_failed: ", key->name);
+                break;
+            case CDT_STRLIST_DYNAMIC:
+            case CDT_STRLIST_CUSTOM:
+                if (key_uses_builtin_api(key))
+                    break;
+                if (key->attr.default_value.value.strlist != NULL)
+                    mstream_fmt(ms, "%S_add_failed: ", key->name);
+                mstream_fmt(
+                    ms,
+                    "%S_deinit(s->%S);\n    ",
+                    key->attr.strlist_api_prefix,
+                    key->name);
+                mstream_fmt(ms, "%S_failed: ", key->name);
+                break;
+            default: break;
+        }
+    }
+    ll_reverse((struct ll**)&section->keys);
+
+    mstream_cstr(ms, "return -1;\n}\n\n");
+}
+
+static void
+gen_source_reset(struct mstream* ms, const struct section* section)
+{
+    const struct key*     key;
+    const struct strlist* strlist;
+    struct strview        api;
+    int                   i;
+
+    mstream_fmt(
+        ms,
+        "int %S_reset(struct %S* s)\n{\n",
+        section->struct_name,
+        section->struct_name);
+    if (section->keys == NULL)
+        mstream_cstr(ms, "    (void)s;\n");
+    for (key = section->keys; key; key = key->next)
+    {
+        cdt_switch(key->type)
+        {
+            case CDT_UNKNOWN: break;
+            case CDT_STR_FIXED:
+                mstream_fmt(
+                    ms,
+                    "    strncpy(s->%S, \"%S\", sizeof(s->%S));\n",
+                    key->name,
+                    key->attr.default_value.value.str,
+                    key->name);
+                break;
+            case CDT_STR_DYNAMIC:
+            case CDT_STR_CUSTOM:
+                api = key->attr.str_api_prefix;
+                if (key_uses_builtin_api(key))
+                {
+                    mstream_fmt(ms, "    c_str_dyn_reset(&s->%S, ", key->name);
+                    gen_source_default_str_ref(ms, section, key);
+                    mstream_cstr(ms, ");\n");
+                }
+                else
+                    mstream_fmt(
+                        ms,
+                        "    if (%S_set(&s->%S, \"%S\", %d) != 0)\n"
+                        "        return -1;\n",
+                        api,
+                        key->name,
+                        key->attr.default_value.value.str,
+                        key->attr.default_value.value.str.len);
+                break;
+            case CDT_STRLIST_FIXED:
+                mstream_fmt(
+                    ms,
+                    "    memset(s->%S, 0, sizeof(s->%S));\n",
+                    key->name,
+                    key->name);
+                strlist = key->attr.default_value.value.strlist;
+                for (i = 0; strlist; strlist = strlist->next, i++)
+                    mstream_fmt(
+                        ms,
+                        "    strcpy(s->%S[%d], \"%S\");\n",
+                        key->name,
+                        i,
+                        strlist->str);
+                break;
+            case CDT_STRLIST_DYNAMIC:
+            case CDT_STRLIST_CUSTOM:
+                api = key->attr.strlist_api_prefix;
+                if (key_uses_builtin_api(key))
+                {
+                    mstream_fmt(
+                        ms,
+                        "    c_strlist_dyn_reset(\n        &s->%S, ",
+                        key->name);
+                    gen_source_default_strlist_ref(ms, section, key);
+                    mstream_cstr(ms, ");\n");
+                    break;
+                }
+                mstream_fmt(ms, "    %S_clear(s->%S);\n", api, key->name);
+                strlist = key->attr.default_value.value.strlist;
+                for (; strlist; strlist = strlist->next)
+                    mstream_fmt(
+                        ms,
+                        "    if (%S_add(&s->%S, \"%S\", (int)sizeof(\"%S\") "
+                        "- 1) != 0)\n"
+                        "        return -1;\n",
+                        api,
+                        key->name,
+                        strlist->str,
+                        strlist->str);
+                break;
+            case CDT_BOOL:
+            case CDT_I8:
+            case CDT_U8:
+            case CDT_I16:
+            case CDT_U16:
+            case CDT_I32:
+            case CDT_U32:
+                mstream_fmt(
+                    ms,
+                    "    s->%S = %d;\n",
+                    key->name,
+                    (int)key->attr.default_value.value.integer);
+                break;
+            case CDT_FLOAT:
+                mstream_fmt(
+                    ms,
+                    "    s->%S = %f;\n",
+                    key->name,
+                    key->attr.default_value.value.floating);
+                break;
+            case CDT_BITFIELD: break;
+        }
+    }
+    mstream_cstr(ms, "    return 0;\n}\n\n");
+}
+
+static void gen_source_deinit(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    int               body;
+    mstream_fmt(
+        ms,
+        "void %S_deinit(struct %S* s)\n{\n",
+        section->struct_name,
+        section->struct_name);
+    body = ms->write_ptr;
+    for (key = section->keys; key; key = key->next)
+    {
+        cdt_switch(key->type)
+        {
+            case CDT_UNKNOWN: break;
+            case CDT_STR_FIXED: break;
+            case CDT_STR_DYNAMIC:
+            case CDT_STR_CUSTOM:
+                mstream_fmt(
+                    ms,
+                    "    %S_deinit(s->%S);\n",
+                    key->attr.str_api_prefix,
+                    key->name);
+                break;
+            case CDT_STRLIST_FIXED: break;
+            case CDT_STRLIST_DYNAMIC:
+            case CDT_STRLIST_CUSTOM:
+                mstream_fmt(
+                    ms,
+                    "    %S_deinit(s->%S);\n",
+                    key->attr.strlist_api_prefix,
+                    key->name);
+                break;
+            case CDT_BOOL:
+            case CDT_I8:
+            case CDT_U8:
+            case CDT_I16:
+            case CDT_U16:
+            case CDT_I32:
+            case CDT_U32: break;
+            case CDT_FLOAT: break;
+            case CDT_BITFIELD: break;
+        }
+    }
+    if (ms->write_ptr == body)
+        mstream_cstr(ms, "    (void)s;\n");
+    mstream_cstr(ms, "}\n\n");
+}
+
+/*!
+ * \brief Writes a statement that empties a list. Built-in lists may still
+ * point at their static default, which can't be cleared in place.
+ */
+static void gen_source_strlist_clear(
+    struct mstream* ms, const struct key* key, const char* s)
+{
+    if (key_uses_builtin_api(key))
+        mstream_fmt(
+            ms,
+            "    c_strlist_dyn_reset(\n"
+            "        &%s->%S, (char**)c_strlist_dyn_empty.data);\n",
+            s,
+            key->name);
+    else
+        mstream_fmt(
+            ms,
+            "    %S_clear(%s->%S);\n",
+            key->attr.strlist_api_prefix,
+            s,
+            key->name);
+}
+
+/*!
+ * \brief Strings and lists are copied through their API, so a destination that
+ * was used before keeps its buffers and only grows them when needed.
+ */
+static void gen_source_copy(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    struct strview    api;
+
+    mstream_fmt(
+        ms,
+        "int %S_copy(struct %S* dst, const struct %S* src)\n{\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    for (key = section->keys; key; key = key->next)
+        if (key_uses_builtin_api(key))
+        {
+            mstream_fmt(
+                ms,
+                "    const struct c_ini_allocator* a = %S_allocator;\n",
+                section->struct_name);
+            break;
+        }
+    if (section_has_key_type(
+            section, CDT_STRLIST_DYNAMIC, CDT_STRLIST_CUSTOM))
+        mstream_cstr(ms, "    const char* str;\n    int i;\n");
+    mstream_cstr(ms, "    if (dst == src)\n        return 0;\n");
+    for (key = section->keys; key; key = key->next)
+    {
+        cdt_switch(key->type)
+        {
+            case CDT_UNKNOWN: break;
+            case CDT_STR_FIXED:
+            case CDT_STRLIST_FIXED:
+                mstream_fmt(
+                    ms,
+                    "    memcpy(dst->%S, src->%S, sizeof(dst->%S));\n",
+                    key->name,
+                    key->name,
+                    key->name);
+                break;
+            case CDT_STR_DYNAMIC:
+            case CDT_STR_CUSTOM:
+                api = key->attr.str_api_prefix;
+                mstream_fmt(
+                    ms,
+                    "    if (%S_set(%s&dst->%S, %S_data(src->%S), "
+                    "%S_len(src->%S)) != 0)\n"
+                    "        return -1;\n",
+                    api,
+                    allocator_arg(api),
+                    key->name,
+                    api,
+                    key->name,
+                    api,
+                    key->name);
+                break;
+            case CDT_STRLIST_DYNAMIC:
+            case CDT_STRLIST_CUSTOM:
+                api = key->attr.strlist_api_prefix;
+                gen_source_strlist_clear(ms, key, "dst");
+                mstream_fmt(
+                    ms,
+                    "    for (i = 0; i != %S_count(src->%S); ++i)\n"
+                    "    {\n"
+                    "        str = %S_cstr(src->%S, i);\n"
+                    "        if (%S_add(%s&dst->%S, str, (int)strlen(str)) "
+                    "!= 0)\n"
+                    "            return -1;\n"
+                    "    }\n",
+                    api,
+                    key->name,
+                    api,
+                    key->name,
+                    api,
+                    allocator_arg(api),
+                    key->name);
+                break;
+            case CDT_BOOL:
+            case CDT_I8:
+            case CDT_U8:
+            case CDT_I16:
+            case CDT_U16:
+            case CDT_I32:
+            case CDT_U32:
+            case CDT_FLOAT:
+                mstream_fmt(
+                    ms, "    dst->%S = src->%S;\n", key->name, key->name);
+                break;
+            case CDT_BITFIELD: break;
+        }
+    }
+    mstream_cstr(ms, "    return 0;\n}\n\n");
+}
+
+/*!
+ * \brief Hands the strings and lists of src over to dst without copying them.
+ * src is left initialized. The empty struct that replaces it is initialized
+ * first, so if that fails, for example in a custom string API, neither
+ * struct has changed and nothing is owned twice.
+ */
+static void gen_source_move(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+
+    mstream_fmt(
+        ms,
+        "int %S_move(struct %S* dst, struct %S* src)\n{\n"
+        "    struct %S empty;\n"
+        "    if (dst == src)\n"
+        "        return 0;\n"
+        "    if (%S_init(&empty) != 0)\n"
+        "        return -1;\n"
+        "    %S_deinit(dst);\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    for (key = section->keys; key; key = key->next)
+    {
+        cdt_switch(key->type)
+        {
+            case CDT_UNKNOWN: break;
+            case CDT_STR_FIXED:
+            case CDT_STRLIST_FIXED:
+                mstream_fmt(
+                    ms,
+                    "    memcpy(dst->%S, src->%S, sizeof(dst->%S));\n",
+                    key->name,
+                    key->name,
+                    key->name);
+                break;
+            case CDT_STR_DYNAMIC:
+            case CDT_STR_CUSTOM:
+            case CDT_STRLIST_DYNAMIC:
+            case CDT_STRLIST_CUSTOM:
+            case CDT_BOOL:
+            case CDT_I8:
+            case CDT_U8:
+            case CDT_I16:
+            case CDT_U16:
+            case CDT_I32:
+            case CDT_U32:
+            case CDT_FLOAT:
+                mstream_fmt(
+                    ms, "    dst->%S = src->%S;\n", key->name, key->name);
+                break;
+            case CDT_BITFIELD: break;
+        }
+    }
+    mstream_cstr(
+        ms,
+        "    memcpy(src, &empty, sizeof *src);\n"
+        "    return 0;\n"
+        "}\n\n");
+}
+
+/*!
+ * \brief Writes statements that set "changed" to whether a field differs
+ * between the structs "a" and "b". _equal() and _diff() share them.
+ */
+static void gen_source_field_changed(
+    struct mstream* ms, const struct key* key, const char* a, const char* b)
+{
+    struct strview api;
+
+    cdt_switch(key->type)
+    {
+        case CDT_UNKNOWN: break;
+        case CDT_STR_FIXED:
+            mstream_fmt(
+                ms,
+                "    changed = strcmp(%s->%S, %s->%S) != 0;\n",
+                a,
+                key->name,
+                b,
+                key->name);
+            break;
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            api = key->attr.str_api_prefix;
+            mstream_fmt(
+                ms,
+                "    changed = %S_len(%s->%S) != %S_len(%s->%S) ||\n"
+                "              memcmp(%S_data(%s->%S), %S_data(%s->%S), "
+                "%S_len(%s->%S)) != 0;\n",
+                api,
+                a,
+                key->name,
+                api,
+                b,
+                key->name,
+                api,
+                a,
+                key->name,
+                api,
+                b,
+                key->name,
+                api,
+                a,
+                key->name);
+            break;
+        case CDT_STRLIST_FIXED:
+            mstream_fmt(
+                ms,
+                "    changed = 0;\n"
+                "    for (i = 0; !changed && i != (int)(sizeof(%s->%S) / "
+                "sizeof(*%s->%S)); ++i)\n"
+                "        changed = strcmp(%s->%S[i], %s->%S[i]) != 0;\n",
+                a,
+                key->name,
+                a,
+                key->name,
+                a,
+                key->name,
+                b,
+                key->name);
+            break;
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            api = key->attr.strlist_api_prefix;
+            mstream_fmt(
+                ms,
+                "    changed = %S_count(%s->%S) != %S_count(%s->%S);\n"
+                "    for (i = 0; !changed && i != %S_count(%s->%S); ++i)\n"
+                "        changed = strcmp(%S_cstr(%s->%S, i), "
+                "%S_cstr(%s->%S, i)) != 0;\n",
+                api,
+                a,
+                key->name,
+                api,
+                b,
+                key->name,
+                api,
+                a,
+                key->name,
+                api,
+                a,
+                key->name,
+                api,
+                b,
+                key->name);
+            break;
+        case CDT_BOOL:
+        case CDT_I8:
+        case CDT_U8:
+        case CDT_I16:
+        case CDT_U16:
+        case CDT_I32:
+        case CDT_U32:
+        case CDT_FLOAT:
+            mstream_fmt(
+                ms,
+                "    changed = %s->%S != %s->%S;\n",
+                a,
+                key->name,
+                b,
+                key->name);
+            break;
+        case CDT_BITFIELD: break;
+    }
+}
+
+static void gen_source_equal(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+
+    mstream_fmt(
+        ms,
+        "int %S_equal(const struct %S* a, const struct %S* b)\n{\n"
+        "    int changed;\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    if (section_has_lists(section))
+        mstream_cstr(ms, "    int i;\n");
+    for (key = section->keys; key; key = key->next)
+    {
+        gen_source_field_changed(ms, key, "a", "b");
+        mstream_cstr(ms, "    if (changed)\n        return 0;\n");
+    }
+    mstream_cstr(ms, "    return 1;\n}\n\n");
+}
+
+/*!
+ * \brief Bitfields have no address, so their values are passed to the callback
+ * as pointers to an int.
+ */
+static void gen_source_diff(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+
+    mstream_fmt(
+        ms,
+        "int %S_diff(const struct %S* a, const struct %S* b, "
+        "int (*on_change)(enum %S_field field, const void* old_value, "
+        "const void* new_value, void* user_ptr), void* user_ptr)\n{\n"
+        "    int changed;\n"
+        "    int count = 0;\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    if (section_has_lists(section))
+        mstream_cstr(ms, "    int i;\n");
+    for (key = section->keys; key; key = key->next)
+        if (key->type & CDT_BITFIELD)
+        {
+            mstream_cstr(ms, "    int old_bits, new_bits;\n");
+            break;
+        }
+    for (key = section->keys; key; key = key->next)
+    {
+        gen_source_field_changed(ms, key, "a", "b");
+        mstream_cstr(ms, "    if (changed)\n    {\n        ++count;\n");
+        if (key->type & CDT_BITFIELD)
+            mstream_fmt(
+                ms,
+                "        old_bits = a->%S;\n"
+                "        new_bits = b->%S;\n"
+                "        if (on_change &&\n"
+                "            on_change(%U_FIELD_%U, &old_bits, &new_bits, "
+                "user_ptr) != 0)\n"
+                "            return -1;\n",
+                key->name,
+                key->name,
+                section->struct_name,
+                key->name);
+        else
+            mstream_fmt(
+                ms,
+                "        if (on_change &&\n"
+                "            on_change(%U_FIELD_%U, &a->%S, &b->%S, "
+                "user_ptr) != 0)\n"
+                "            return -1;\n",
+                section->struct_name,
+                key->name,
+                key->name,
+                key->name);
+        mstream_cstr(ms, "    }\n");
+    }
+    mstream_cstr(ms, "    return count;\n}\n\n");
+}
+
+/*!
+ * \brief Combines every known field into one 64-bit value. Structs that are
+ * _equal() hash the same, floats are normalized so -0.0 and 0.0 do too.
+ */
+static void gen_source_hash(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    struct strview    api;
+
+    mstream_fmt(
+        ms,
+        "uint64_t %S_hash(const struct %S* s)\n{\n"
+        "    uint64_t h = (uint64_t)0xcbf29ce4 << 32 | 0x84222325;\n",
+        section->struct_name,
+        section->struct_name);
+    if (section_has_key_type(section, CDT_FLOAT, CDT_FLOAT))
+        mstream_cstr(ms, "    double d;\n    uint64_t bits;\n");
+    if (section_has_key_type(
+            section, CDT_STRLIST_DYNAMIC, CDT_STRLIST_CUSTOM))
+        mstream_cstr(ms, "    const char* str;\n");
+    if (section_has_lists(section))
+        mstream_cstr(ms, "    int i;\n");
+    for (key = section->keys; key; key = key->next)
+    {
+        cdt_switch(key->type)
+        {
+            case CDT_UNKNOWN: break;
+            case CDT_STR_FIXED:
+                mstream_fmt(
+                    ms,
+                    "    h = c_ini_hash_str(h, s->%S, (int)strlen(s->%S));\n",
+                    key->name,
+                    key->name);
+                break;
+            case CDT_STR_DYNAMIC:
+            case CDT_STR_CUSTOM:
+                api = key->attr.str_api_prefix;
+                mstream_fmt(
+                    ms,
+                    "    h = c_ini_hash_str(h, %S_data(s->%S), %S_len(s->%S));\n",
+                    api,
+                    key->name,
+                    api,
+                    key->name);
+                break;
+            case CDT_STRLIST_FIXED:
+                mstream_fmt(
+                    ms,
+                    "    for (i = 0; i != (int)(sizeof(s->%S) / "
+                    "sizeof(*s->%S)) && *s->%S[i]; ++i)\n"
+                    "        h = c_ini_hash_str(h, s->%S[i], "
+                    "(int)strlen(s->%S[i]));\n"
+                    "    h = c_ini_hash_u64(h, (uint64_t)i);\n",
+                    key->name,
+                    key->name,
+                    key->name,
+                    key->name,
+                    key->name);
+                break;
+            case CDT_STRLIST_DYNAMIC:
+            case CDT_STRLIST_CUSTOM:
+                api = key->attr.strlist_api_prefix;
+                mstream_fmt(
+                    ms,
+                    "    for (i = 0; i != %S_count(s->%S); ++i)\n"
+                    "    {\n"
+                    "        str = %S_cstr(s->%S, i);\n"
+                    "        h = c_ini_hash_str(h, str, (int)strlen(str));\n"
+                    "    }\n"
+                    "    h = c_ini_hash_u64(h, (uint64_t)i);\n",
+                    api,
+                    key->name,
+                    api,
+                    key->name);
+                break;
+            case CDT_BOOL:
+            case CDT_I8:
+            case CDT_U8:
+            case CDT_I16:
+            case CDT_U16:
+            case CDT_I32:
+            case CDT_U32:
+                mstream_fmt(
+                    ms,
+                    "    h = c_ini_hash_u64(h, (uint64_t)s->%S);\n",
+                    key->name);
+                break;
+            case CDT_FLOAT:
+                mstream_fmt(
+                    ms,
+                    "    d = s->%S + 0.0;\n"
+                    "    memcpy(&bits, &d, sizeof(bits));\n"
+                    "    h = c_ini_hash_u64(h, bits);\n",
+                    key->name);
+                break;
+            case CDT_BITFIELD: break;
+        }
+    }
+    mstream_cstr(ms, "    return h;\n}\n\n");
+}
+
+/*! Writes the "key = value" line of a key of the struct "s" */
+static void gen_source_fwrite_key(struct mstream* ms, const struct key* key)
+{
+    struct strview api;
+
+    cdt_switch(key->type)
+    {
+        case CDT_UNKNOWN: break;
+        case CDT_STR_FIXED:
+            mstream_fmt(
+                ms,
+                "    fprintf(f, \"%S = \\\"%%s\\\"\\n\", s->%S);\n",
+                key->name,
+                key->name);
+            break;
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            mstream_fmt(
+                ms,
+                "    fprintf(f, \"%S = \\\"%%.*s\\\"\\n\", "
+                "%S_len(s->%S), %S_data(s->%S));\n",
+                key->name,
+                key->attr.str_api_prefix,
+                key->name,
+                key->attr.str_api_prefix,
+                key->name);
+            break;
+        case CDT_STRLIST_FIXED:
+            mstream_fmt(ms, "    if (s->%S[0][0] != '\\0')\n", key->name);
+            mstream_fmt(ms, "        fprintf(f, \"%S = \");\n", key->name);
+            mstream_fmt(
+                ms,
+                "    for (i = 0; i < (int)sizeof(s->%S) / "
+                "(int)sizeof(*s->%S) && *s->%S[i]; ++i)\n"
+                "    {\n"
+                "        if (i != 0) fprintf(f, \", \");\n"
+                "        fprintf(f, \"\\\"%%s\\\"\", s->%S[i]);\n"
+                "    }\n",
+                key->name,
+                key->name,
+                key->name,
+                key->name);
+            mstream_fmt(ms, "    if (s->%S[0][0] != '\\0')\n", key->name);
+            mstream_fmt(ms, "        fprintf(f, \"\\n\");\n", key->name);
+            break;
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            api = key->attr.strlist_api_prefix;
+            mstream_fmt(
+                ms, "    if (%S_count(s->%S) > 0)\n", api, key->name);
+            mstream_fmt(ms, "        fprintf(f, \"%S = \");\n", key->name);
+            mstream_fmt(
+                ms,
+                "    for (i = 0; i != %S_count(s->%S); ++i)\n"
+                "    {\n"
+                "        if (i) fprintf(f, \", \");\n"
+                "        fprintf(f, \"\\\"%%s\\\"\", %S_cstr(s->%S, i));\n"
+                "    }\n",
+                api,
+                key->name,
+                api,
+                key->name);
+            mstream_fmt(
+                ms, "    if (%S_count(s->%S) > 0)\n", api, key->name);
+            mstream_cstr(ms, "        fprintf(f, \"\\n\");\n");
+            break;
+        case CDT_BOOL:
+            mstream_fmt(
+                ms,
+                "    fprintf(f, \"%S = %%s\\n\", "
+                "s->%S ? \"true\" : \"false\");\n",
+                key->name,
+                key->name);
+            break;
+        case CDT_I8:
+        case CDT_U8:
+        case CDT_I16:
+        case CDT_U16:
+        case CDT_I32:
+        case CDT_U32:
+            mstream_fmt(
+                ms,
+                "    fprintf(f, \"%S = %%d\\n\", s->%S);\n",
+                key->name,
+                key->name);
+            break;
+        case CDT_FLOAT:
+            mstream_fmt(
+                ms,
+                "    fprintf(f, \"%S = %%.9g\\n\", s->%S);\n",
+                key->name,
+                key->name);
+            break;
+        case CDT_BITFIELD: break;
+    }
+}
+
+static void gen_source_fwrite(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+
+    mstream_fmt(
+        ms,
+        "int %S_fwrite(const struct %S* s, FILE* f)\n{\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_cstr(ms, "    char** list;\n");
+    mstream_cstr(ms, "    int i;\n");
+    mstream_cstr(ms, "    (void)list, (void)i;\n");
+    mstream_fmt(ms, "    fprintf(f, \"[%S]\\n\");\n", section->name);
+    for (key = section->keys; key; key = key->next)
+        gen_source_fwrite_key(ms, key);
+    mstream_cstr(ms, "    fprintf(f, \"\\n\");\n");
+    mstream_cstr(ms, "    return 0;\n}\n\n");
+}
+
+/*!
+ * \brief Writes the keys of "s" that differ from "base". Lists can't be empty
+ * in INI, so a list that was cleared is written as a comment.
+ */
+static void
+gen_source_write_patch(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    struct mstream    body = mstream_init_writeable();
+
+    mstream_fmt(
+        ms,
+        "int %S_write_patch(const struct %S* base, const struct %S* s, "
+        "FILE* f)\n{\n"
+        "    int changed;\n"
+        "    int count = 0;\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    if (section_has_lists(section))
+        mstream_cstr(ms, "    int i;\n");
+    for (key = section->keys; key; key = key->next)
+    {
+        gen_source_field_changed(ms, key, "base", "s");
+        mstream_fmt(
+            ms,
+            "    if (changed && count++ == 0)\n"
+            "        fprintf(f, \"[%S]\\n\");\n"
+            "    if (changed)\n"
+            "    {\n",
+            section->name);
+        body.write_ptr = 0;
+        gen_source_fwrite_key(&body, key);
+        cdt_switch(key->type)
+        {
             case CDT_STRLIST_FIXED:
-                strlist = key->attr.default_value.value.strlist;
-                for (i = 0; strlist; strlist = strlist->next, i++)
-                    mstream_fmt(
-                        ms,
-                        "    strcpy(s->%S[%d], \"%S\");\n",
-                        key->name,
-                        i,
-                        strlist->str);
+                mstream_fmt(
+                    &body,
+                    "    if (s->%S[0][0] == '\\0')\n"
+                    "        fprintf(f, \"# %S is empty\\n\");\n",
+                    key->name,
+                    key->name);
                 break;
             case CDT_STRLIST_DYNAMIC:
             case CDT_STRLIST_CUSTOM:
-                strlist = key->attr.default_value.value.strlist;
                 mstream_fmt(
-                    ms,
-                    "    if (%S_init(&s->%S) != 0)\n"
-                    "        goto %S_failed;\n",
+                    &body,
+                    "    if (%S_count(s->%S) == 0)\n"
+                    "        fprintf(f, \"# %S is empty\\n\");\n",
                     key->attr.strlist_api_prefix,
                     key->name,
                     key->name);
-                for (i = 0; strlist; strlist = strlist->next, i++)
-                    mstream_fmt(
-                        ms,
-                        "    if (%S_add(&s->%S, \"%S\", (int)sizeof(\"%S\") - "
-                        "1) != 0)\n"
-                        "        goto %S_add_failed;\n",
-                        key->attr.strlist_api_prefix,
-                        key->name,
-                        strlist->str,
-                        strlist->str,
-                        key->name);
                 break;
-            case CDT_BOOL:
-            case CDT_I8:
-            case CDT_U8:
-            case CDT_I16:
-            case CDT_U16:
-            case CDT_I32:
-            case CDT_U32:
+            default: break;
+        }
+        mstream_indented(ms, &body);
+        mstream_cstr(ms, "    }\n");
+    }
+    free(body.address);
+    mstream_cstr(
+        ms,
+        "    if (count > 0)\n"
+        "        fprintf(f, \"\\n\");\n"
+        "    return count;\n}\n\n");
+}
+
+static void gen_source_parse_key(
+    struct mstream* ms, const struct section* section, const struct key* key)
+{
+    struct strview api;
+    mstream_fmt(
+        ms,
+        "static enum token parse_%S__%S(\n"
+        "    struct c_ini_parser* p, struct %S* s)\n"
+        "{\n",
+        section->struct_name,
+        key->name,
+        section->struct_name);
+    cdt_switch(key->type)
+    {
+        case CDT_UNKNOWN: break;
+        case CDT_STR_FIXED:
+            mstream_fmt(
+                ms,
+                "    struct c_ini_strspan value;\n"
+                "    if (scan_next(p) != TOK_STRING)\n"
+                "        return parser_error(p, \"Expected a string literal "
+                "for %S\\n\");\n",
+                key->name);
+            mstream_fmt(
+                ms,
+                "    value = p->value.string;\n\n"
+                "    if (value.len >= (int)sizeof(s->%S))\n"
+                "        return parser_error(\n"
+                "            p,\n"
+                "            \"\\\"%S\\\" can't be longer than %%d "
+                "characters\\n\",\n"
+                "            (int)sizeof(s->%S) - 1);\n\n",
+                key->name,
+                key->name,
+                key->name);
+            mstream_fmt(
+                ms,
+                "    memcpy(s->%S, p->source + value.off, value.len);\n"
+                "    s->%S[value.len] = '\\0';\n\n"
+                "    return scan_next(p);\n",
+                key->name,
+                key->name);
+            break;
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            api = key->attr.str_api_prefix;
+            if (*allocator_arg(api))
                 mstream_fmt(
                     ms,
-                    "    s->%S = %d;\n",
-                    key->name,
-                    (int)key->attr.default_value.value.integer);
-                break;
-            case CDT_FLOAT:
+                    "    const struct c_ini_allocator* a =\n"
+                    "        p->allocator ? p->allocator : %S_allocator;\n",
+                    section->struct_name);
+            mstream_fmt(
+                ms,
+                "    if (scan_next(p) != TOK_STRING)\n"
+                "        return parser_error(p, \"Expected a string literal of "
+                "%S\\n\");\n\n",
+                key->name);
+            mstream_fmt(
+                ms,
+                "    if ((p->allocated += (size_t)p->value.string.len + 1) >\n"
+                "        (size_t)p->max_allocated)\n"
+                "        return parser_error(\n"
+                "            p, \"More than %%d bytes allocated\\n\", "
+                "p->max_allocated);\n"
+                "    if (%S_set(%s&s->%S, p->source + p->value.string.off, "
+                "p->value.string.len) != 0)\n"
+                "        return TOK_ERROR;\n"
+                "    C_INI_STAT(p, allocations, 1);\n\n"
+                "    return scan_next(p);\n",
+                api,
+                allocator_arg(api),
+                key->name);
+            break;
+        case CDT_STRLIST_FIXED:
+            mstream_fmt(
+                ms,
+                "    enum token tok;\n"
+                "    int        i = 0;\n"
+                "    while (1)\n"
+                "    {\n"
+                "        if (scan_next(p) != TOK_STRING)\n"
+                "            return parser_error(p,"
+                "\"Expected a string literal for %S\\n\");\n\n",
+                key->name);
+            mstream_fmt(
+                ms,
+                "        if (p->value.string.len > (int)sizeof(*s->%S))\n"
+                "            return parser_error(\n"
+                "                p,\n"
+                "                \"String literal is too large. Max size is "
+                "%%d bytes.\\n\",\n"
+                "                (int)sizeof(*s->%S));\n",
+                key->name,
+                key->name);
+            mstream_fmt(
+                ms,
+                "        if (i == (int)sizeof(s->%S) / (int)sizeof(*s->%S))\n"
+                "            return parser_error(\n"
+                "                p,\n"
+                "                \"Too many strings in list. Max size is %%d "
+                "strings.\\n\",\n"
+                "                i);\n",
+                key->name,
+                key->name);
+            mstream_cstr(
+                ms,
+                "        if (i >= p->max_list_elements)\n"
+                "            return parser_error(\n"
+                "                p, \"More than %d elements in list\\n\", "
+                "p->max_list_elements);\n\n");
+            mstream_fmt(
+                ms,
+                "        memcpy(\n"
+                "            s->%S[i],\n"
+                "            p->source + p->value.string.off,\n"
+                "            p->value.string.len);\n"
+                "        s->%S[i++][p->value.string.len] = '\\0';\n",
+                key->name,
+                key->name);
+            mstream_cstr(
+                ms,
+                "        tok = scan_next(p);\n"
+                "        if (tok != ',')\n"
+                "            break;\n"
+                "    }\n\n");
+            mstream_fmt(
+                ms,
+                "    while (i != (int)sizeof(s->%S) / (int)sizeof(*s->%S))\n"
+                "        s->%S[i++][0] = '\\0';\n\n"
+                "    return tok;\n",
+                key->name,
+                key->name,
+                key->name);
+            break;
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            api = key->attr.strlist_api_prefix;
+            mstream_cstr(ms, "    enum token tok;\n    int        n = 0;\n");
+            if (*allocator_arg(api))
+                mstream_fmt(
+                    ms,
+                    "    const struct c_ini_allocator* a =\n"
+                    "        p->allocator ? p->allocator : %S_allocator;\n",
+                    section->struct_name);
+            gen_source_strlist_clear(ms, key, "s");
+            mstream_fmt(
+                ms,
+                "    while (1)\n"
+                "    {\n"
+                "        if (scan_next(p) != TOK_STRING)\n"
+                "            return parser_error(p,"
+                "\"Expected a string literal for %S\\n\");\n\n",
+                key->name);
+            mstream_cstr(
+                ms,
+                "        if (++n > p->max_list_elements)\n"
+                "            return parser_error(\n"
+                "                p, \"More than %d elements in list\\n\", "
+                "p->max_list_elements);\n"
+                "        if ((p->allocated += (size_t)p->value.string.len + 1) "
+                ">\n"
+                "            (size_t)p->max_allocated)\n"
+                "            return parser_error(\n"
+                "                p, \"More than %d bytes allocated\\n\", "
+                "p->max_allocated);\n");
+            mstream_fmt(
+                ms,
+                "        if (%S_add(%s&s->%S, p->source + p->value.string.off, "
+                "p->value.string.len) != 0)\n"
+                "            return -1;\n"
+                "        C_INI_STAT(p, allocations, 1);\n",
+                api,
+                allocator_arg(api),
+                key->name);
+            mstream_cstr(
+                ms,
+                "        tok = scan_next(p);\n"
+                "        if (tok != ',')\n"
+                "            break;\n"
+                "    }\n\n"
+                "    return tok;\n");
+            break;
+        case CDT_BOOL:
+        case CDT_I8:
+        case CDT_U8:
+        case CDT_I16:
+        case CDT_U16:
+        case CDT_I32:
+        case CDT_U32:
+            mstream_fmt(
+                ms,
+                "    if (scan_next(p) != TOK_INTEGER)\n"
+                "        return parser_error(p, \"Expected an integer literal "
+                "for %S\\n\");\n\n",
+                key->name);
+
+            if (key->type != CDT_U32 && key->type != CDT_I32)
                 mstream_fmt(
                     ms,
-                    "    s->%S = %f;\n",
+                    "    if (p->value.integer_literal < %d || "
+                    "p->value.integer_literal > %d)\n"
+                    "        return parser_error(p, \"\\\"%S\\\" must be "
+                    "%d to %d\\n\");\n\n",
+                    key->attr.min.value.integer,
+                    key->attr.max.value.integer,
                     key->name,
-                    key->attr.default_value.value.floating);
-                break;
-            case CDT_BITFIELD: break;
+                    key->attr.min.value.integer,
+                    key->attr.max.value.integer);
+            mstream_fmt(
+                ms, "    s->%S = p->value.integer_literal;\n", key->name);
+            mstream_cstr(ms, "    return scan_next(p);\n");
+            break;
+        case CDT_FLOAT:
+            mstream_fmt(
+                ms,
+                "    double value;\n"
+                "    enum token tok = scan_next(p);\n"
+                "    if (tok != TOK_FLOAT && tok != TOK_INTEGER)\n"
+                "        return parser_error(\n"
+                "            p, \"Expected a floating point literal for "
+                "%S\\n\");\n\n",
+                key->name);
+            mstream_cstr(
+                ms,
+                "    if (tok == TOK_FLOAT)\n"
+                "        value = p->value.float_literal;\n"
+                "    else\n"
+                "        value = (double)p->value.integer_literal;\n");
+            mstream_fmt(
+                ms,
+                "    if (value < %f || value > %f)\n"
+                "        return parser_error(p, \"\\\"%S\\\" must be %f to "
+                "%f\\n\");\n",
+                key->attr.min.value.floating,
+                key->attr.max.value.floating,
+                key->name,
+                key->attr.min.value.floating,
+                key->attr.max.value.floating);
+            mstream_fmt(
+                ms,
+                "\n"
+                "    s->%S = value;\n"
+                "    return scan_next(p);\n",
+                key->name);
+            break;
+        case CDT_BITFIELD: break;
+    }
+    mstream_cstr(ms, "}\n\n");
+}
+
+/*!
+ * \brief Writes the lookup of the key in "key", which is a switch over the
+ * key's hash. The buckets are dense, so compilers turn it into a jump table,
+ * and every bucket compares against one or two key names at most. Once a key
+ * matched and the "=" after it was scanned, gen_branch() writes the code that
+ * parses the value into "tok". Unknown keys are errors.
+ *
+ * Files written by _fwrite() list the keys in declaration order, so before
+ * hashing, the key is compared with the one declared after the previous key.
+ * That needs an "int next = 0;" in the calling function.
+ */
+/*!
+ * \brief Writes the lookup from a key to its field ID that every way of
+ * parsing a section shares. Keys usually appear in the order of the struct,
+ * so the one after the previous key is compared first. Other keys are found
+ * through a switch over a few bits of their hash.
+ */
+static void
+gen_source_key_lookup(struct mstream* ms, const struct section* section)
+{
+    struct strview    name = section->struct_name;
+    const struct key* key;
+    uint32_t          buckets = 1;
+    uint32_t          bucket;
+    int               keys = 0;
+
+    for (key = section->keys; key; key = key->next)
+        keys++;
+    while (buckets < 2 * (uint32_t)keys)
+        buckets *= 2;
+
+    mstream_fmt(
+        ms,
+        "static const struct\n"
+        "{\n"
+        "    const char* name;\n"
+        "    int         len;\n"
+        "} %S_keys[%U_FIELDS_COUNT] = {\n",
+        name,
+        name);
+    for (key = section->keys; key; key = key->next)
+        mstream_fmt(
+            ms,
+            "    {\"%S\", %d}%s\n",
+            key->name,
+            key->name.len,
+            key->next ? "," : "};\n");
+
+    mstream_fmt(
+        ms,
+        "static int %S_find_key(\n"
+        "    const struct c_ini_parser* p,\n"
+        "    struct c_ini_strspan       key,\n"
+        "    int                        next)\n"
+        "{\n"
+        "    if (next != %U_FIELDS_COUNT && key.len == %S_keys[next].len &&\n"
+        "        memcmp(p->source + key.off, %S_keys[next].name, key.len) "
+        "== 0)\n"
+        "        return next;\n",
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    switch (key_hash(p->source + key.off, key.len) & %d)\n"
+        "    {\n",
+        (int)buckets - 1);
+    for (bucket = 0; bucket != buckets; ++bucket)
+    {
+        int empty = 1;
+        for (key = section->keys; key; key = key->next)
+        {
+            if ((key_hash(key->name) & (buckets - 1)) != bucket)
+                continue;
+            if (empty)
+                mstream_fmt(ms, "        case %d:\n", (int)bucket);
+            empty = 0;
+            mstream_fmt(
+                ms,
+                "            if (key.len == %d &&\n"
+                "                memcmp(p->source + key.off, \"%S\", %d) "
+                "== 0)\n"
+                "                return %U_FIELD_%U;\n",
+                key->name.len,
+                key->name,
+                key->name.len,
+                name,
+                key->name);
+        }
+        if (!empty)
+            mstream_cstr(ms, "            break;\n");
+    }
+    mstream_cstr(
+        ms,
+        "    }\n"
+        "    return -1;\n"
+        "}\n\n");
+}
+
+/*!
+ * \brief Writes the part of a section loop that handles a key. gen_branch()
+ * writes what is done with the value of the field in "field".
+ */
+static void gen_source_key_dispatch(
+    struct mstream*       ms,
+    const struct section* section,
+    void (*gen_branch)(struct mstream*, const struct section*))
+{
+    mstream_cstr(
+        ms,
+        "            if (++p->keys > p->max_keys)\n"
+        "                return parser_error(\n"
+        "                    p, \"More than %d keys in section\\n\", "
+        "p->max_keys);\n"
+        "            key = p->value.string;\n");
+    if (section->keys)
+    {
+        mstream_fmt(
+            ms,
+            "            field = %S_find_key(p, key, next);\n"
+            "            if (field >= 0)\n"
+            "            {\n",
+            section->struct_name);
+        mstream_cstr(
+            ms,
+            "                if (scan_next(p) != '=')\n"
+            "                    return parser_error(\n"
+            "                        p, \"Expected \\\"=\\\" after key\\n\");\n"
+            "                next = field + 1;\n");
+        gen_branch(ms, section);
+        mstream_cstr(
+            ms,
+            "                continue;\n"
+            "            }\n");
+    }
+    mstream_fmt(
+        ms,
+        "            return parser_error(\n"
+        "                p, \"Unknown key \\\"%%.*s\\\" in section "
+        "\\\"%S\\\"\\n\",\n"
+        "                key.len, p->source + key.off);\n",
+        section->name);
+}
+
+static void
+gen_section_key_branch(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
+        ms,
+        "                C_INI_HOOK(p, key_begin, %S_keys[field].name);\n"
+        "                if (fields == NULL ||\n"
+        "                    C_INI_FIELD_TEST(fields, field))\n"
+        "                {\n"
+        "                    tok = %S_parsers[field](p, s);\n"
+        "                    if (p->dirty)\n"
+        "                        C_INI_FIELD_SET(p->dirty, field);\n"
+        "                }\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "                else\n"
+        "                    tok = skip_value(p);\n"
+        "                C_INI_HOOK(p, key_end, %S_keys[field].name);\n"
+        "                C_INI_STAT(p, keys, 1);\n",
+        section->struct_name);
+}
+
+/*!
+ * \brief Writes a table of functions indexed by field ID, one per key, named
+ * <prefix>_<struct>__<key>. They take the parser, and the struct if "to_struct"
+ * is set.
+ */
+static void gen_source_key_table(
+    struct mstream*       ms,
+    const struct section* section,
+    const char*           table,
+    const char*           prefix,
+    int                   to_struct)
+{
+    const struct key* key;
+    mstream_fmt(
+        ms,
+        "static enum token (*const %S_%s[%U_FIELDS_COUNT])(\n"
+        "    struct c_ini_parser*",
+        section->struct_name,
+        table,
+        section->struct_name);
+    if (to_struct)
+        mstream_fmt(ms, ", struct %S*", section->struct_name);
+    mstream_cstr(ms, ") = {\n");
+    for (key = section->keys; key; key = key->next)
+        mstream_fmt(
+            ms,
+            "    %s_%S__%S%s\n",
+            prefix,
+            section->struct_name,
+            key->name,
+            key->next ? "," : "};\n");
+}
+
+static void
+gen_source_parse_section(struct mstream* ms, const struct section* section)
+{
+    struct key* key;
+    for (key = section->keys; key; key = key->next)
+        gen_source_parse_key(ms, section, key);
+    if (section->keys)
+    {
+        gen_source_key_lookup(ms, section);
+        gen_source_key_table(ms, section, "parsers", "parse", 1);
+    }
+
+    mstream_fmt(
+        ms,
+        "int %S_parse_section_fields(\n"
+        "    struct %S* s, const uint32_t* fields, struct c_ini_parser* p)\n"
+        "{\n"
+        "    enum token           tok;\n"
+        "    struct c_ini_strspan key;\n",
+        section->struct_name,
+        section->struct_name);
+    if (section->keys)
+        mstream_cstr(
+            ms,
+            "    int                  next = 0;\n"
+            "    int                  field;\n");
+    mstream_cstr(
+        ms,
+        "\n"
+        "    tok = scan_next(p);\n"
+        "    while (1)\n"
+        "    {\n"
+        "        if (tok == TOK_ERROR) return TOK_ERROR;\n"
+        "        if (tok == TOK_END) return TOK_END;\n"
+        "        if (tok == TOK_KEY)\n"
+        "        {\n");
+    gen_source_key_dispatch(ms, section, gen_section_key_branch);
+    mstream_cstr(
+        ms,
+        "        }\n"
+        "\n"
+        "        return tok;\n"
+        "    }\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "int %S_parse_section(struct %S* s, struct c_ini_parser* p)\n"
+        "{\n"
+        "    return %S_parse_section_fields(s, NULL, p);\n"
+        "}\n\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+}
+
+static void gen_source_parse(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
+        ms,
+        "static int %S_on_section(struct c_ini_parser* p, void* user_ptr)\n{\n",
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "    enum token tok = %S_parse_section(user_ptr, p);\n",
+        section->struct_name);
+    mstream_cstr(
+        ms,
+        "   if (tok != TOK_ERROR)\n"
+        "        return TOK_END;\n"
+        "    return tok;\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "int %S_parse_opts(\n"
+        "    struct %S* s,\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    const struct c_ini_options* opts)\n{\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "    return %S_parse_all_opts(\n"
+        "        filename, data, len, %S_on_section, s, opts);\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_cstr(ms, "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "int %S_parse(\n"
+        "    struct %S* s, const char* filename, const char* data, int "
+        "len)\n{\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "    return %S_parse_opts(s, filename, data, len, NULL);\n",
+        section->struct_name);
+    mstream_cstr(ms, "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "struct %S_fields_target\n"
+        "{\n"
+        "    struct %S*      s;\n"
+        "    const uint32_t* fields;\n"
+        "};\n\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "static int %S_on_fields_section(struct c_ini_parser* p, void* "
+        "user_ptr)\n"
+        "{\n"
+        "    struct %S_fields_target* target = user_ptr;\n"
+        "    enum token tok =\n"
+        "        %S_parse_section_fields(target->s, target->fields, p);\n"
+        "    if (tok != TOK_ERROR)\n"
+        "        return TOK_END;\n"
+        "    return tok;\n"
+        "}\n\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "int %S_parse_fields_opts(\n"
+        "    struct %S* s,\n"
+        "    const uint32_t* fields,\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    const struct c_ini_options* opts)\n{\n"
+        "    struct %S_fields_target target;\n"
+        "    target.s = s;\n"
+        "    target.fields = fields;\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "    return %S_parse_all_opts(\n"
+        "        filename, data, len, %S_on_fields_section, &target, opts);\n"
+        "}\n\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "int %S_parse_fields(\n"
+        "    struct %S* s,\n"
+        "    const uint32_t* fields,\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len)\n{\n"
+        "    return %S_parse_fields_opts(s, fields, filename, data, len, "
+        "NULL);\n"
+        "}\n\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+}
+
+static void
+gen_source_parse_all(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
+        ms,
+        "static int %S_parse_sections(\n"
+        "    struct c_ini_parser* p,\n"
+        "    int (*on_section)(struct c_ini_parser*, void*),\n"
+        "    void* user_ptr)\n{\n",
+        section->struct_name);
+    mstream_cstr(
+        ms,
+        "    if (p->end > p->max_bytes)\n"
+        "        return parser_error(\n"
+        "            p,\n"
+        "            \"Document is larger than the limit of %d bytes\\n\",\n"
+        "            p->max_bytes);\n"
+        "    while (1)\n"
+        "    {\n");
+    mstream_cstr(
+        ms,
+        "        enum token tok = scan_next(p);\n"
+        "    reswitch_tok:\n"
+        "        if (tok == TOK_ERROR) return -1;\n"
+        "        if (tok == TOK_END) return 0;\n"
+        "        if (tok == '[')\n"
+        "        {\n"
+        "            p->section_start = p->tail;\n"
+        "            if (++p->sections > p->max_sections)\n"
+        "                return parser_error(\n"
+        "                    p, \"More than %d sections\\n\", "
+        "p->max_sections);\n");
+    mstream_cstr(
+        ms,
+        "            if (scan_next(p) != TOK_KEY)\n"
+        "                return parser_error(\n"
+        "                    p,\n"
+        "                    \"Expected a section name within the brackets. "
+        "Example: \"\n"
+        "                    \"[mysection]\\n\");\n");
+    mstream_fmt(
+        ms,
+        "            if (!cstr_equal(\"%S\", p->value.string, p->source))\n"
+        "            {\n"
+        "                C_INI_STAT(p, sections_skipped, 1);\n"
+        "                continue;\n"
+        "            }\n",
+        section->name);
+    mstream_cstr(
+        ms,
+        "            if (scan_next(p) != ']')\n"
+        "                return parser_error(p, \"Missing closing bracket "
+        "\\\"]\\\"\\n\");\n");
+    mstream_fmt(
+        ms,
+        "            C_INI_STAT(p, sections_matched, 1);\n"
+        "            C_INI_HOOK(p, section_begin, \"%S\");\n"
+        "            p->keys = 0;\n"
+        "            tok = on_section(p, user_ptr);\n"
+        "            C_INI_HOOK(p, section_end, \"%S\");\n"
+        "            goto reswitch_tok;\n"
+        "        }\n"
+        "    }\n"
+        "}\n\n",
+        section->name,
+        section->name);
+
+    mstream_fmt(
+        ms,
+        "int %S_parse_all_opts(\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    int (*on_section)(struct c_ini_parser*, void*),\n"
+        "    void* user_ptr,\n"
+        "    const struct c_ini_options* opts)\n{\n",
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "    struct c_ini_parser p;\n"
+        "    parser_init(&p, filename, data, len, opts);\n"
+        "    return parser_finish(\n"
+        "        &p, %S_parse_sections(&p, on_section, user_ptr));\n"
+        "}\n\n",
+        section->struct_name);
+
+    mstream_fmt(
+        ms,
+        "int %S_parse_all(\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    int (*on_section)(struct c_ini_parser*, void*),\n"
+        "    void* user_ptr)\n{\n",
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "    return %S_parse_all_opts(\n"
+        "        filename, data, len, on_section, user_ptr, NULL);\n"
+        "}\n\n",
+        section->struct_name);
+
+    /* Only data after the last line that starts with "[" can still be
+     * incomplete, so that is all that is held back */
+    mstream_fmt(
+        ms,
+        "int %S_parse_tail_opts(\n"
+        "    struct c_ini_tail* tail,\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    int (*on_section)(struct c_ini_parser*, void*),\n"
+        "    void* user_ptr,\n"
+        "    const struct c_ini_options* opts)\n{\n",
+        section->struct_name);
+    mstream_cstr(
+        ms,
+        "    struct c_ini_parser p;\n"
+        "    int                 end = len;\n"
+        "    int                 result;\n\n"
+        "    /* The data was truncated or replaced */\n"
+        "    if (tail->offset > len)\n"
+        "    {\n"
+        "        tail->offset = 0;\n"
+        "        tail->sections = 0;\n"
+        "        tail->allocated = 0;\n"
+        "    }\n"
+        "    if (!tail->flush)\n"
+        "        end = c_ini_tail_end(data, tail->offset, len);\n"
+        "    if (end == tail->offset)\n"
+        "        return 0;\n\n");
+    mstream_fmt(
+        ms,
+        "    parser_init(&p, filename, data, end, opts);\n"
+        "    p.head = p.section_start = tail->offset;\n"
+        "    p.sections = tail->sections;\n"
+        "    p.allocated = tail->allocated;\n"
+        "    result = parser_finish(\n"
+        "        &p, %S_parse_sections(&p, on_section, user_ptr));\n",
+        section->struct_name);
+    mstream_cstr(
+        ms,
+        "    /* Sections that were handled aren't handled again, and the\n"
+        "     * limits apply to the whole document, not to each call */\n"
+        "    if (result != 0 && p.sections > tail->sections)\n"
+        "        p.sections--;\n"
+        "    tail->offset = result == 0 ? end : p.section_start;\n"
+        "    tail->sections = p.sections;\n"
+        "    tail->allocated = p.allocated;\n"
+        "    return result;\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "int %S_parse_tail(\n"
+        "    struct c_ini_tail* tail,\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    int (*on_section)(struct c_ini_parser*, void*),\n"
+        "    void* user_ptr)\n{\n",
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "    return %S_parse_tail_opts(\n"
+        "        tail, filename, data, len, on_section, user_ptr, NULL);\n"
+        "}\n\n",
+        section->struct_name);
+}
+
+static void
+gen_source_for_each_value(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    mstream_fmt(
+        ms,
+        "int %S_for_each_value(struct %S* s, int (*on_value)(void* value, "
+        "int type, void*), void* user_ptr)\n{\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+    for (key = section->keys; key; key = key->next)
+    {
+        if (key->type & CDT_BITFIELD)
+            continue;
+        mstream_fmt(
+            ms,
+            "    if (on_value(&s->%S, %d, user_ptr) != 0)\n"
+            "        return -1;\n",
+            key->name,
+            key->type);
+    }
+    mstream_cstr(ms, "    return 0;\n");
+    mstream_cstr(ms, "}\n\n");
+}
+
+/*!
+ * \brief Returns the prefix of the string API that reports the heap memory of
+ * a key, or an empty strview if there is none. The built-in APIs always have
+ * one, custom APIs only if the key has the MEMORY() attribute.
+ */
+static struct strview key_memory_api(const struct key* key)
+{
+    cdt_switch(key->type)
+    {
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            if (key->attr.has_memory_api ||
+                cstr_equal("c_str_dyn", key->attr.str_api_prefix))
+                return key->attr.str_api_prefix;
+            break;
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            if (key->attr.has_memory_api ||
+                cstr_equal("c_strlist_dyn", key->attr.strlist_api_prefix))
+                return key->attr.strlist_api_prefix;
+            break;
+        default: break;
+    }
+    return empty_strview();
+}
+
+static void
+gen_source_memory_usage(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    struct strview    api;
+
+    mstream_fmt(
+        ms,
+        "size_t %S_memory_usage_by_field(const struct %S* s, "
+        "void (*on_field)(const char* name, size_t bytes, void* user_ptr), "
+        "void* user_ptr)\n{\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_cstr(
+        ms,
+        "    size_t total = 0;\n"
+        "    size_t bytes = 0;\n"
+        "    (void)s;\n"
+        "    (void)on_field;\n"
+        "    (void)user_ptr;\n"
+        "    (void)bytes;\n");
+    for (key = section->keys; key; key = key->next)
+    {
+        api = key_memory_api(key);
+        if (api.len == 0)
+            continue;
+        mstream_fmt(
+            ms,
+            "    bytes = %S_memory(s->%S);\n"
+            "    if (on_field)\n"
+            "        on_field(\"%S\", bytes, user_ptr);\n"
+            "    total += bytes;\n",
+            api,
+            key->name,
+            key->name);
+    }
+    mstream_cstr(ms, "    return total;\n");
+    mstream_cstr(ms, "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "size_t %S_memory_usage(const struct %S* s)\n{\n"
+        "    return %S_memory_usage_by_field(s, NULL, NULL);\n"
+        "}\n\n",
+        section->struct_name,
+        section->struct_name,
+        section->struct_name);
+}
+
+/*!
+ * \brief Writes the slab pool of a struct. Records are allocated in slabs that
+ * double in size, up to a limit, so that repeated sections cost one
+ * allocation per slab instead of one per record.
+ */
+/*!
+ * \brief Writes the cursor functions, which parse one matching section per
+ * struct and stop. The cursor only stores an offset, so every call starts a
+ * new parser there. Structs are reset instead of being initialized, so their
+ * strings keep their capacity from one record to the next.
+ */
+static void gen_source_cursor(struct mstream* ms, const struct section* section)
+{
+    struct strview name = section->struct_name;
+
+    mstream_fmt(
+        ms,
+        "struct %S_cursor_batch\n"
+        "{\n"
+        "    struct %S* s;\n"
+        "    int n;\n"
+        "    int count;\n"
+        "    int next; /* Where the next call starts */\n"
+        "};\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "static int %S_on_cursor_section(struct c_ini_parser* p, void* user_ptr)\n"
+        "{\n"
+        "    struct %S_cursor_batch* batch = user_ptr;\n"
+        "    struct %S*              s = &batch->s[batch->count];\n"
+        "    enum token              tok;\n"
+        "    if (%S_reset(s) != 0)\n"
+        "        return parser_error(p, \"Failed to allocate \\\"%S\\\"\\n\");\n"
+        "    tok = %S_parse_section(s, p);\n"
+        "    if (tok == TOK_ERROR)\n"
+        "        return tok;\n",
+        name,
+        name,
+        name,
+        name,
+        section->name,
+        name);
+    mstream_cstr(
+        ms,
+        "    if (++batch->count != batch->n)\n"
+        "        return tok;\n"
+        "    /* The token that ended the section is read again next time */\n"
+        "    batch->next = p->tail;\n"
+        "    return TOK_END;\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "void %S_cursor_init(\n"
+        "    struct c_ini_cursor* c,\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    const struct c_ini_options* opts)\n"
+        "{\n"
+        "    c->filename = filename;\n"
+        "    c->data = data;\n"
+        "    c->len = len;\n"
+        "    c->offset = 0;\n"
+        "    c->opts = opts;\n"
+        "    c->error = 0;\n"
+        "    c->sections = 0;\n"
+        "    c->allocated = 0;\n"
+        "}\n\n",
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_cursor_next_batch(struct c_ini_cursor* c, struct %S* s, "
+        "int n)\n"
+        "{\n"
+        "    struct c_ini_parser     p;\n"
+        "    struct %S_cursor_batch batch;\n"
+        "    int                     result;\n\n"
+        "    if (c->error)\n"
+        "        return -1;\n"
+        "    if (n <= 0 || c->offset >= c->len)\n"
+        "        return 0;\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    batch.s = s;\n"
+        "    batch.n = n;\n"
+        "    batch.count = 0;\n"
+        "    batch.next = c->len;\n"
+        "    parser_init(&p, c->filename, c->data, c->len, c->opts);\n"
+        "    p.head = p.section_start = c->offset;\n"
+        "    p.sections = c->sections;\n"
+        "    p.allocated = c->allocated;\n"
+        "    result = parser_finish(\n"
+        "        &p, %S_parse_sections(&p, %S_on_cursor_section, &batch));\n",
+        name,
+        name);
+    mstream_cstr(
+        ms,
+        "    /* The limits apply to the whole document, not to each batch */\n"
+        "    c->sections = p.sections;\n"
+        "    c->allocated = p.allocated;\n"
+        "    if (result == 0)\n"
+        "    {\n"
+        "        c->offset = batch.next;\n"
+        "        return batch.count;\n"
+        "    }\n"
+        "    /* Records parsed before the error are still returned. The error\n"
+        "     * is returned by every call after that */\n"
+        "    c->offset = p.section_start;\n"
+        "    c->error = 1;\n"
+        "    return batch.count > 0 ? batch.count : -1;\n"
+        "}\n\n");
+    mstream_fmt(
+        ms,
+        "int %S_cursor_next(struct c_ini_cursor* c, struct %S* s)\n"
+        "{\n"
+        "    return %S_cursor_next_batch(c, s, 1);\n"
+        "}\n\n",
+        name,
+        name,
+        name);
+}
+
+static void gen_source_pool(struct mstream* ms, const struct section* section)
+{
+    struct strview name = section->struct_name;
+
+    gen_pool_types(ms, section);
+    mstream_cstr(ms, "\n");
+    mstream_fmt(
+        ms,
+        "void %S_pool_init(\n"
+        "    struct %S_pool* pool, const struct c_ini_allocator* allocator)\n"
+        "{\n"
+        "    pool->first = NULL;\n"
+        "    pool->last = NULL;\n"
+        "    pool->count = 0;\n"
+        "    pool->allocator = allocator;\n"
+        "}\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "void %S_pool_deinit(struct %S_pool* pool)\n"
+        "{\n"
+        "    const struct c_ini_allocator* a = pool->allocator;\n"
+        "    struct %S_pool_slab*          slab = pool->first;\n"
+        "    struct %S_pool_slab*          next;\n"
+        "    int                           i;\n",
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    for (; slab; slab = next)\n"
+        "    {\n"
+        "        for (i = 0; i != slab->count; ++i)\n"
+        "            %S_deinit(&slab->records[i]);\n"
+        "        next = slab->next;\n"
+        "        if (a)\n"
+        "            (a->free)(a->ctx, slab);\n"
+        "        else\n"
+        "            free(slab);\n"
+        "    }\n"
+        "    %S_pool_init(pool, a);\n"
+        "}\n\n",
+        name,
+        name);
+
+    mstream_fmt(
+        ms,
+        "struct %S* %S_pool_add(struct %S_pool* pool)\n"
+        "{\n"
+        "    const struct c_ini_allocator* a = pool->allocator;\n"
+        "    struct %S_pool_slab*          slab = pool->last;\n"
+        "    struct %S*                    s;\n",
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    if (slab == NULL || slab->count == slab->capacity)\n"
+        "    {\n"
+        "        int capacity = slab ? slab->capacity * 2 : 16;\n"
+        "        size_t size;\n"
+        "        if (capacity > 4096)\n"
+        "            capacity = 4096;\n"
+        "        size = sizeof(*slab) + C_INI_CACHE_LINE - 1 +\n"
+        "               sizeof(struct %S) * capacity;\n"
+        "        slab = a ? (a->alloc)(a->ctx, size) : malloc(size);\n"
+        "        if (slab == NULL)\n"
+        "            return NULL;\n",
+        name);
+    mstream_fmt(
+        ms,
+        "        slab->next = NULL;\n"
+        "        slab->records = (struct %S*)(\n"
+        "            ((uintptr_t)(slab + 1) + C_INI_CACHE_LINE - 1) &\n"
+        "            ~(uintptr_t)(C_INI_CACHE_LINE - 1));\n"
+        "        slab->count = 0;\n"
+        "        slab->capacity = capacity;\n"
+        "        if (pool->last)\n"
+        "            pool->last->next = slab;\n"
+        "        else\n"
+        "            pool->first = slab;\n"
+        "        pool->last = slab;\n"
+        "    }\n\n",
+        name);
+    mstream_fmt(
+        ms,
+        "    s = &slab->records[slab->count];\n"
+        "    if (%S_init(s) != 0)\n"
+        "        return NULL;\n"
+        "    slab->count++;\n"
+        "    pool->count++;\n"
+        "    return s;\n"
+        "}\n\n",
+        name);
+
+    mstream_fmt(
+        ms,
+        "int %S_pool_for_each(\n"
+        "    struct %S_pool* pool,\n"
+        "    int (*on_record)(struct %S* s, void* user_ptr),\n"
+        "    void* user_ptr)\n"
+        "{\n"
+        "    struct %S_pool_slab* slab;\n"
+        "    int                  i;\n"
+        "    for (slab = pool->first; slab; slab = slab->next)\n"
+        "        for (i = 0; i != slab->count; ++i)\n"
+        "            if (on_record(&slab->records[i], user_ptr) != 0)\n"
+        "                return -1;\n"
+        "    return 0;\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        name);
+
+    mstream_fmt(
+        ms,
+        "static int %S_on_pool_section(struct c_ini_parser* p, void* user_ptr)\n"
+        "{\n"
+        "    struct %S* s = %S_pool_add(user_ptr);\n"
+        "    if (s == NULL)\n"
+        "        return parser_error(p, \"Failed to allocate \\\"%S\\\"\\n\");\n"
+        "    return %S_parse_section(s, p);\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        section->name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_parse_all_into_pool(\n"
+        "    struct %S_pool* pool,\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    const struct c_ini_options* opts)\n"
+        "{\n"
+        "    return %S_parse_all_opts(\n"
+        "        filename, data, len, %S_on_pool_section, pool, opts);\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        name);
+}
+
+/*!
+ * \brief Writes the function that parses the value of a scalar key into its
+ * column. Only the range of the column type is checked here, CONSTRAIN() is
+ * checked for the whole column at once after parsing.
+ */
+static void gen_source_parse_column(
+    struct mstream* ms, const struct section* section, const struct key* key)
+{
+    struct attributes range;
+
+    /* Bitfields keep their range, whatever the base type is */
+    if (key->type & CDT_BITFIELD)
+        range = key->attr;
+    else
+        attributes_set_default_for_type(&range, key->type);
+
+    mstream_fmt(
+        ms,
+        "static enum token parse_%S_column__%S(\n"
+        "    struct c_ini_parser* p, %s* value)\n"
+        "{\n",
+        section->struct_name,
+        key->name,
+        column_type(key));
+    if (key->type == CDT_FLOAT)
+    {
+        mstream_fmt(
+            ms,
+            "    enum token tok = scan_next(p);\n"
+            "    if (tok != TOK_FLOAT && tok != TOK_INTEGER)\n"
+            "        return parser_error(\n"
+            "            p, \"Expected a floating point literal for "
+            "%S\\n\");\n",
+            key->name);
+        mstream_cstr(
+            ms,
+            "    *value = tok == TOK_FLOAT ? p->value.float_literal\n"
+            "                              : "
+            "(double)p->value.integer_literal;\n"
+            "    return scan_next(p);\n"
+            "}\n\n");
+        return;
+    }
+
+    mstream_fmt(
+        ms,
+        "    if (scan_next(p) != TOK_INTEGER)\n"
+        "        return parser_error(p, \"Expected an integer literal "
+        "for %S\\n\");\n",
+        key->name);
+    if (key->type != CDT_U32 && key->type != CDT_I32)
+        mstream_fmt(
+            ms,
+            "    if (p->value.integer_literal < %d || "
+            "p->value.integer_literal > %d)\n"
+            "        return parser_error(p, \"\\\"%S\\\" must be "
+            "%d to %d\\n\");\n",
+            (int)range.min.value.integer,
+            (int)range.max.value.integer,
+            key->name,
+            (int)range.min.value.integer,
+            (int)range.max.value.integer);
+    mstream_fmt(
+        ms,
+        "    *value = (%s)p->value.integer_literal;\n"
+        "    return scan_next(p);\n"
+        "}\n\n",
+        column_type(key));
+}
+
+/*!
+ * \brief Writes the batch range check of all constrained columns. The first
+ * loop has no early exit, so it vectorizes. Only if a value is out of range
+ * the second loop finds the first one to report it.
+ */
+static void
+gen_source_columns_check(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    mstream_fmt(
+        ms,
+        "static int %S_columns_check(\n"
+        "    const struct %S_columns* c, int begin, struct c_ini_parser* p)\n"
+        "{\n"
+        "    int i;\n",
+        section->struct_name,
+        section->struct_name);
+    for (key = section->keys; key; key = key->next)
+    {
+        struct attributes range;
+        struct mstream    cond = mstream_init_writeable();
+        const char*       sep = "";
+        double            min, max, type_min, type_max;
+        if (!key_has_column_check(key))
+            continue;
+
+        attributes_set_default_for_type(&range, key->type);
+        if (key->type == CDT_FLOAT)
+        {
+            min = key->attr.min.value.floating;
+            max = key->attr.max.value.floating;
+            type_min = range.min.value.floating;
+            type_max = range.max.value.floating;
+        }
+        else
+        {
+            min = (double)key->attr.min.value.integer;
+            max = (double)key->attr.max.value.integer;
+            type_min = (double)range.min.value.integer;
+            type_max = (double)range.max.value.integer;
         }
+        /* Comparing against the limits of the type would only produce
+         * warnings */
+        if (min != type_min)
+        {
+            mstream_fmt(&cond, "(v[i] < %f)", min);
+            sep = " | ";
+        }
+        if (max != type_max)
+            mstream_fmt(&cond, "%s(v[i] > %f)", sep, max);
+        mstream_putc(&cond, '\0');
+
+        mstream_fmt(
+            ms,
+            "    if (C_INI_FIELD_TEST(c->fields, %U_FIELD_%U))\n"
+            "    {\n"
+            "        const %s* v = c->column.%S;\n"
+            "        %s bad = 0;\n",
+            section->struct_name,
+            key->name,
+            column_type(key),
+            key->name,
+            /* Vectorizers want the flags as wide as the values */
+            key->type == CDT_FLOAT ? "int64_t" : "int");
+        mstream_fmt(
+            ms,
+            "        for (i = begin; i < c->count; ++i)\n"
+            "            bad |= %s;\n"
+            "        if (bad)\n"
+            "            for (i = begin;; ++i)\n"
+            "                if (%s)\n",
+            (const char*)cond.address,
+            (const char*)cond.address);
+        mstream_fmt(
+            ms,
+            "                    return parser_error_in_section(\n"
+            "                        p, \"%S\", i - begin, \"%S\",\n"
+            "                        \"\\\"%S\\\" must be %f to %f\\n\");\n"
+            "    }\n",
+            section->name,
+            key->name,
+            key->name,
+            min,
+            max);
+        free(cond.address);
     }
-    mstream_cstr(ms, "    return 0;\n\n    ");
+    mstream_cstr(ms, "    return 0;\n}\n\n");
+}
+
+static int section_has_column_checks(const struct section* section)
+{
+    const struct key* key;
+    for (key = section->keys; key; key = key->next)
+        if (key_has_column_check(key))
+            return 1;
+    return 0;
+}
+
+static void
+gen_source_columns_alloc(struct mstream* ms, const struct section* section)
+{
+    struct strview    name = section->struct_name;
+    const struct key* key;
+
+    mstream_fmt(
+        ms,
+        "void %S_columns_init(\n"
+        "    struct %S_columns*            c,\n"
+        "    const uint32_t*               fields,\n"
+        "    const struct c_ini_allocator* allocator)\n"
+        "{\n",
+        name,
+        name);
+    for (key = section->keys; key; key = key->next)
+        if (key_is_scalar(key))
+            mstream_fmt(ms, "    c->column.%S = NULL;\n", key->name);
+    mstream_cstr(
+        ms,
+        "    c->count = 0;\n"
+        "    c->capacity = 0;\n"
+        "    if (fields)\n"
+        "        memcpy(c->fields, fields, sizeof(c->fields));\n"
+        "    else\n"
+        "        memset(c->fields, 0xFF, sizeof(c->fields));\n"
+        "    c->allocator = allocator;\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "void %S_columns_deinit(struct %S_columns* c)\n"
+        "{\n"
+        "    const struct c_ini_allocator* a = c->allocator;\n",
+        name,
+        name);
+    for (key = section->keys; key; key = key->next)
+        if (key_is_scalar(key))
+            mstream_fmt(
+                ms,
+                "    if (c->column.%S)\n"
+                "    {\n"
+                "        if (a)\n"
+                "            (a->free)(a->ctx, c->column.%S);\n"
+                "        else\n"
+                "            free(c->column.%S);\n"
+                "        c->column.%S = NULL;\n"
+                "    }\n",
+                key->name,
+                key->name,
+                key->name,
+                key->name);
+    mstream_cstr(
+        ms,
+        "    c->count = 0;\n"
+        "    c->capacity = 0;\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "static void* %S_columns_realloc(\n"
+        "    const struct c_ini_allocator* a, void* ptr, size_t size)\n"
+        "{\n"
+        "    if (a == NULL)\n"
+        "        return realloc(ptr, size);\n"
+        "    if (ptr == NULL)\n"
+        "        return (a->alloc)(a->ctx, size);\n"
+        "    return (a->realloc)(a->ctx, ptr, size);\n"
+        "}\n\n",
+        name);
+    mstream_fmt(
+        ms,
+        "static int %S_columns_grow(struct %S_columns* c)\n"
+        "{\n"
+        "    int   capacity = c->capacity ? c->capacity * 2 : 64;\n"
+        "    void* column;\n",
+        name,
+        name);
+    for (key = section->keys; key; key = key->next)
+        if (key_is_scalar(key))
+            mstream_fmt(
+                ms,
+                "    if (C_INI_FIELD_TEST(c->fields, %U_FIELD_%U))\n"
+                "    {\n"
+                "        column = %S_columns_realloc(\n"
+                "            c->allocator, c->column.%S, "
+                "sizeof(*c->column.%S) * capacity);\n"
+                "        if (column == NULL)\n"
+                "            return -1;\n"
+                "        c->column.%S = column;\n"
+                "    }\n",
+                name,
+                key->name,
+                name,
+                key->name,
+                key->name,
+                key->name);
+    mstream_cstr(
+        ms,
+        "    c->capacity = capacity;\n"
+        "    return 0;\n"
+        "}\n\n");
+}
+
+static void
+gen_column_key_branch(struct mstream* ms, const struct section* section)
+{
+    const struct key* key;
+    mstream_cstr(
+        ms,
+        "                if (!C_INI_FIELD_TEST(c->fields, field))\n"
+        "                    tok = skip_value(p);\n"
+        "                else\n"
+        "                    switch (field)\n"
+        "                    {\n");
+    for (key = section->keys; key; key = key->next)
+        if (key_is_scalar(key))
+            mstream_fmt(
+                ms,
+                "                        case %U_FIELD_%U:\n"
+                "                            tok = parse_%S_column__%S(\n"
+                "                                p, &c->column.%S[row]);\n"
+                "                            break;\n",
+                section->struct_name,
+                key->name,
+                section->struct_name,
+                key->name,
+                key->name);
+    mstream_cstr(
+        ms,
+        "                        default: tok = skip_value(p); break;\n"
+        "                    }\n"
+        "                C_INI_STAT(p, keys, 1);\n");
+}
+
+static void gen_source_columns(struct mstream* ms, const struct section* section)
+{
+    struct strview    name = section->struct_name;
+    const struct key* key;
+
+    if (!section_has_columns(section))
+        return;
+
+    gen_columns_types(ms, section);
+    mstream_cstr(ms, "\n");
+    for (key = section->keys; key; key = key->next)
+        if (key_is_scalar(key))
+            gen_source_parse_column(ms, section, key);
+    gen_source_columns_alloc(ms, section);
+    if (section_has_column_checks(section))
+        gen_source_columns_check(ms, section);
+
+    /* Like _parse_section(), but every section appends a row */
+    mstream_fmt(
+        ms,
+        "static int %S_on_column_section(struct c_ini_parser* p, void* "
+        "user_ptr)\n"
+        "{\n"
+        "    struct %S_columns*   c = user_ptr;\n"
+        "    enum token           tok;\n"
+        "    struct c_ini_strspan key;\n"
+        "    int                  next = 0;\n"
+        "    int                  field;\n"
+        "    int                  row;\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    if (c->count == c->capacity && %S_columns_grow(c) != 0)\n"
+        "        return parser_error(p, \"Failed to allocate columns of "
+        "\\\"%S\\\"\\n\");\n"
+        "    row = c->count++;\n",
+        name,
+        section->name);
+    for (key = section->keys; key; key = key->next)
+    {
+        if (!key_is_scalar(key))
+            continue;
+        mstream_fmt(
+            ms,
+            "    if (C_INI_FIELD_TEST(c->fields, %U_FIELD_%U))\n"
+            "        c->column.%S[row] = ",
+            name,
+            key->name,
+            key->name);
+        if (key->type == CDT_FLOAT)
+            mstream_fmt(ms, "%f;\n", key->attr.default_value.value.floating);
+        else
+            mstream_fmt(
+                ms, "%d;\n", (int)key->attr.default_value.value.integer);
+    }
+    mstream_cstr(
+        ms,
+        "\n"
+        "    tok = scan_next(p);\n"
+        "    while (1)\n"
+        "    {\n"
+        "        if (tok == TOK_ERROR) return TOK_ERROR;\n"
+        "        if (tok == TOK_END) return TOK_END;\n"
+        "        if (tok == TOK_KEY)\n"
+        "        {\n");
+    gen_source_key_dispatch(ms, section, gen_column_key_branch);
+    mstream_cstr(
+        ms,
+        "        }\n"
+        "\n"
+        "        return tok;\n"
+        "    }\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "int %S_parse_all_into_columns(\n"
+        "    struct %S_columns* c,\n"
+        "    const char* filename,\n"
+        "    const char* data,\n"
+        "    int len,\n"
+        "    const struct c_ini_options* opts)\n"
+        "{\n"
+        "    struct c_ini_parser p;\n"
+        "    int                 begin = c->count;\n"
+        "    int                 result;\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    parser_init(&p, filename, data, len, opts);\n"
+        "    result = %S_parse_sections(&p, %S_on_column_section, c);\n",
+        name,
+        name);
+    if (section_has_column_checks(section))
+        mstream_fmt(
+            ms,
+            "    if (result == 0)\n"
+            "        result = %S_columns_check(c, begin, &p);\n",
+            name);
+    mstream_cstr(
+        ms,
+        "    /* A document that fails doesn't add any rows */\n"
+        "    if (result != 0)\n"
+        "        c->count = begin;\n"
+        "    return parser_finish(&p, result);\n"
+        "}\n\n");
+}
+
+static void
+gen_lazy_key_branch(struct mstream* ms, const struct section* section)
+{
+    (void)section;
+    mstream_cstr(
+        ms,
+        "                lazy->offsets[field] = p->head;\n"
+        "                tok = skip_value(p);\n"
+        "                C_INI_STAT(p, keys, 1);\n");
+}
+
+/*!
+ * \brief Writes _parse_lazy(), which only remembers where the value of each
+ * key starts, and the _get_<field>() functions, which parse a value the first
+ * time it is asked for.
+ */
+static void gen_source_lazy(struct mstream* ms, const struct section* section)
+{
+    struct strview    name = section->struct_name;
+    const struct key* key;
+
+    if (section->keys == NULL || !(section->features & FEATURE_LAZY))
+        return;
+
+    gen_lazy_types(ms, section);
+    mstream_cstr(ms, "\n");
+    mstream_fmt(
+        ms,
+        "static int %S_on_lazy_section(struct c_ini_parser* p, void* "
+        "user_ptr)\n"
+        "{\n"
+        "    struct %S_lazy*      lazy = user_ptr;\n"
+        "    enum token           tok;\n"
+        "    struct c_ini_strspan key;\n"
+        "    int                  next = 0;\n"
+        "    int                  field;\n\n"
+        "    tok = scan_next(p);\n"
+        "    while (1)\n"
+        "    {\n"
+        "        if (tok == TOK_ERROR) return TOK_ERROR;\n"
+        "        if (tok == TOK_END) return TOK_END;\n"
+        "        if (tok == TOK_KEY)\n"
+        "        {\n",
+        name,
+        name);
+    gen_source_key_dispatch(ms, section, gen_lazy_key_branch);
+    mstream_cstr(
+        ms,
+        "        }\n"
+        "\n"
+        "        /* Only the first matching section, like _parse() */\n"
+        "        return tok == TOK_ERROR ? TOK_ERROR : TOK_END;\n"
+        "    }\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "int %S_parse_lazy(\n"
+        "    struct %S_lazy* lazy,\n"
+        "    struct %S*      s,\n"
+        "    const char*     filename,\n"
+        "    const char*     data,\n"
+        "    int             len)\n"
+        "{\n"
+        "    struct c_ini_parser p;\n"
+        "    int                 i;\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    lazy->s = s;\n"
+        "    lazy->filename = filename;\n"
+        "    lazy->data = data;\n"
+        "    lazy->len = len;\n"
+        "    for (i = 0; i != %U_FIELDS_COUNT; ++i)\n"
+        "        lazy->offsets[i] = -1;\n"
+        "    memset(lazy->decoded, 0, sizeof(lazy->decoded));\n\n"
+        "    parser_init(&p, filename, data, len, NULL);\n"
+        "    return parser_finish(\n"
+        "        &p, %S_parse_sections(&p, %S_on_lazy_section, lazy));\n"
+        "}\n\n",
+        name,
+        name,
+        name);
 
-    ll_reverse((struct ll**)&section->keys);
+    mstream_fmt(
+        ms,
+        "static int %S_lazy_decode(\n"
+        "    struct %S_lazy* lazy,\n"
+        "    int             field,\n"
+        "    enum token (*parse)(struct c_ini_parser*, struct %S*))\n"
+        "{\n"
+        "    struct c_ini_parser p;\n",
+        name,
+        name,
+        name);
+    mstream_cstr(
+        ms,
+        "    if (C_INI_FIELD_TEST(lazy->decoded, field))\n"
+        "        return 0;\n"
+        "    /* Keys that weren't in the file keep their current value */\n"
+        "    if (lazy->offsets[field] >= 0)\n"
+        "    {\n"
+        "        parser_init(&p, lazy->filename, lazy->data, lazy->len, "
+        "NULL);\n"
+        "        p.head = lazy->offsets[field];\n"
+        "        if (parse(&p, lazy->s) == TOK_ERROR)\n"
+        "            return -1;\n"
+        "    }\n"
+        "    C_INI_FIELD_SET(lazy->decoded, field);\n"
+        "    return 0;\n"
+        "}\n\n");
     for (key = section->keys; key; key = key->next)
+        mstream_fmt(
+            ms,
+            "int %S_get_%S(struct %S_lazy* lazy)\n"
+            "{\n"
+            "    return %S_lazy_decode(lazy, %U_FIELD_%U, parse_%S__%S);\n"
+            "}\n\n",
+            name,
+            key->name,
+            name,
+            name,
+            name,
+            key->name,
+            name,
+            key->name);
+}
+
+/*!
+ * \brief Writes a function that checks the value of a key like
+ * parse_<struct>__<key>() does, but without storing it anywhere.
+ */
+static void gen_source_validate_key(
+    struct mstream* ms, const struct section* section, const struct key* key)
+{
+    mstream_fmt(
+        ms,
+        "static enum token validate_%S__%S(struct c_ini_parser* p)\n"
+        "{\n",
+        section->struct_name,
+        key->name);
+    cdt_switch(key->type)
     {
-        cdt_switch(key->type)
-        {
-            case CDT_UNKNOWN:
-            case CDT_STR_FIXED: break;
-            case CDT_STR_DYNAMIC:
-            case CDT_STR_CUSTOM:
-                if (key->attr.default_value.value.str.len > 0)
-                    mstream_fmt(ms, "%S_set_failed: ", key->name);
-                mstream_fmt(
-                    ms,
-                    "%S_deinit(s->%S);\n    ",
-                    key->attr.str_api_prefix,
-                    key->name);
-                mstream_fmt(ms, "%S_failed: ", key->name);
-                break;
-            case CDT_STRLIST_FIXED: break;
-            case CDT_STRLIST_DYNAMIC:
-            case CDT_STRLIST_CUSTOM:
-                strlist = key->attr.default_value.value.strlist;
-                if (strlist != NULL)
-                    mstream_fmt(ms, "%S_add_failed: ", key->name);
+        case CDT_UNKNOWN: break;
+        case CDT_STR_FIXED:
+            mstream_fmt(
+                ms,
+                "    if (scan_next(p) != TOK_STRING)\n"
+                "        return parser_error(p, \"Expected a string literal "
+                "for %S\\n\");\n",
+                key->name);
+            mstream_fmt(
+                ms,
+                "    if (p->value.string.len >= (int)sizeof(((struct %S*)0)->%S))\n"
+                "        return parser_error(\n"
+                "            p,\n"
+                "            \"\\\"%S\\\" can't be longer than %%d "
+                "characters\\n\",\n"
+                "            (int)sizeof(((struct %S*)0)->%S) - 1);\n"
+                "    return scan_next(p);\n",
+                section->struct_name,
+                key->name,
+                key->name,
+                section->struct_name,
+                key->name);
+            break;
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            mstream_fmt(
+                ms,
+                "    if (scan_next(p) != TOK_STRING)\n"
+                "        return parser_error(p, \"Expected a string literal of "
+                "%S\\n\");\n"
+                "    return scan_next(p);\n",
+                key->name);
+            break;
+        case CDT_STRLIST_FIXED:
+            mstream_fmt(
+                ms,
+                "    enum token tok;\n"
+                "    int        i = 0;\n"
+                "    while (1)\n"
+                "    {\n"
+                "        if (scan_next(p) != TOK_STRING)\n"
+                "            return parser_error(p,"
+                "\"Expected a string literal for %S\\n\");\n",
+                key->name);
+            mstream_fmt(
+                ms,
+                "        if (p->value.string.len > "
+                "(int)sizeof(*((struct %S*)0)->%S))\n"
+                "            return parser_error(\n"
+                "                p,\n"
+                "                \"String literal is too large. Max size is "
+                "%%d bytes.\\n\",\n"
+                "                (int)sizeof(*((struct %S*)0)->%S));\n",
+                section->struct_name,
+                key->name,
+                section->struct_name,
+                key->name);
+            mstream_fmt(
+                ms,
+                "        if (i++ == (int)sizeof(((struct %S*)0)->%S) /\n"
+                "                       (int)sizeof(*((struct %S*)0)->%S))\n"
+                "            return parser_error(\n"
+                "                p, \"Too many strings in list.\\n\");\n",
+                section->struct_name,
+                key->name,
+                section->struct_name,
+                key->name);
+            mstream_cstr(
+                ms,
+                "        tok = scan_next(p);\n"
+                "        if (tok != ',')\n"
+                "            return tok;\n"
+                "    }\n");
+            break;
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            mstream_fmt(
+                ms,
+                "    enum token tok;\n"
+                "    while (1)\n"
+                "    {\n"
+                "        if (scan_next(p) != TOK_STRING)\n"
+                "            return parser_error(p,"
+                "\"Expected a string literal for %S\\n\");\n",
+                key->name);
+            mstream_cstr(
+                ms,
+                "        tok = scan_next(p);\n"
+                "        if (tok != ',')\n"
+                "            return tok;\n"
+                "    }\n");
+            break;
+        case CDT_BOOL:
+        case CDT_I8:
+        case CDT_U8:
+        case CDT_I16:
+        case CDT_U16:
+        case CDT_I32:
+        case CDT_U32:
+            mstream_fmt(
+                ms,
+                "    if (scan_next(p) != TOK_INTEGER)\n"
+                "        return parser_error(p, \"Expected an integer literal "
+                "for %S\\n\");\n",
+                key->name);
+            if (key->type != CDT_U32 && key->type != CDT_I32)
                 mstream_fmt(
                     ms,
-                    "%S_deinit(s->%S);\n    ",
-                    key->attr.strlist_api_prefix,
-                    key->name);
-                mstream_fmt(ms, "%S_failed: ", key->name);
-                break;
-            case CDT_BOOL:
-            case CDT_I8:
-            case CDT_U8:
-            case CDT_I16:
-            case CDT_U16:
-            case CDT_I32:
-            case CDT_U32:
-            case CDT_FLOAT: break;
-            case CDT_BITFIELD: break;
-        }
+                    "    if (p->value.integer_literal < %d || "
+                    "p->value.integer_literal > %d)\n"
+                    "        return parser_error(p, \"\\\"%S\\\" must be "
+                    "%d to %d\\n\");\n",
+                    key->attr.min.value.integer,
+                    key->attr.max.value.integer,
+                    key->name,
+                    key->attr.min.value.integer,
+                    key->attr.max.value.integer);
+            mstream_cstr(ms, "    return scan_next(p);\n");
+            break;
+        case CDT_FLOAT:
+            mstream_fmt(
+                ms,
+                "    double value;\n"
+                "    enum token tok = scan_next(p);\n"
+                "    if (tok != TOK_FLOAT && tok != TOK_INTEGER)\n"
+                "        return parser_error(\n"
+                "            p, \"Expected a floating point literal for "
+                "%S\\n\");\n",
+                key->name);
+            mstream_fmt(
+                ms,
+                "    value = tok == TOK_FLOAT ? p->value.float_literal\n"
+                "                             : "
+                "(double)p->value.integer_literal;\n"
+                "    if (value < %f || value > %f)\n"
+                "        return parser_error(p, \"\\\"%S\\\" must be %f to "
+                "%f\\n\");\n"
+                "    return scan_next(p);\n",
+                key->attr.min.value.floating,
+                key->attr.max.value.floating,
+                key->name,
+                key->attr.min.value.floating,
+                key->attr.max.value.floating);
+            break;
+        case CDT_BITFIELD: break;
     }
-    ll_reverse((struct ll**)&section->keys);
+    mstream_cstr(ms, "}\n\n");
+}
+
+static void
+gen_validate_key_branch(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
+        ms,
+        "                tok = %S_validators[field](p);\n",
+        section->struct_name);
+}
+
+/*!
+ * \brief Writes _validate(), which runs the checks of _parse() on the first
+ * matching section without a struct to write to.
+ */
+static void
+gen_source_validate(struct mstream* ms, const struct section* section)
+{
+    struct strview    name = section->struct_name;
+    const struct key* key;
+
+    if (section->keys == NULL)
+        return;
+
+    for (key = section->keys; key; key = key->next)
+        gen_source_validate_key(ms, section, key);
+    gen_source_key_table(ms, section, "validators", "validate", 0);
+
+    mstream_fmt(
+        ms,
+        "static int %S_on_validate_section(struct c_ini_parser* p, void* "
+        "user_ptr)\n"
+        "{\n"
+        "    enum token           tok;\n"
+        "    struct c_ini_strspan key;\n"
+        "    int                  next = 0;\n"
+        "    int                  field;\n\n"
+        "    (void)user_ptr;\n"
+        "    tok = scan_next(p);\n"
+        "    while (1)\n"
+        "    {\n"
+        "        if (tok == TOK_ERROR) return TOK_ERROR;\n"
+        "        if (tok == TOK_END) return TOK_END;\n"
+        "        if (tok == TOK_KEY)\n"
+        "        {\n",
+        name);
+    gen_source_key_dispatch(ms, section, gen_validate_key_branch);
+    mstream_cstr(
+        ms,
+        "        }\n"
+        "\n"
+        "        return tok == TOK_ERROR ? TOK_ERROR : TOK_END;\n"
+        "    }\n"
+        "}\n\n");
+
+    mstream_fmt(
+        ms,
+        "int %S_validate(const char* data, int len, struct c_ini_error* "
+        "error)\n"
+        "{\n"
+        "    struct c_ini_parser p;\n"
+        "    struct c_ini_error  ignored;\n\n"
+        "    parser_init(&p, NULL, data, len, NULL);\n"
+        "    p.error = error ? error : &ignored;\n"
+        "    p.error->offset = -1;\n"
+        "    return parser_finish(\n"
+        "        &p, %S_parse_sections(&p, %S_on_validate_section, NULL));\n"
+        "}\n\n",
+        name,
+        name,
+        name);
+}
+
+static void
+gen_layer_key_branch(struct mstream* ms, const struct section* section)
+{
+    mstream_fmt(
+        ms,
+        "                C_INI_HOOK(p, key_begin, %S_keys[field].name);\n"
+        "                if (C_INI_FIELD_TEST(target->set, field))\n"
+        "                    tok = skip_value(p);\n"
+        "                else\n"
+        "                {\n"
+        "                    tok = %S_parsers[field](p, target->s);\n",
+        section->struct_name,
+        section->struct_name);
+    mstream_fmt(
+        ms,
+        "                    C_INI_FIELD_SET(target->layer, field);\n"
+        "                    if (p->dirty)\n"
+        "                        C_INI_FIELD_SET(p->dirty, field);\n"
+        "                }\n"
+        "                C_INI_HOOK(p, key_end, %S_keys[field].name);\n"
+        "                C_INI_STAT(p, keys, 1);\n",
+        section->struct_name);
+}
+
+/*!
+ * \brief Writes _parse_layers(), which parses a stack of documents from the
+ * highest priority to the lowest. Keys that a higher layer already set are
+ * only tokenized, and layers below the one that set the last field are never
+ * looked at.
+ */
+static void
+gen_source_layers(struct mstream* ms, const struct section* section)
+{
+    struct strview name = section->struct_name;
+
+    if (section->keys == NULL || !(section->features & FEATURE_LAYERS))
+        return;
+
+    mstream_fmt(
+        ms,
+        "struct %S_layer_target\n"
+        "{\n"
+        "    struct %S* s;\n"
+        "    /* Fields set by higher layers, and by the current one */\n"
+        "    uint32_t set[C_INI_FIELD_WORDS(%U_FIELDS_COUNT)];\n"
+        "    uint32_t layer[C_INI_FIELD_WORDS(%U_FIELDS_COUNT)];\n"
+        "};\n\n",
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "static int %S_on_layer_section(struct c_ini_parser* p, void* "
+        "user_ptr)\n"
+        "{\n"
+        "    struct %S_layer_target* target = user_ptr;\n"
+        "    enum token              tok;\n"
+        "    struct c_ini_strspan    key;\n"
+        "    int                     next = 0;\n"
+        "    int                     field;\n\n",
+        name,
+        name);
+    mstream_cstr(
+        ms,
+        "    tok = scan_next(p);\n"
+        "    while (1)\n"
+        "    {\n"
+        "        if (tok == TOK_ERROR) return TOK_ERROR;\n"
+        "        if (tok == TOK_END) return TOK_END;\n"
+        "        if (tok == TOK_KEY)\n"
+        "        {\n");
+    gen_source_key_dispatch(ms, section, gen_layer_key_branch);
+    mstream_cstr(
+        ms,
+        "        }\n"
+        "\n"
+        "        /* Only the first matching section, like _parse() */\n"
+        "        return tok == TOK_ERROR ? TOK_ERROR : TOK_END;\n"
+        "    }\n"
+        "}\n\n");
 
-    mstream_cstr(ms, "return -1;\n}\n\n");
+    mstream_fmt(
+        ms,
+        "int %S_parse_layers_opts(\n"
+        "    struct %S* s,\n"
+        "    const char** filenames,\n"
+        "    const char** data,\n"
+        "    const int* lens,\n"
+        "    int n,\n"
+        "    const struct c_ini_options* opts)\n"
+        "{\n"
+        "    struct %S_layer_target target;\n"
+        "    struct c_ini_parser     p;\n"
+        "    int                     i, field;\n\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    target.s = s;\n"
+        "    memset(target.set, 0, sizeof(target.set));\n"
+        "    while (n--)\n"
+        "    {\n"
+        "        memset(target.layer, 0, sizeof(target.layer));\n"
+        "        parser_init(&p, filenames[n], data[n], lens[n], opts);\n"
+        "        if (parser_finish(\n"
+        "                &p, %S_parse_sections(&p, %S_on_layer_section, "
+        "&target)) != 0)\n"
+        "            return -1;\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "        /* Duplicate keys within a layer behave like in _parse() */\n"
+        "        for (i = 0; i != (int)(sizeof(target.set) / "
+        "sizeof(*target.set)); ++i)\n"
+        "            target.set[i] |= target.layer[i];\n"
+        "        for (field = 0; field != %U_FIELDS_COUNT; ++field)\n"
+        "            if (!C_INI_FIELD_TEST(target.set, field))\n"
+        "                break;\n"
+        "        if (field == %U_FIELDS_COUNT)\n"
+        "            break;\n"
+        "    }\n\n"
+        "    return 0;\n"
+        "}\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_parse_layers(\n"
+        "    struct %S* s,\n"
+        "    const char** filenames,\n"
+        "    const char** data,\n"
+        "    const int* lens,\n"
+        "    int n)\n"
+        "{\n"
+        "    return %S_parse_layers_opts(s, filenames, data, lens, n, NULL);\n"
+        "}\n\n",
+        name,
+        name,
+        name);
 }
 
-static void gen_source_deinit(struct mstream* ms, const struct section* section)
+/*!
+ * \brief Writes the watch functions. Subscriptions are owned by the caller and
+ * kept in a list in the order they were added, so subscribing never
+ * allocates.
+ */
+static void gen_source_watch(struct mstream* ms, const struct section* section)
 {
-    const struct key* key;
+    struct strview name = section->struct_name;
+
+    if (section->keys == NULL || !(section->features & FEATURE_WATCH))
+        return;
+
+    gen_watch_types(ms, section);
+    mstream_cstr(ms, "\n");
     mstream_fmt(
         ms,
-        "void %S_deinit(struct %S* s)\n{\n",
-        section->struct_name,
-        section->struct_name);
-    mstream_cstr(ms, "    (void)s;\n");
-    for (key = section->keys; key; key = key->next)
-    {
-        cdt_switch(key->type)
-        {
-            case CDT_UNKNOWN: break;
-            case CDT_STR_FIXED: break;
-            case CDT_STR_DYNAMIC:
-            case CDT_STR_CUSTOM:
-                mstream_fmt(
-                    ms,
-                    "    %S_deinit(s->%S);\n",
-                    key->attr.str_api_prefix,
-                    key->name);
-                break;
-            case CDT_STRLIST_FIXED: break;
-            case CDT_STRLIST_DYNAMIC:
-            case CDT_STRLIST_CUSTOM:
-                mstream_fmt(
-                    ms,
-                    "    %S_deinit(s->%S);\n",
-                    key->attr.strlist_api_prefix,
-                    key->name);
-                break;
-            case CDT_BOOL:
-            case CDT_I8:
-            case CDT_U8:
-            case CDT_I16:
-            case CDT_U16:
-            case CDT_I32:
-            case CDT_U32: break;
-            case CDT_FLOAT: break;
-            case CDT_BITFIELD: break;
-        }
-    }
-    mstream_cstr(ms, "}\n\n");
+        "void %S_watch_init(struct %S_watch* w, struct %S* s)\n"
+        "{\n"
+        "    w->s = s;\n"
+        "    memset(w->dirty, 0, sizeof(w->dirty));\n"
+        "    w->subscriptions = NULL;\n"
+        "}\n\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "void %S_subscribe(\n"
+        "    struct %S_watch*        w,\n"
+        "    struct %S_subscription* sub,\n"
+        "    const uint32_t*         fields,\n"
+        "    void (*on_change)(struct %S* s, const uint32_t* dirty, "
+        "void* user_ptr),\n"
+        "    void* user_ptr)\n"
+        "{\n"
+        "    struct %S_subscription** link = &w->subscriptions;\n",
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_cstr(
+        ms,
+        "    if (fields)\n"
+        "        memcpy(sub->fields, fields, sizeof(sub->fields));\n"
+        "    else\n"
+        "        memset(sub->fields, 0xff, sizeof(sub->fields));\n"
+        "    sub->on_change = on_change;\n"
+        "    sub->user_ptr = user_ptr;\n"
+        "    sub->next = NULL;\n"
+        "    while (*link)\n"
+        "        link = &(*link)->next;\n"
+        "    *link = sub;\n"
+        "}\n\n");
+    mstream_fmt(
+        ms,
+        "void %S_unsubscribe(struct %S_watch* w, struct %S_subscription* sub)\n"
+        "{\n"
+        "    struct %S_subscription** link = &w->subscriptions;\n"
+        "    while (*link && *link != sub)\n"
+        "        link = &(*link)->next;\n"
+        "    if (*link)\n"
+        "        *link = sub->next;\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "void %S_watch_notify(struct %S_watch* w)\n"
+        "{\n"
+        "    uint32_t dirty[C_INI_FIELD_WORDS(%U_FIELDS_COUNT)];\n"
+        "    struct %S_subscription* sub;\n"
+        "    struct %S_subscription* next;\n"
+        "    int i;\n\n"
+        "    memcpy(dirty, w->dirty, sizeof(dirty));\n"
+        "    memset(w->dirty, 0, sizeof(w->dirty));\n",
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    /* Callbacks may unsubscribe themselves */\n"
+        "    for (sub = w->subscriptions; sub; sub = next)\n"
+        "    {\n"
+        "        next = sub->next;\n"
+        "        for (i = 0; i != C_INI_FIELD_WORDS(%U_FIELDS_COUNT); ++i)\n"
+        "            if (sub->fields[i] & dirty[i])\n"
+        "            {\n"
+        "                sub->on_change(w->s, dirty, sub->user_ptr);\n"
+        "                break;\n"
+        "            }\n"
+        "    }\n"
+        "}\n\n",
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_watch_parse_opts(\n"
+        "    struct %S_watch*            w,\n"
+        "    const char*                 filename,\n"
+        "    const char*                 data,\n"
+        "    int                         len,\n"
+        "    const struct c_ini_options* opts)\n"
+        "{\n"
+        "    struct c_ini_options watch_opts;\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    if (opts)\n"
+        "        watch_opts = *opts;\n"
+        "    else\n"
+        "        memset(&watch_opts, 0, sizeof(watch_opts));\n"
+        "    watch_opts.dirty = w->dirty;\n"
+        "    if (%S_parse_opts(w->s, filename, data, len, &watch_opts) != 0)\n"
+        "        return -1;\n"
+        "    %S_watch_notify(w);\n"
+        "    return 0;\n"
+        "}\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_watch_parse(\n"
+        "    struct %S_watch* w, const char* filename, const char* data, "
+        "int len)\n"
+        "{\n"
+        "    return %S_watch_parse_opts(w, filename, data, len, NULL);\n"
+        "}\n\n",
+        name,
+        name,
+        name);
 }
 
-static void gen_source_fwrite(struct mstream* ms, const struct section* section)
+/*!
+ * \brief Writes the snapshot handle. Readers announce the epoch they started
+ * in before loading the current snapshot, so a snapshot that was replaced in
+ * epoch N can be freed once no reader is in an epoch before N. Readers never
+ * wait, the single writer frees what it can after each publish.
+ */
+static void
+gen_source_handle(struct mstream* ms, const struct section* section)
 {
-    const struct key* key;
-    struct strview    api;
+    struct strview name = section->struct_name;
+
+    if (section->keys == NULL || !(section->features & FEATURE_HANDLE))
+        return;
 
+    gen_handle_types(ms, section);
     mstream_fmt(
         ms,
-        "int %S_fwrite(const struct %S* s, FILE* f)\n{\n",
-        section->struct_name,
-        section->struct_name);
-    mstream_cstr(ms, "    char** list;\n");
-    mstream_cstr(ms, "    int i;\n");
-    mstream_cstr(ms, "    (void)list, (void)i;\n");
-    mstream_fmt(ms, "    fprintf(f, \"[%S]\\n\");\n", section->name);
-    for (key = section->keys; key; key = key->next)
-    {
-        cdt_switch(key->type)
-        {
-            case CDT_UNKNOWN: break;
-            case CDT_STR_FIXED:
-                mstream_fmt(
-                    ms,
-                    "    fprintf(f, \"%S = \\\"%%s\\\"\\n\", s->%S);\n",
-                    key->name,
-                    key->name);
-                break;
-            case CDT_STR_DYNAMIC:
-            case CDT_STR_CUSTOM:
-                mstream_fmt(
-                    ms,
-                    "    fprintf(f, \"%S = \\\"%%.*s\\\"\\n\", "
-                    "%S_len(s->%S), %S_data(s->%S));\n",
-                    key->name,
-                    key->attr.str_api_prefix,
-                    key->name,
-                    key->attr.str_api_prefix,
-                    key->name);
-                break;
-            case CDT_STRLIST_FIXED:
-                mstream_fmt(ms, "    if (s->%S[0][0] != '\\0')\n", key->name);
-                mstream_fmt(ms, "        fprintf(f, \"%S = \");\n", key->name);
-                mstream_fmt(
-                    ms,
-                    "    for (i = 0; i < (int)sizeof(s->%S) / "
-                    "(int)sizeof(*s->%S) && *s->%S[i]; ++i)\n"
-                    "    {\n"
-                    "        if (i != 0) fprintf(f, \", \");\n"
-                    "        fprintf(f, \"\\\"%%s\\\"\", s->%S[i]);\n"
-                    "    }\n",
-                    key->name,
-                    key->name,
-                    key->name,
-                    key->name);
-                mstream_fmt(ms, "    if (s->%S[0][0] != '\\0')\n", key->name);
-                mstream_fmt(ms, "        fprintf(f, \"\\n\");\n", key->name);
-                break;
-            case CDT_STRLIST_DYNAMIC:
-            case CDT_STRLIST_CUSTOM:
-                api = key->attr.strlist_api_prefix;
-                mstream_fmt(
-                    ms, "    if (%S_count(s->%S) > 0)\n", api, key->name);
-                mstream_fmt(ms, "        fprintf(f, \"%S = \");\n", key->name);
-                mstream_fmt(
-                    ms,
-                    "    for (i = 0; i != %S_count(s->%S); ++i)\n"
-                    "    {\n"
-                    "        if (i) fprintf(f, \", \");\n"
-                    "        fprintf(f, \"\\\"%%s\\\"\", %S_cstr(s->%S, i));\n"
-                    "    }\n",
-                    api,
-                    key->name,
-                    api,
-                    key->name);
-                mstream_fmt(
-                    ms, "    if (%S_count(s->%S) > 0)\n", api, key->name);
-                mstream_cstr(ms, "        fprintf(f, \"\\n\");\n");
-                break;
-            case CDT_BOOL:
-                mstream_fmt(
-                    ms,
-                    "    fprintf(f, \"%S = %%s\\n\", "
-                    "s->%S ? \"true\" : \"false\");\n",
-                    key->name,
-                    key->name);
-                break;
-            case CDT_I8:
-            case CDT_U8:
-            case CDT_I16:
-            case CDT_U16:
-            case CDT_I32:
-            case CDT_U32:
-                mstream_fmt(
-                    ms,
-                    "    fprintf(f, \"%S = %%d\\n\", s->%S);\n",
-                    key->name,
-                    key->name);
-                break;
-            case CDT_FLOAT:
-                mstream_fmt(
-                    ms,
-                    "    fprintf(f, \"%S = %%.9g\\n\", s->%S);\n",
-                    key->name,
-                    key->name);
-                break;
-            case CDT_BITFIELD: break;
-        }
-    }
-    mstream_cstr(ms, "    fprintf(f, \"\\n\");\n");
-    mstream_cstr(ms, "    return 0;\n}\n\n");
+        "\n"
+        "struct %S_snapshot\n"
+        "{\n"
+        "    struct %S                     data;\n"
+        "    const struct c_ini_allocator* allocator;\n"
+        "    /* Epoch the snapshot was replaced in */\n"
+        "    uint32_t                      retired;\n"
+        "    struct %S_snapshot*           next;\n"
+        "};\n\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "static struct %S_snapshot* %S_snapshot_new(void)\n"
+        "{\n"
+        "    const struct c_ini_allocator* a = %S_allocator;\n"
+        "    struct %S_snapshot*           snapshot =\n"
+        "        a ? a->alloc(a->ctx, sizeof(*snapshot))\n"
+        "          : malloc(sizeof(*snapshot));\n"
+        "    if (snapshot == NULL)\n"
+        "        return NULL;\n",
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    snapshot->allocator = a;\n"
+        "    snapshot->next = NULL;\n"
+        "    if (%S_init(&snapshot->data) != 0)\n"
+        "    {\n"
+        "        if (a) a->free(a->ctx, snapshot);\n"
+        "        else free(snapshot);\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    return snapshot;\n"
+        "}\n\n",
+        name);
+    mstream_fmt(
+        ms,
+        "static void %S_snapshot_free(struct %S_snapshot* snapshot)\n"
+        "{\n"
+        "    const struct c_ini_allocator* a = snapshot->allocator;\n"
+        "    %S_deinit(&snapshot->data);\n"
+        "    if (a) a->free(a->ctx, snapshot);\n"
+        "    else free(snapshot);\n"
+        "}\n\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_handle_reclaim(struct %S_handle* h)\n"
+        "{\n"
+        "    struct %S_snapshot** link = &h->retired;\n"
+        "    struct %S_snapshot*  snapshot;\n"
+        "    uint32_t             oldest = C_INI_LOAD_U32(&h->epoch);\n"
+        "    uint32_t             epoch;\n"
+        "    int                  i, pending = 0;\n\n",
+        name,
+        name,
+        name,
+        name);
+    mstream_cstr(
+        ms,
+        "    for (i = 0; i != C_INI_MAX_READERS; ++i)\n"
+        "    {\n"
+        "        epoch = C_INI_LOAD_U32(&h->readers[i].epoch);\n"
+        "        if (epoch != 0 && epoch < oldest)\n"
+        "            oldest = epoch;\n"
+        "    }\n"
+        "    while ((snapshot = *link) != NULL)\n"
+        "    {\n"
+        "        if (snapshot->retired <= oldest)\n"
+        "        {\n"
+        "            *link = snapshot->next;\n");
+    mstream_fmt(
+        ms,
+        "            %S_snapshot_free(snapshot);\n"
+        "        }\n"
+        "        else\n"
+        "        {\n"
+        "            link = &snapshot->next;\n"
+        "            pending++;\n"
+        "        }\n"
+        "    }\n"
+        "    return pending;\n"
+        "}\n\n",
+        name);
+    mstream_fmt(
+        ms,
+        "static void %S_handle_swap(\n"
+        "    struct %S_handle* h, struct %S_snapshot* snapshot)\n"
+        "{\n"
+        "    struct %S_snapshot* old = C_INI_EXCHANGE_PTR(&h->current, "
+        "snapshot);\n"
+        "    /* Readers that see the new epoch also see the new snapshot */\n"
+        "    old->retired = h->epoch + 1;\n"
+        "    C_INI_STORE_U32(&h->epoch, old->retired);\n"
+        "    old->next = h->retired;\n"
+        "    h->retired = old;\n"
+        "    %S_handle_reclaim(h);\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_handle_init(struct %S_handle* h)\n"
+        "{\n"
+        "    memset(h, 0, sizeof(*h));\n"
+        "    h->epoch = 1;\n"
+        "    h->current = %S_snapshot_new();\n"
+        "    return h->current ? 0 : -1;\n"
+        "}\n\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "void %S_handle_deinit(struct %S_handle* h)\n"
+        "{\n"
+        "    struct %S_snapshot* next;\n"
+        "    if (h->current)\n"
+        "        %S_snapshot_free(h->current);\n"
+        "    for (; h->retired; h->retired = next)\n"
+        "    {\n"
+        "        next = h->retired->next;\n"
+        "        %S_snapshot_free(h->retired);\n"
+        "    }\n"
+        "    h->current = NULL;\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_handle_publish(struct %S_handle* h, struct %S* s)\n"
+        "{\n"
+        "    struct %S_snapshot* snapshot = %S_snapshot_new();\n"
+        "    if (snapshot == NULL)\n"
+        "        return -1;\n"
+        "    if (%S_move(&snapshot->data, s) != 0)\n"
+        "    {\n"
+        "        %S_snapshot_free(snapshot);\n"
+        "        return -1;\n"
+        "    }\n"
+        "    %S_handle_swap(h, snapshot);\n"
+        "    return 0;\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_handle_parse_opts(\n"
+        "    struct %S_handle*           h,\n"
+        "    const char*                 filename,\n"
+        "    const char*                 data,\n"
+        "    int                         len,\n"
+        "    const struct c_ini_options* opts)\n"
+        "{\n"
+        "    struct %S_snapshot* snapshot = %S_snapshot_new();\n"
+        "    if (snapshot == NULL)\n"
+        "        return -1;\n",
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "    if (%S_parse_opts(&snapshot->data, filename, data, len, opts) "
+        "!= 0)\n"
+        "    {\n"
+        "        %S_snapshot_free(snapshot);\n"
+        "        return -1;\n"
+        "    }\n"
+        "    %S_handle_swap(h, snapshot);\n"
+        "    return 0;\n"
+        "}\n\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_handle_parse(\n"
+        "    struct %S_handle* h, const char* filename, const char* data, "
+        "int len)\n"
+        "{\n"
+        "    return %S_handle_parse_opts(h, filename, data, len, NULL);\n"
+        "}\n\n",
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "int %S_handle_register(struct %S_handle* h)\n"
+        "{\n"
+        "    int i;\n"
+        "    for (i = 0; i != C_INI_MAX_READERS; ++i)\n"
+        "        if (C_INI_CAS_U32(&h->readers[i].used, 0, 1))\n"
+        "            return i;\n"
+        "    return -1;\n"
+        "}\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "void %S_handle_unregister(struct %S_handle* h, int reader)\n"
+        "{\n"
+        "    C_INI_STORE_U32(&h->readers[reader].epoch, 0);\n"
+        "    C_INI_STORE_U32(&h->readers[reader].used, 0);\n"
+        "}\n\n",
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "const struct %S* %S_handle_read_lock(struct %S_handle* h, "
+        "int reader)\n"
+        "{\n"
+        "    struct %S_snapshot* snapshot;\n"
+        "    C_INI_STORE_U32(&h->readers[reader].epoch, "
+        "C_INI_LOAD_U32(&h->epoch));\n"
+        "    snapshot = C_INI_LOAD_PTR(&h->current);\n"
+        "    return &snapshot->data;\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        name);
+    mstream_fmt(
+        ms,
+        "void %S_handle_read_unlock(struct %S_handle* h, int reader)\n"
+        "{\n"
+        "    C_INI_STORE_U32(&h->readers[reader].epoch, 0);\n"
+        "}\n\n",
+        name,
+        name);
 }
 
-static void gen_source_parse_key(
-    struct mstream* ms, const struct section* section, const struct key* key)
+/*!
+ * \brief Writes the functions that create and map POSIX shared memory. They
+ * are only compiled with C_INI_SHM defined, because they aren't standard C.
+ */
+static void
+gen_source_shm_posix(struct mstream* ms, const struct section* section)
 {
-    struct strview api;
+    struct strview name = section->struct_name;
+
+    mstream_cstr(ms, "#if defined(C_INI_SHM)\n");
     mstream_fmt(
         ms,
-        "static enum token parse_%S__%S(\n"
-        "    struct c_ini_parser* p, struct %S* s)\n"
-        "{\n",
-        section->struct_name,
-        key->name,
-        section->struct_name);
+        "struct c_ini_shm* %S_shm_create(const char* name, size_t capacity)\n"
+        "{\n"
+        "    struct c_ini_shm* shm;\n"
+        "    struct stat       st;\n"
+        "    void*             mem;\n"
+        "    uint32_t          sequence;\n"
+        "    int               fd = shm_open(name, O_CREAT | O_RDWR, 0644);\n"
+        "    if (fd < 0)\n"
+        "        return NULL;\n",
+        name);
+    mstream_cstr(
+        ms,
+        "    /* Readers that have it mapped would fault if it shrank */\n"
+        "    if (fstat(fd, &st) != 0 ||\n"
+        "        (st.st_size != 0 && (size_t)st.st_size != capacity) ||\n"
+        "        (st.st_size == 0 && ftruncate(fd, (off_t)capacity) != 0))\n"
+        "    {\n"
+        "        close(fd);\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    mem = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, "
+        "fd, 0);\n"
+        "    close(fd);\n"
+        "    if (mem == MAP_FAILED)\n"
+        "        return NULL;\n\n");
+    mstream_cstr(
+        ms,
+        "    /* The image of a publisher that restarted is kept, so readers\n"
+        "     * never see the sequence go back. If it crashed while publishing\n"
+        "     * the sequence is still odd and the image may be half written,\n"
+        "     * so it is dropped and the sequence made even again */\n"
+        "    shm = mem;\n"
+        "    if (shm->magic == C_INI_SHM_MAGIC && shm->capacity == capacity)\n"
+        "    {\n");
+    mstream_fmt(
+        ms,
+        "        sequence = C_INI_LOAD_U32(&shm->sequence);\n"
+        "        if (sequence & 1)\n"
+        "        {\n"
+        "            shm->layout = 0;\n"
+        "            shm->size = sizeof(*shm);\n"
+        "            C_INI_STORE_U32(&shm->sequence, sequence + 1);\n"
+        "        }\n"
+        "        return shm;\n"
+        "    }\n"
+        "    shm = %S_shm_init(mem, capacity);\n"
+        "    if (shm == NULL)\n"
+        "        munmap(mem, capacity);\n"
+        "    return shm;\n"
+        "}\n\n",
+        name);
+    mstream_fmt(
+        ms,
+        "const struct c_ini_shm* %S_shm_open(const char* name)\n"
+        "{\n"
+        "    const struct c_ini_shm* shm;\n"
+        "    struct stat             st;\n"
+        "    void*                   mem;\n"
+        "    int                     fd = shm_open(name, O_RDONLY, 0);\n"
+        "    if (fd < 0)\n"
+        "        return NULL;\n"
+        "    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*shm))\n"
+        "    {\n"
+        "        close(fd);\n"
+        "        return NULL;\n"
+        "    }\n",
+        name);
+    mstream_cstr(
+        ms,
+        "    mem = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, "
+        "0);\n"
+        "    close(fd);\n"
+        "    if (mem == MAP_FAILED)\n"
+        "        return NULL;\n"
+        "    /* The publisher may not have initialized it yet */\n"
+        "    shm = mem;\n"
+        "    if (shm->magic != C_INI_SHM_MAGIC ||\n"
+        "        shm->capacity != (size_t)st.st_size)\n"
+        "    {\n"
+        "        munmap(mem, (size_t)st.st_size);\n"
+        "        return NULL;\n"
+        "    }\n"
+        "    return shm;\n"
+        "}\n\n");
+    mstream_fmt(
+        ms,
+        "void %S_shm_close(const struct c_ini_shm* shm)\n"
+        "{\n"
+        "    munmap((void*)shm, shm->capacity);\n"
+        "}\n"
+        "#endif\n\n",
+        name);
+}
+
+/*! Adds the bytes a string or list field takes up in the image to "size" */
+static void gen_source_shm_size_key(struct mstream* ms, const struct key* key)
+{
+    struct strview api;
+
     cdt_switch(key->type)
     {
-        case CDT_UNKNOWN: break;
         case CDT_STR_FIXED:
+            mstream_fmt(ms, "    size += strlen(s->%S) + 1;\n", key->name);
+            break;
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
             mstream_fmt(
                 ms,
-                "    struct c_ini_strspan value;\n"
-                "    if (scan_next(p) != TOK_STRING)\n"
-                "        return parser_error(p, \"Expected a string literal "
-                "for %S\\n\");\n",
+                "    size += %S_len(s->%S) + 1;\n",
+                key->attr.str_api_prefix,
                 key->name);
+            break;
+        case CDT_STRLIST_FIXED:
+            /* The table of a list is aligned and has room for the count */
             mstream_fmt(
                 ms,
-                "    value = p->value.string;\n\n"
-                "    if (value.len >= (int)sizeof(s->%S))\n"
-                "        return parser_error(\n"
-                "            p,\n"
-                "            \"\\\"%S\\\" can't be longer than %%d "
-                "characters\\n\",\n"
-                "            (int)sizeof(s->%S) - 1);\n\n",
+                "    size += 3 + 4;\n"
+                "    for (i = 0; i < (int)(sizeof(s->%S) / sizeof(*s->%S)) && "
+                "*s->%S[i]; ++i)\n"
+                "        size += 4 + strlen(s->%S[i]) + 1;\n",
+                key->name,
                 key->name,
                 key->name,
                 key->name);
+            break;
+        case CDT_STRLIST_DYNAMIC:
+        case CDT_STRLIST_CUSTOM:
+            api = key->attr.strlist_api_prefix;
             mstream_fmt(
                 ms,
-                "    memcpy(s->%S, p->source + value.off, value.len);\n"
-                "    s->%S[value.len] = '\\0';\n\n"
-                "    return scan_next(p);\n",
+                "    size += 3 + 4;\n"
+                "    for (i = 0; i != %S_count(s->%S); ++i)\n"
+                "        size += 4 + strlen(%S_cstr(s->%S, i)) + 1;\n",
+                api,
                 key->name,
+                api,
                 key->name);
             break;
-        case CDT_STR_DYNAMIC:
-        case CDT_STR_CUSTOM:
+        default: break;
+    }
+}
+
+static void gen_source_shm_put_key(struct mstream* ms, const struct key* key)
+{
+    struct strview api;
+
+    if (key_is_scalar(key))
+        mstream_fmt(ms, "    image->%S = s->%S;\n", key->name, key->name);
+    cdt_switch(key->type)
+    {
+        case CDT_STR_FIXED:
             mstream_fmt(
                 ms,
-                "    if (scan_next(p) != TOK_STRING)\n"
-                "        return parser_error(p, \"Expected a string literal of "
-                "%S\\n\");\n\n",
+                "    c_ini_shm_put(shm, &off, &image->%S, s->%S, "
+                "(int)strlen(s->%S));\n",
+                key->name,
+                key->name,
                 key->name);
+            break;
+        case CDT_STR_DYNAMIC:
+        case CDT_STR_CUSTOM:
+            api = key->attr.str_api_prefix;
             mstream_fmt(
                 ms,
-                "    if (%S_set(&s->%S, p->source + p->value.string.off, "
-                "p->value.string.len) != 0)\n"
-                "        return TOK_ERROR;\n\n"
-                "    return scan_next(p);\n",
-                key->attr.str_api_prefix,
+                "    c_ini_shm_put(\n"
+                "        shm, &off, &image->%S, %S_data(s->%S), "
+                "%S_len(s->%S));\n",
+                key->name,
+                api,
+                key->name,
+                api,
                 key->name);
             break;
         case CDT_STRLIST_FIXED:
             mstream_fmt(
                 ms,
-                "    enum token tok;\n"
-                "    int        i = 0;\n"
-                "    while (1)\n"
-                "    {\n"
-                "        if (scan_next(p) != TOK_STRING)\n"
-                "            return parser_error(p,"
-                "\"Expected a string literal for %S\\n\");\n\n",
-                key->name);
-            mstream_fmt(
-                ms,
-                "        if (p->value.string.len > (int)sizeof(*s->%S))\n"
-                "            return parser_error(\n"
-                "                p,\n"
-                "                \"String literal is too large. Max size is "
-                "%%d bytes.\\n\",\n"
-                "                sizeof(*s->%S));\n",
+                "    i = 0;\n"
+                "    while (i < (int)(sizeof(s->%S) / sizeof(*s->%S)) && "
+                "*s->%S[i])\n"
+                "        i++;\n"
+                "    items = c_ini_shm_table(shm, &off, &image->%S, i);\n",
                 key->name,
-                key->name);
-            mstream_fmt(
-                ms,
-                "        if (i > (int)sizeof(s->%S) / (int)sizeof(*s->%S))\n"
-                "            return parser_error(\n"
-                "                p, \"Too many strings in list. Max size is "
-                "%%d strings.\\n\");\n\n",
                 key->name,
-                key->name);
-            mstream_fmt(
-                ms,
-                "        memcpy(\n"
-                "            s->%S[i],\n"
-                "            p->source + p->value.string.off,\n"
-                "            p->value.string.len);\n"
-                "        s->%S[i++][p->value.string.len] = '\\0';\n",
                 key->name,
                 key->name);
-            mstream_cstr(
-                ms,
-                "        tok = scan_next(p);\n"
-                "        if (tok != ',')\n"
-                "            break;\n"
-                "    }\n\n");
             mstream_fmt(
                 ms,
-                "    while (i != (int)sizeof(s->%S) / (int)sizeof(*s->%S))\n"
-                "        s->%S[i++][0] = '\\0';\n\n"
-                "    return tok;\n",
+                "    for (i = 0; i < (int)(sizeof(s->%S) / sizeof(*s->%S)) && "
+                "*s->%S[i]; ++i)\n"
+                "        c_ini_shm_put(\n"
+                "            shm, &off, &items[i], s->%S[i], "
+                "(int)strlen(s->%S[i]));\n",
+                key->name,
+                key->name,
                 key->name,
                 key->name,
                 key->name);
@@ -3148,277 +9227,259 @@ static void gen_source_parse_key(
             api = key->attr.strlist_api_prefix;
             mstream_fmt(
                 ms,
-                "    enum token tok;\n"
-                "    %S_clear(s->%S);\n",
+                "    items = c_ini_shm_table(shm, &off, &image->%S, "
+                "%S_count(s->%S));\n"
+                "    for (i = 0; i != %S_count(s->%S); ++i)\n",
+                key->name,
                 api,
-                key->name);
-            mstream_fmt(
-                ms,
-                "    while (1)\n"
-                "    {\n"
-                "        if (scan_next(p) != TOK_STRING)\n"
-                "            return parser_error(p,"
-                "\"Expected a string literal for %S\\n\");\n\n",
-                key->name);
-            mstream_fmt(
-                ms,
-                "        if (%S_add(&s->%S, p->source + p->value.string.off, "
-                "p->value.string.len) != 0)\n"
-                "            return -1;\n",
+                key->name,
                 api,
                 key->name);
-            mstream_cstr(
-                ms,
-                "        tok = scan_next(p);\n"
-                "        if (tok != ',')\n"
-                "            break;\n"
-                "    }\n\n"
-                "    return tok;\n");
-            break;
-        case CDT_BOOL:
-        case CDT_I8:
-        case CDT_U8:
-        case CDT_I16:
-        case CDT_U16:
-        case CDT_I32:
-        case CDT_U32:
-            mstream_fmt(
-                ms,
-                "    if (scan_next(p) != TOK_INTEGER)\n"
-                "        return parser_error(p, \"Expected an integer literal "
-                "for %S\\n\");\n\n",
-                key->name);
-
-            if (key->type != CDT_U32 && key->type != CDT_I32)
-                mstream_fmt(
-                    ms,
-                    "    if (p->value.integer_literal < %d || "
-                    "p->value.integer_literal > %d)\n"
-                    "        return parser_error(p, \"\\\"%S\\\" must be "
-                    "%d to %d\\n\");\n\n",
-                    key->attr.min.value.integer,
-                    key->attr.max.value.integer,
-                    key->name,
-                    key->attr.min.value.integer,
-                    key->attr.max.value.integer);
-            mstream_fmt(
-                ms, "    s->%S = p->value.integer_literal;\n", key->name);
-            mstream_cstr(ms, "    return scan_next(p);\n");
-            break;
-        case CDT_FLOAT:
-            mstream_fmt(
-                ms,
-                "    double value;\n"
-                "    enum token tok = scan_next(p);\n"
-                "    if (tok != TOK_FLOAT && tok != TOK_INTEGER)\n"
-                "        return parser_error(\n"
-                "            p, \"Expected a floating point literal for "
-                "%S\\n\");\n\n",
-                key->name);
-            mstream_cstr(
-                ms,
-                "    if (tok == TOK_FLOAT)\n"
-                "        value = p->value.float_literal;\n"
-                "    else\n"
-                "        value = (double)p->value.integer_literal;\n");
             mstream_fmt(
                 ms,
-                "    if (value < %f || value > %f)\n"
-                "        return parser_error(p, \"\\\"%S\\\" must be %f to "
-                "%f\\n\");\n",
-                key->attr.min.value.floating,
-                key->attr.max.value.floating,
+                "        c_ini_shm_put(\n"
+                "            shm,\n"
+                "            &off,\n"
+                "            &items[i],\n"
+                "            %S_cstr(s->%S, i),\n"
+                "            (int)strlen(%S_cstr(s->%S, i)));\n",
+                api,
                 key->name,
-                key->attr.min.value.floating,
-                key->attr.max.value.floating);
-            mstream_fmt(
-                ms,
-                "\n"
-                "    s->%S = value;\n"
-                "    return scan_next(p);\n",
+                api,
                 key->name);
             break;
-        case CDT_BITFIELD: break;
+        default: break;
     }
-    mstream_cstr(ms, "}\n\n");
 }
 
-static void
-gen_source_parse_section(struct mstream* ms, const struct section* section)
+/*!
+ * \brief Writes the functions that publish a flat image of the struct into
+ * shared memory, and the accessors that read it. Scalars are stored as is,
+ * strings and lists as offsets. The image is guarded by a sequence lock: the
+ * publisher makes the sequence odd while it writes, and readers check that
+ * it didn't change while they read.
+ */
+static void gen_source_shm(struct mstream* ms, const struct section* section)
 {
-    struct key* key;
-    for (key = section->keys; key; key = key->next)
-        gen_source_parse_key(ms, section, key);
+    struct strview    name = section->struct_name;
+    const struct key* key;
 
-    mstream_fmt(
-        ms,
-        "int "
-        "%S_parse_section(struct %S* s, struct c_ini_parser* p)\n"
-        "{\n"
-        "    enum token           tok;\n"
-        "    struct c_ini_strspan key;\n"
-        "\n"
-        "    tok = scan_next(p);\n"
-        "    while (1)\n"
-        "    {\n"
-        "        if (tok == TOK_ERROR) return TOK_ERROR;\n"
-        "        if (tok == TOK_END) return TOK_END;\n"
-        "        if (tok == TOK_KEY)\n"
-        "        {\n"
-        "            key = p->value.string;\n"
-        "            if (0) {}\n",
-        section->struct_name,
-        section->struct_name);
+    if (section->keys == NULL || !(section->features & FEATURE_SHM))
+        return;
 
+    mstream_fmt(ms, "struct %S_shm_image\n{\n", name);
     for (key = section->keys; key; key = key->next)
-    {
-        mstream_fmt(
-            ms,
-            "            else if (cstr_equal(\"%S\", key, p->source))\n",
-            key->name);
-        mstream_cstr(
-            ms,
-            "            {\n"
-            "                if (scan_next(p) != '=')\n"
-            "                    return parser_error(p, \"Expected \\\"=\\\" ");
         mstream_fmt(
             ms,
-            "after key\\n\");\n"
-            "                tok = parse_%S__%S(p, s);\n"
-            "            }\n",
-            section->struct_name,
+            "    %s %S;\n",
+            key_is_scalar(key) ? column_type(key) : "uint32_t",
             key->name);
-    }
-
+    mstream_cstr(ms, "};\n\n");
     mstream_fmt(
         ms,
-        "            else\n"
-        "            {\n"
-        "                return parser_error(\n"
-        "                    p, \"Unknown key \\\"%%.*s\\\" in section "
-        "\\\"%S\\\"\\n\",\n"
-        "                    key.len, p->source + key.off);\n"
-        "            }\n"
-        "            continue;\n"
-        "        }\n"
-        "\n"
-        "        return tok;\n"
-        "    }\n"
+        "static const struct %S_shm_image* %S_shm_image(\n"
+        "    const struct c_ini_shm* shm)\n"
+        "{\n"
+        "    if (shm->layout != sizeof(struct %S_shm_image))\n"
+        "        return NULL;\n"
+        "    return (const struct %S_shm_image*)(shm + 1);\n"
         "}\n\n",
-        section->name);
-}
+        name,
+        name,
+        name,
+        name);
 
-static void gen_source_parse(struct mstream* ms, const struct section* section)
-{
-    mstream_fmt(
-        ms,
-        "static int %S_on_section(struct c_ini_parser* p, void* user_ptr)\n{\n",
-        section->struct_name);
     mstream_fmt(
         ms,
-        "    enum token tok = %S_parse_section(user_ptr, p);\n",
-        section->struct_name);
-    mstream_cstr(
-        ms,
-        "   if (tok != TOK_ERROR)\n"
-        "        return TOK_END;\n"
-        "    return tok;\n"
-        "}\n\n");
+        "struct c_ini_shm* %S_shm_init(void* mem, size_t capacity)\n"
+        "{\n"
+        "    struct c_ini_shm* shm = mem;\n"
+        "    if (capacity < sizeof(*shm) + sizeof(struct %S_shm_image) + 1 ||\n"
+        "        (size_t)(uint32_t)capacity != capacity)\n"
+        "        return NULL;\n"
+        "    memset(shm, 0, sizeof(*shm));\n"
+        "    ((char*)mem)[capacity - 1] = '\\0';\n"
+        "    shm->magic = C_INI_SHM_MAGIC;\n"
+        "    shm->capacity = (uint32_t)capacity;\n"
+        "    return shm;\n"
+        "}\n\n",
+        name,
+        name);
 
     mstream_fmt(
         ms,
-        "int %S_parse(\n"
-        "    struct %S* s, const char* filename, const char* data, int "
-        "len)\n{\n",
-        section->struct_name,
-        section->struct_name);
-    mstream_fmt(
-        ms,
-        "    return %S_parse_all(filename, data, len, %S_on_section, s);\n",
-        section->struct_name,
-        section->struct_name);
-    mstream_cstr(ms, "}\n\n");
-}
+        "size_t %S_shm_size(const struct %S* s)\n"
+        "{\n"
+        "    size_t size =\n"
+        "        sizeof(struct c_ini_shm) + sizeof(struct %S_shm_image) + 1;\n",
+        name,
+        name,
+        name);
+    if (section_has_lists(section))
+        mstream_cstr(ms, "    int i;\n");
+    for (key = section->keys; key; key = key->next)
+        gen_source_shm_size_key(ms, key);
+    if (!section_has_strings(section))
+        mstream_cstr(ms, "    (void)s;\n");
+    mstream_cstr(ms, "    return size;\n}\n\n");
 
-static void
-gen_source_parse_all(struct mstream* ms, const struct section* section)
-{
     mstream_fmt(
         ms,
-        "int %S_parse_all(\n"
-        "    const char* filename,\n"
-        "    const char* data,\n"
-        "    int len,\n"
-        "    int (*on_section)(struct c_ini_parser*, void*),\n"
-        "    void* user_ptr)\n{\n",
-        section->struct_name,
-        section->struct_name);
-    mstream_cstr(
+        "int %S_shm_publish(struct c_ini_shm* shm, const struct %S* s)\n"
+        "{\n"
+        "    struct %S_shm_image* image = (struct %S_shm_image*)(shm + 1);\n"
+        "    uint32_t off = sizeof(*shm) + sizeof(*image);\n"
+        "    uint32_t sequence = C_INI_LOAD_U32(&shm->sequence);\n",
+        name,
+        name,
+        name,
+        name);
+    if (section_has_lists(section))
+        mstream_cstr(
+            ms,
+            "    uint32_t* items;\n"
+            "    int i;\n");
+    mstream_fmt(
         ms,
-        "    struct c_ini_parser p;\n"
-        "    parser_init(&p, filename, data, len);\n\n"
-        "    while (1)\n"
-        "    {\n"
-        "        enum token tok = scan_next(&p);\n"
-        "    reswitch_tok:\n"
-        "        if (tok == TOK_ERROR) return -1;\n"
-        "        if (tok == TOK_END) return 0;\n"
-        "        if (tok == '[')\n"
-        "        {\n");
+        "\n"
+        "    if (%S_shm_size(s) > shm->capacity)\n"
+        "        return -1;\n"
+        "    /* Fails if another publish is in progress */\n"
+        "    if ((sequence & 1) ||\n"
+        "        !C_INI_CAS_U32(&shm->sequence, sequence, sequence + 1))\n"
+        "        return -1;\n\n",
+        name);
+    for (key = section->keys; key; key = key->next)
+        gen_source_shm_put_key(ms, key);
     mstream_cstr(
         ms,
-        "            if (scan_next(&p) != TOK_KEY)\n"
-        "                return parser_error(\n"
-        "                    &p,\n"
-        "                    \"Expected a section name within the brackets. "
-        "Example: \"\n"
-        "                    \"[mysection]\\n\");\n");
+        "\n"
+        "    shm->layout = sizeof(*image);\n"
+        "    shm->size = off;\n"
+        "    C_INI_STORE_U32(&shm->sequence, sequence + 2);\n"
+        "    return 0;\n"
+        "}\n\n");
+
     mstream_fmt(
         ms,
-        "            if (!cstr_equal(\"%S\", p.value.string, data))\n"
-        "                continue;\n",
-        section->name);
-    mstream_cstr(
+        "int %S_shm_parse(\n"
+        "    struct c_ini_shm* shm, const char* filename, const char* data, "
+        "int len)\n"
+        "{\n"
+        "    struct %S s;\n"
+        "    int result;\n"
+        "    if (%S_init(&s) != 0)\n"
+        "        return -1;\n"
+        "    result = %S_parse(&s, filename, data, len);\n"
+        "    if (result == 0)\n"
+        "        result = %S_shm_publish(shm, &s);\n"
+        "    %S_deinit(&s);\n"
+        "    return result;\n"
+        "}\n\n",
+        name,
+        name,
+        name,
+        name,
+        name,
+        name);
+
+    /* The sequence is read with a plain load, because readers may only be
+     * able to map the segment read-only */
+    mstream_fmt(
         ms,
-        "            if (scan_next(&p) != ']')\n"
-        "                return parser_error(&p, \"Missing closing bracket "
-        "\\\"]\\\"\\n\");\n");
+        "uint32_t %S_shm_read_begin(const struct c_ini_shm* shm)\n"
+        "{\n"
+        "    uint32_t sequence = *(const volatile uint32_t*)&shm->sequence;\n"
+        "    C_INI_FENCE();\n"
+        "    return sequence;\n"
+        "}\n\n",
+        name);
     mstream_fmt(
         ms,
-        "            tok = on_section(&p, user_ptr);\n"
-        "            goto reswitch_tok;\n"
-        "        }\n"
-        "    }\n",
-        section->struct_name);
+        "int %S_shm_read_retry(const struct c_ini_shm* shm, "
+        "uint32_t sequence)\n"
+        "{\n"
+        "    C_INI_FENCE();\n"
+        "    return (sequence & 1) ||\n"
+        "           *(const volatile uint32_t*)&shm->sequence != sequence;\n"
+        "}\n\n",
+        name);
 
-    mstream_fmt(ms, "    return 0;\n", section->name);
-    mstream_cstr(ms, "}\n\n");
-}
+    gen_source_shm_posix(ms, section);
 
-static void
-gen_source_for_each_value(struct mstream* ms, const struct section* section)
-{
-    const struct key* key;
-    mstream_fmt(
-        ms,
-        "int %S_for_each_value(struct %S* s, int (*on_value)(void* value, "
-        "int type, void*), void* user_ptr)\n{\n",
-        section->struct_name,
-        section->struct_name,
-        section->struct_name);
     for (key = section->keys; key; key = key->next)
     {
-        if (key->type & CDT_BITFIELD)
+        gen_shm_accessor(ms, section, key);
+        mstream_fmt(
+            ms,
+            "\n"
+            "{\n"
+            "    const struct %S_shm_image* image = %S_shm_image(shm);\n",
+            name,
+            name);
+        if (key_is_scalar(key))
+            mstream_fmt(ms, "    return image ? image->%S : 0;\n", key->name);
+        else if (key_is_list(key))
+            mstream_fmt(
+                ms,
+                "    return c_ini_shm_count(shm, image ? image->%S : 0);\n",
+                key->name);
+        else
+            mstream_fmt(
+                ms,
+                "    return c_ini_shm_str(shm, image ? image->%S : 0);\n",
+                key->name);
+        mstream_cstr(ms, "}\n\n");
+        if (!key_is_list(key))
             continue;
+        gen_shm_list_accessor(ms, name, key);
         mstream_fmt(
             ms,
-            "    if (on_value(&s->%S, %d, user_ptr) != 0)\n"
-            "        return -1;\n",
-            key->name,
-            key->type);
+            "\n"
+            "{\n"
+            "    const struct %S_shm_image* image = %S_shm_image(shm);\n"
+            "    return c_ini_shm_item(shm, image ? image->%S : 0, index);\n"
+            "}\n\n",
+            name,
+            name,
+            key->name);
     }
-    mstream_cstr(ms, "    return 0;\n");
-    mstream_cstr(ms, "}\n\n");
+}
+
+static void
+gen_source_section(struct mstream* ms, const struct section* section)
+{
+    gen_field_types(ms, section);
+    mstream_cstr(ms, "\n");
+    gen_source_set_allocator(ms, section);
+    gen_source_init(ms, section);
+    gen_source_reset(ms, section);
+    gen_source_deinit(ms, section);
+    if (section->keys)
+    {
+        gen_source_copy(ms, section);
+        gen_source_move(ms, section);
+        gen_source_equal(ms, section);
+        gen_source_hash(ms, section);
+        gen_source_diff(ms, section);
+    }
+    gen_source_fwrite(ms, section);
+    if (section->keys)
+        gen_source_write_patch(ms, section);
+    gen_source_parse_section(ms, section);
+    gen_source_parse_all(ms, section);
+    gen_source_parse(ms, section);
+    gen_source_cursor(ms, section);
+    gen_source_for_each_value(ms, section);
+    gen_source_memory_usage(ms, section);
+    gen_source_pool(ms, section);
+    gen_source_columns(ms, section);
+    gen_source_lazy(ms, section);
+    gen_source_validate(ms, section);
+    gen_source_layers(ms, section);
+    gen_source_watch(ms, section);
+    gen_source_handle(ms, section);
+    gen_source_shm(ms, section);
 }
 
 static int
@@ -3428,32 +9489,254 @@ gen_source(const char* filename, const struct root* root, const struct cfg* cfg)
     struct mstream        ms = mstream_init_writeable();
 
     gen_source_includes(&ms, cfg);
-    gen_source_ini_parser(&ms);
-    gen_source_helpers(&ms, root);
+    gen_source_types(&ms);
+    gen_source_ini_parser(&ms, "static ");
+    for (section = root->sections; section; section = section->next)
+        gen_source_struct_def(&ms, section);
+    gen_source_helpers(&ms, root, "static ");
 
     for (section = root->sections; section; section = section->next)
-    {
-        gen_source_init(&ms, section);
-        gen_source_deinit(&ms, section);
-        gen_source_fwrite(&ms, section);
-        gen_source_parse_section(&ms, section);
-        gen_source_parse(&ms, section);
-        gen_source_parse_all(&ms, section);
-        gen_source_for_each_value(&ms, section);
-    }
+        gen_source_section(&ms, section);
 
     if (filename)
         return write_if_different(&ms, filename);
-    fwrite(ms.address, ms.write_ptr, 1, stdout);
+    return write_stdout(&ms);
+}
+
+static char*
+shard_filename(const char* dir, struct strview name, const char* ext)
+{
+    char* filename = malloc(strlen(dir) + name.len + strlen(ext) + 2);
+    if (filename)
+        sprintf(
+            filename, "%s/%.*s%s", dir, name.len, name.source + name.off, ext);
+    return filename;
+}
+
+static int write_shard(
+    const struct mstream* ms,
+    const char*           dir,
+    struct strview        name,
+    const char*           ext)
+{
+    int   result;
+    char* filename = shard_filename(dir, name, ext);
+    if (filename == NULL)
+        return print_error("Out of memory\n");
+    result = write_if_different(ms, filename);
+    free(filename);
+    return result;
+}
+
+static const struct section*
+find_shard(const struct root* root, struct strview name)
+{
+    const struct section* section;
+    for (section = root->sections; section; section = section->next)
+        if (section->struct_name.len == name.len &&
+            memcmp(
+                section->struct_name.source + section->struct_name.off,
+                name.source + name.off,
+                name.len) == 0)
+            return section;
+    return NULL;
+}
+
+/*!
+ * \brief The build system has to know the names of the shards before the
+ * generator runs. If they don't match, shards would silently be left out of
+ * the build or be missing, so that is an error.
+ */
+static int check_shards(const struct root* root, const struct cfg* cfg)
+{
+    const struct section* section;
+    int                   i, result = 0;
+
+    for (section = root->sections; section; section = section->next)
+    {
+        for (i = 0; i != cfg->shard_count; ++i)
+            if (cstr_equal(cfg->shards[i], section->struct_name))
+                break;
+        if (i == cfg->shard_count)
+            result = print_error(
+                "Struct \"%.*s\" of section \"%.*s\" is missing from the "
+                "list of shards\n",
+                section->struct_name.len,
+                section->struct_name.source + section->struct_name.off,
+                section->name.len,
+                section->name.source + section->name.off);
+    }
+    for (i = 0; i != cfg->shard_count; ++i)
+        if (find_shard(root, cstr_strview(cfg->shards[i])) == NULL)
+            result = print_error(
+                "Shard \"%s\" doesn't match the struct name of any section\n",
+                cfg->shards[i]);
+
+    return result;
+}
+
+/*!
+ * \brief Shards of sections that were removed would otherwise stay in the
+ * output directory. Only files listed in the previous manifest are deleted, so
+ * other files in the directory are left alone.
+ */
+static int remove_stale_shards(const char* dir, const struct root* root)
+{
+    struct mfile   mf;
+    struct strview name;
+    char*          filename;
+    int            result;
+
+    filename = shard_filename(dir, cstr_strview("c_ini_shards"), ".txt");
+    if (filename == NULL)
+        return print_error("Out of memory\n");
+    result = mfile_map_read(&mf, filename, 1);
+    free(filename);
+    if (result != 0)
+        return 0;
+
+    name.source = mf.address;
+    for (name.off = 0; name.off < mf.size; name.off += name.len + 1)
+    {
+        for (name.len = 0; name.off + name.len < mf.size; name.len++)
+            if (name.source[name.off + name.len] == '\n')
+                break;
+        if (name.len == 0 || cstr_equal("c_ini_runtime", name) ||
+            find_shard(root, name))
+            continue;
+        filename = shard_filename(dir, name, ".c");
+        if (filename == NULL)
+        {
+            result = print_error("Out of memory\n");
+            break;
+        }
+        remove(filename);
+        free(filename);
+    }
+
+    mfile_unmap(&mf);
+    return result;
+}
+
+/*!
+ * \brief Writes one C file per section plus a runtime shared by all of them.
+ * File names only depend on the struct names, and write_if_different() leaves
+ * untouched shards alone, so build systems only recompile what changed.
+ */
+static int
+gen_shards(const char* dir, const struct root* root, const struct cfg* cfg)
+{
+    const struct section* section;
+    struct mstream        ms = mstream_init_writeable();
+    struct strview        runtime = cstr_strview("c_ini_runtime");
+
+    if (cfg->shards && check_shards(root, cfg) != 0)
+        goto fail;
+    if (remove_stale_shards(dir, root) != 0)
+        goto fail;
+
+    mstream_cstr(&ms, "#pragma once\n\n");
+    gen_source_includes(&ms, cfg);
+    gen_source_types(&ms);
+    gen_source_runtime_decls(&ms, root, cfg->shard_prefix);
+    if (write_shard(&ms, dir, runtime, ".h") != 0)
+        goto fail;
+
+    ms.write_ptr = 0;
+    mstream_cstr(&ms, "#include \"c_ini_runtime.h\"\n\n");
+    gen_source_ini_parser(&ms, "");
+    gen_source_helpers(&ms, root, "");
+    if (write_shard(&ms, dir, runtime, ".c") != 0)
+        goto fail;
+
+    for (section = root->sections; section; section = section->next)
+    {
+        ms.write_ptr = 0;
+        mstream_cstr(&ms, "#include \"c_ini_runtime.h\"\n\n");
+        gen_source_struct_def(&ms, section);
+        gen_source_section(&ms, section);
+        if (write_shard(&ms, dir, section->struct_name, ".c") != 0)
+            goto fail;
+    }
+
+    /* Remembers which files were written, see remove_stale_shards() */
+    ms.write_ptr = 0;
+    mstream_cstr(&ms, "c_ini_runtime\n");
+    for (section = root->sections; section; section = section->next)
+        mstream_fmt(&ms, "%S\n", section->struct_name);
+    if (write_shard(&ms, dir, cstr_strview("c_ini_shards"), ".txt") != 0)
+        goto fail;
+
+    free(ms.address);
+    return 0;
+
+fail:
+    free(ms.address);
+    return -1;
+}
+
+static int gen_outputs(const struct root* root, const struct cfg* cfg)
+{
+    if (cfg->output_source == NULL && cfg->output_header == NULL &&
+        cfg->output_shard_dir == NULL)
+        switch (cfg->output_format)
+        {
+            case OUTPUT_NONE: break;
+            case OUTPUT_C: return gen_source(NULL, root, cfg);
+            case OUTPUT_H: return gen_header(NULL, root);
+        }
+
+    if (cfg->output_source)
+        if (gen_source(cfg->output_source, root, cfg) != 0)
+            return -1;
+    if (cfg->output_shard_dir)
+        if (gen_shards(cfg->output_shard_dir, root, cfg) != 0)
+            return -1;
+    if (cfg->output_header)
+        if (gen_header(cfg->output_header, root) != 0)
+            return -1;
+
     return 0;
 }
 
+static void
+print_stats(const struct stats* stats, const struct root* root, double wall)
+{
+    static const char* phases[PHASE_COUNT] = {
+        "map", "scan", "parse", "emit", "compare"};
+    const struct section* section;
+    const struct key*     key;
+    int                   phase, sections = 0, keys = 0;
+
+    for (section = root->sections; section; section = section->next, sections++)
+        for (key = section->keys; key; key = key->next)
+            keys++;
+
+    fprintf(stderr, "%stime:%s\n", emph_style(), reset_style());
+    for (phase = 0; phase != PHASE_COUNT; ++phase)
+        fprintf(
+            stderr, "  %-16s %10.6f s\n", phases[phase], stats->time[phase]);
+    fprintf(stderr, "  %-16s %10.6f s\n", "total (wall)", wall);
+    fprintf(stderr, "%scounts:%s\n", emph_style(), reset_style());
+    fprintf(stderr, "  %-16s %10ld\n", "input bytes", stats->input_bytes);
+    fprintf(stderr, "  %-16s %10ld\n", "tokens", stats->tokens);
+    fprintf(stderr, "  %-16s %10d\n", "sections", sections);
+    fprintf(stderr, "  %-16s %10d\n", "keys", keys);
+    fprintf(stderr, "  %-16s %10ld\n", "emitted bytes", stats->emitted_bytes);
+    fprintf(stderr, "  %-16s %10d\n", "files written", stats->files_written);
+    fprintf(
+        stderr, "  %-16s %10d\n", "files unchanged", stats->files_unchanged);
+}
+
 int main(int argc, char** argv)
 {
     struct mfile  mf;
     struct parser parser;
     struct cfg    cfg = {0};
     struct root   root = {0};
+    struct stats  stats;
+    double        start, emit_start;
+    int           result;
 
     if (!stream_is_terminal(stderr))
         disable_colors = 1;
@@ -3461,42 +9744,35 @@ int main(int argc, char** argv)
     if (parse_cmdline(argc, argv, &cfg) != 0)
         return EXIT_FAILURE;
 
+    memset(&stats, 0, sizeof stats);
+    if (cfg.stats)
+        global_stats = &stats;
+    start = stats_start(global_stats);
+
     if (cfg.input_fnames == NULL)
     {
         if (mfile_map_stdin(&mf) != 0)
             return EXIT_FAILURE;
+        stats_lap(global_stats, PHASE_MAP, start);
         parser_init(&parser, &mf, "<stdin>");
+        parser.stats = global_stats;
         if (parse(&parser, &root, 0) != 0)
             return EXIT_FAILURE;
+        stats.input_bytes = mf.size;
+        stats.tokens = parser.tokens;
     }
-    else
+    else if (parse_inputs(&cfg, &root) != 0)
+        return EXIT_FAILURE;
+
+    /* Time spent in write_if_different() is accounted for separately */
+    emit_start = stats_start(global_stats);
+    result = gen_outputs(&root, &cfg);
+    if (global_stats)
     {
-        int i;
-        for (i = 0; i != cfg.input_count; ++i)
-        {
-            char is_source_file = file_is_source_file(cfg.input_fnames[i]);
-            if (mfile_map_read(&mf, cfg.input_fnames[i], 0) != 0)
-                return EXIT_FAILURE;
-            parser_init(&parser, &mf, cfg.input_fnames[i]);
-            if (parse(&parser, &root, is_source_file) != 0)
-                return EXIT_FAILURE;
-        }
+        stats_lap(global_stats, PHASE_EMIT, emit_start);
+        stats.time[PHASE_EMIT] -= stats.time[PHASE_COMPARE];
+        print_stats(&stats, &root, clock_seconds() - start);
     }
 
-    if (cfg.output_source == NULL && cfg.output_header == NULL)
-        switch (cfg.output_format)
-        {
-            case OUTPUT_NONE: break;
-            case OUTPUT_C: return gen_source(NULL, &root, &cfg);
-            case OUTPUT_H: return gen_header(NULL, &root);
-        }
-
-    if (cfg.output_source)
-        if (gen_source(cfg.output_source, &root, &cfg) != 0)
-            return EXIT_FAILURE;
-    if (cfg.output_header)
-        if (gen_header(cfg.output_header, &root) != 0)
-            return EXIT_FAILURE;
-
-    return EXIT_SUCCESS;
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -1,8 +1,194 @@
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
 #define SECTION(name)
 #define DEFAULT(value)
 #define CONSTRAIN(min, max)
 #define IGNORE()
 #define STRING(prefix)
 #define STRINGLIST(prefix)
+#define MEMORY()
+#define WITH(feature)
+
+/*!
+ * Statistics filled in by the generated parse functions, but only if the
+ * generated source is compiled with C_INI_INSTRUMENTATION defined. Counters
+ * are added to and never reset, so one struct can accumulate several parses.
+ */
+struct c_ini_stats
+{
+    uint64_t bytes;            /* Bytes of INI data scanned */
+    uint64_t tokens;           /* Tokens returned by the scanner */
+    uint64_t sections_matched; /* Sections that were parsed */
+    uint64_t sections_skipped; /* Sections belonging to other structs */
+    uint64_t keys;             /* Key/value pairs parsed */
+    uint64_t allocations;      /* Calls to string and list functions */
+    uint64_t cycles;           /* Cycle counter ticks spent parsing */
+};
+
+/*!
+ * Callbacks fired while parsing, if the generated source is compiled with
+ * C_INI_INSTRUMENTATION defined. Every callback is optional. "name" is the
+ * file name for documents, and the section or key name otherwise. "cycles" is
+ * a cycle counter timestamp (rdtsc on x86, cntvct_el0 on ARM64).
+ */
+struct c_ini_hooks
+{
+    void (*document_begin)(void* user, const char* name, uint64_t cycles);
+    void (*document_end)(void* user, const char* name, uint64_t cycles);
+    void (*section_begin)(void* user, const char* name, uint64_t cycles);
+    void (*section_end)(void* user, const char* name, uint64_t cycles);
+    void (*key_begin)(void* user, const char* name, uint64_t cycles);
+    void (*key_end)(void* user, const char* name, uint64_t cycles);
+    void* user;
+};
+
+/*!
+ * Memory functions used by the built-in dynamic strings and string lists.
+ * "ctx" is passed to every call. Set one for all instances of a struct with
+ * <struct>_set_allocator(), or for a single parse with c_ini_options. Every
+ * string remembers the allocator it was allocated with, so mixing both is
+ * fine as long as the allocators outlive the strings. That is stored in a
+ * header in front of the string, so built-in strings and lists must never be
+ * passed to free() or replaced with strings allocated some other way.
+ */
+struct c_ini_allocator
+{
+    void* (*alloc)(void* ctx, size_t size);
+    void* (*realloc)(void* ctx, void* ptr, size_t size);
+    void (*free)(void* ctx, void* ptr);
+    void* ctx;
+};
+
+/*!
+ * Bounds for parsing untrusted input. Parsing stops with an error as soon as
+ * one of them is exceeded. Allocated bytes are the bytes of string data that
+ * are copied into dynamic and custom strings and lists. 0 means no limit.
+ */
+struct c_ini_limits
+{
+    int max_bytes;
+    int max_sections;
+    int max_keys_per_section;
+    int max_list_elements;
+    int max_string_length;
+    int max_allocated_bytes;
+};
+
+/*! Passed to the *_opts() variants of the parse functions. NULL members are
+ * ignored. "dirty" is a set of fields of the struct being parsed (see
+ * C_INI_FIELD_WORDS below). The bit of every field that is assigned is set,
+ * even if the value didn't change, and bits are never cleared. Errors are
+ * printed to "diagnostics", or stderr if NULL, with one write per error.
+ * Everything a parse needs besides its input comes from here, so parses on
+ * different threads don't share any state. */
+struct c_ini_options
+{
+    const struct c_ini_hooks*     hooks;
+    struct c_ini_stats*           stats;
+    const struct c_ini_allocator* allocator;
+    const struct c_ini_limits*    limits;
+    uint32_t*                     dirty;
+    FILE*                         diagnostics;
+    int                           disable_colors;
+};
+
+/*!
+ * Filled in with the first error found by <struct>_validate(). "offset" and
+ * "length" are in bytes from the start of the data, lines and columns start
+ * at 1. "offset" is -1 if there was no error. Messages that don't fit are
+ * truncated.
+ */
+struct c_ini_error
+{
+    int  offset;
+    int  length;
+    int  line;
+    int  column;
+    char message[128];
+};
+
+/*!
+ * Reader threads of a <struct>_handle each use one of these. Define
+ * C_INI_MAX_READERS the same way everywhere the generated header is included
+ * to change their number. Slots are padded to a cache line, so readers don't
+ * slow each other down.
+ */
+#if !defined(C_INI_MAX_READERS)
+#    define C_INI_MAX_READERS 64
+#endif
+struct c_ini_reader
+{
+    uint32_t epoch; /* 0 if the reader holds no snapshot */
+    uint32_t used;
+    char     padding[56];
+};
+
+/*!
+ * Walks over the sections of a document one <struct>_cursor_next() call at a
+ * time. Set up with <struct>_cursor_init(). "data" has to stay valid while the
+ * cursor is used. After a section failed to parse, "error" is set and "offset"
+ * is where that section starts. "sections" and "allocated" carry the counts
+ * that c_ini_limits bounds from one call to the next.
+ */
+struct c_ini_cursor
+{
+    const char*                 filename;
+    const char*                 data;
+    int                         len;
+    int                         offset;
+    const struct c_ini_options* opts;
+    int                         error;
+    int                         sections;
+    size_t                      allocated;
+};
+
+/*!
+ * Remembers how far <struct>_parse_tail() got in data that keeps growing, such
+ * as a file that sections are appended to. Start with all zeros. The last
+ * section is only handled once a line starting with "[" follows it, because
+ * more keys may still be appended to it. Set "flush" to handle it anyway, e.g.
+ * once the writer is done. The limits in c_ini_limits apply to all of the data,
+ * "sections" and "allocated" count towards them across calls.
+ */
+struct c_ini_tail
+{
+    int    offset; /* Where the first section that wasn't handled yet starts */
+    int    flush;
+    int    sections;
+    size_t allocated;
+};
+
+/*!
+ * Start of a shared memory segment that <struct>_shm_publish() writes a flat
+ * image of a struct into. The fields follow the header, strings are stored
+ * after them and referred to by their offset from the header. "sequence" is
+ * odd while an image is being written, readers retry if it changed while they
+ * were reading.
+ */
+#define C_INI_SHM_MAGIC 0x494e4943u
+struct c_ini_shm
+{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t layout;   /* Size of the fields, 0 until the first publish */
+    uint32_t size;     /* Bytes in use, including this header */
+    uint32_t capacity; /* Size of the segment, the last byte stays 0 */
+    uint32_t padding[3];
+};
+
+/*!
+ * Every struct gets an enum with one ID per field, <STRUCT>_FIELD_<NAME>, and
+ * <STRUCT>_FIELDS_COUNT, the number of fields. A set of fields is an array of
+ * C_INI_FIELD_WORDS(<STRUCT>_FIELDS_COUNT) words with one bit per field:
+ *
+ *   uint32_t fields[C_INI_FIELD_WORDS(SPRITE_FIELDS_COUNT)] = {0};
+ *   C_INI_FIELD_SET(fields, SPRITE_FIELD_X);
+ */
+#define C_INI_FIELD_WORDS(count) (((count) + 31) / 32)
+#define C_INI_FIELD_SET(fields, id)                                            \
+    ((fields)[(id) / 32] |= (uint32_t)1 << ((id) % 32))
+#define C_INI_FIELD_TEST(fields, id) (((fields)[(id) / 32] >> ((id) % 32)) & 1)
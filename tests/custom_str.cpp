@@ -1,10 +1,22 @@
 #include "custom_str.h"
 #include <string>
 
+static bool fail_next_init = false;
+
 extern "C" {
 
+void custom_str_fail_next_init(void)
+{
+    fail_next_init = true;
+}
+
 int custom_str_init(struct str** str)
 {
+    if (fail_next_init)
+    {
+        fail_next_init = false;
+        return -1;
+    }
     *str = reinterpret_cast<struct str*>(new std::string);
     return 0;
 }
@@ -32,4 +44,10 @@ int custom_str_len(const struct str* str)
     const auto* s = reinterpret_cast<const std::string*>(str);
     return s->size();
 }
+
+size_t custom_str_memory(const struct str* str)
+{
+    const auto* s = reinterpret_cast<const std::string*>(str);
+    return sizeof(*s) + s->capacity() + 1;
+}
 }
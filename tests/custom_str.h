@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stddef.h>
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -10,6 +12,10 @@ void        custom_str_deinit(struct str* str);
 int         custom_str_set(struct str** str, const char* data, int len);
 const char* custom_str_data(const struct str* str);
 int         custom_str_len(const struct str* str);
+size_t      custom_str_memory(const struct str* str);
+
+/* Makes the next call to custom_str_init() fail */
+void custom_str_fail_next_init(void);
 
 #if defined(__cplusplus)
 }
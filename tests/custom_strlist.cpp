@@ -29,4 +29,16 @@ void custom_strlist_clear(struct strlist* l)
     auto* cpp_l = reinterpret_cast<list*>(l);
     cpp_l->clear();
 }
+
+int custom_strlist_count(const struct strlist* l)
+{
+    auto* cpp_l = reinterpret_cast<const list*>(l);
+    return static_cast<int>(cpp_l->size());
+}
+
+const char* custom_strlist_cstr(const struct strlist* l, int i)
+{
+    auto* cpp_l = reinterpret_cast<const list*>(l);
+    return (*cpp_l)[i].c_str();
+}
 }
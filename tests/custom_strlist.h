@@ -9,6 +9,8 @@ int  custom_strlist_init(struct strlist** l);
 void custom_strlist_deinit(struct strlist* l);
 int  custom_strlist_add(struct strlist** l, const char* data, int len);
 void custom_strlist_clear(struct strlist* l);
+int  custom_strlist_count(const struct strlist* l);
+const char* custom_strlist_cstr(const struct strlist* l, int i);
 
 #if defined(__cplusplus)
 }
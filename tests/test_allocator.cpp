@@ -0,0 +1,170 @@
+#include "test_allocator.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdlib>
+
+#define NAME allocator
+
+SECTION("allocator")
+struct allocator_struct
+{
+    char*  str DEFAULT("default");
+    char** list DEFAULT("a") DEFAULT("b");
+    int    value;
+};
+
+struct counting_allocator
+{
+    static void* alloc(void* ctx, size_t size)
+    {
+        static_cast<counting_allocator*>(ctx)->allocs++;
+        return malloc(size);
+    }
+    static void* realloc(void* ctx, void* ptr, size_t size)
+    {
+        static_cast<counting_allocator*>(ctx)->reallocs++;
+        return ::realloc(ptr, size);
+    }
+    static void free(void* ctx, void* ptr)
+    {
+        static_cast<counting_allocator*>(ctx)->frees++;
+        ::free(ptr);
+    }
+
+    counting_allocator()
+    {
+        allocator.alloc = alloc;
+        allocator.realloc = realloc;
+        allocator.free = free;
+        allocator.ctx = this;
+    }
+
+    struct c_ini_allocator allocator;
+    int                    allocs = 0;
+    int                    reallocs = 0;
+    int                    frees = 0;
+};
+
+struct NAME : testing::Test
+{
+    void TearDown() override { allocator_struct_set_allocator(NULL); }
+
+    struct allocator_struct s;
+    counting_allocator      per_struct;
+    counting_allocator      per_parse;
+};
+
+using namespace testing;
+
+TEST_F(NAME, per_struct)
+{
+    const char* ini = "[allocator]\nstr = \"Hello\"\nlist = \"x\", \"y\"\n";
+    allocator_struct_set_allocator(&per_struct.allocator);
+    ASSERT_THAT(allocator_struct_init(&s), Eq(0));
+    ASSERT_THAT(
+        allocator_struct_parse(&s, "<stdin>", ini, strlen(ini)), Eq(0));
+    EXPECT_THAT(s.str, StrEq("Hello"));
+    EXPECT_THAT(s.list[1], StrEq("y"));
+    allocator_struct_deinit(&s);
+
+    EXPECT_THAT(per_struct.allocs, Gt(0));
+    EXPECT_THAT(per_struct.frees, Eq(per_struct.allocs));
+}
+
+TEST_F(NAME, per_parse)
+{
+    const char*          ini = "[allocator]\nstr = \"Hello\"\nlist = \"x\"\n";
+    struct c_ini_options opts = {};
+    opts.allocator = &per_parse.allocator;
+
+    ASSERT_THAT(allocator_struct_init(&s), Eq(0));
+    ASSERT_THAT(
+        allocator_struct_parse_opts(&s, "<stdin>", ini, strlen(ini), &opts),
+        Eq(0));
+    EXPECT_THAT(s.str, StrEq("Hello"));
+    EXPECT_THAT(s.list[0], StrEq("x"));
+    /* The defaults are static, so the string, the list and its element all
+     * come from the parse allocator */
+    EXPECT_THAT(per_parse.allocs, Eq(3));
+    EXPECT_THAT(per_parse.frees, Eq(0));
+
+    allocator_struct_deinit(&s);
+    EXPECT_THAT(per_parse.frees, Eq(3));
+}
+
+TEST_F(NAME, mixed)
+{
+    const char*          ini = "[allocator]\nstr = \"Hello\"\n";
+    struct c_ini_options opts = {};
+    opts.allocator = &per_parse.allocator;
+
+    allocator_struct_set_allocator(&per_struct.allocator);
+    ASSERT_THAT(allocator_struct_init(&s), Eq(0));
+    ASSERT_THAT(
+        allocator_struct_parse_opts(&s, "<stdin>", ini, strlen(ini), &opts),
+        Eq(0));
+    ASSERT_THAT(
+        allocator_struct_parse_opts(&s, "<stdin>", ini, strlen(ini), &opts),
+        Eq(0));
+    /* The second parse reuses the buffer of the first */
+    EXPECT_THAT(per_parse.allocs, Eq(1));
+    EXPECT_THAT(per_parse.reallocs, Eq(0));
+    allocator_struct_deinit(&s);
+
+    EXPECT_THAT(per_struct.frees, Eq(per_struct.allocs));
+    EXPECT_THAT(per_parse.frees, Eq(per_parse.allocs));
+}
+
+TEST_F(NAME, init_does_not_allocate)
+{
+    allocator_struct_set_allocator(&per_struct.allocator);
+    ASSERT_THAT(allocator_struct_init(&s), Eq(0));
+    EXPECT_THAT(s.str, StrEq("default"));
+    EXPECT_THAT(s.list[0], StrEq("a"));
+    EXPECT_THAT(s.list[1], StrEq("b"));
+    EXPECT_THAT(s.list[2], IsNull());
+    allocator_struct_deinit(&s);
+    EXPECT_THAT(per_struct.allocs, Eq(0));
+    EXPECT_THAT(per_struct.frees, Eq(0));
+}
+
+TEST_F(NAME, reset_keeps_capacity)
+{
+    const char* ini = "[allocator]\nstr = \"Hello world\"\nvalue = 5\n";
+    allocator_struct_set_allocator(&per_struct.allocator);
+    ASSERT_THAT(allocator_struct_init(&s), Eq(0));
+    ASSERT_THAT(
+        allocator_struct_parse(&s, "<stdin>", ini, strlen(ini)), Eq(0));
+    const char* buffer = s.str;
+
+    ASSERT_THAT(allocator_struct_reset(&s), Eq(0));
+    EXPECT_THAT(s.str, StrEq("default"));
+    EXPECT_THAT(s.str, Eq(buffer));
+    EXPECT_THAT(s.list[0], StrEq("a"));
+    EXPECT_THAT(s.list[1], StrEq("b"));
+    EXPECT_THAT(s.list[2], IsNull());
+    EXPECT_THAT(s.value, Eq(0));
+    EXPECT_THAT(per_struct.reallocs, Eq(0));
+
+    allocator_struct_deinit(&s);
+    EXPECT_THAT(per_struct.frees, Eq(per_struct.allocs));
+}
+
+TEST_F(NAME, reset_restores_list_defaults)
+{
+    const char* ini = "[allocator]\nlist = \"x\", \"y\", \"z\"\n";
+    allocator_struct_set_allocator(&per_struct.allocator);
+    ASSERT_THAT(allocator_struct_init(&s), Eq(0));
+    ASSERT_THAT(
+        allocator_struct_parse(&s, "<stdin>", ini, strlen(ini)), Eq(0));
+    EXPECT_THAT(s.list[2], StrEq("z"));
+
+    ASSERT_THAT(allocator_struct_reset(&s), Eq(0));
+    EXPECT_THAT(s.list[0], StrEq("a"));
+    EXPECT_THAT(s.list[1], StrEq("b"));
+    EXPECT_THAT(s.list[2], IsNull());
+    /* The parsed list was freed, the defaults are static */
+    EXPECT_THAT(per_struct.frees, Eq(per_struct.allocs));
+    allocator_struct_deinit(&s);
+}
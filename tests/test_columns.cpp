@@ -0,0 +1,155 @@
+#include "test_columns.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdlib>
+#include <string>
+
+#define NAME columns
+
+SECTION("sprite") WITH(columns)
+struct columns_struct
+{
+    char*  name;
+    char** tags;
+    float  x DEFAULT(1.5);
+    float  y;
+    int    scale DEFAULT(1) CONSTRAIN(0, 100);
+    int8_t layer;
+    bool   visible DEFAULT(true);
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        C_INI_FIELD_SET(fields, COLUMNS_STRUCT_FIELD_X);
+        C_INI_FIELD_SET(fields, COLUMNS_STRUCT_FIELD_SCALE);
+        columns_struct_columns_init(&c, fields, NULL);
+    }
+    void TearDown() override { columns_struct_columns_deinit(&c); }
+
+    int parse(const std::string& ini)
+    {
+        return columns_struct_parse_all_into_columns(
+            &c, "<stdin>", ini.data(), ini.size(), NULL);
+    }
+
+    static std::string sprites(int count)
+    {
+        std::string ini;
+        for (int i = 0; i != count; ++i)
+            ini += "[sprite]\nname = \"sprite\"\ntags = \"a\", \"b\"\nx = " +
+                   std::to_string(i) + ".5\ny = 2.0\nscale = " +
+                   std::to_string(i % 100) + "\n[other]\nx = 1\n";
+        return ini;
+    }
+
+    uint32_t fields[C_INI_FIELD_WORDS(COLUMNS_STRUCT_FIELDS_COUNT)] = {};
+    struct columns_struct_columns c;
+};
+
+using namespace testing;
+
+TEST_F(NAME, only_requested_columns)
+{
+    ASSERT_THAT(parse(sprites(200)), Eq(0));
+    ASSERT_THAT(c.count, Eq(200));
+    EXPECT_THAT(c.column.y, IsNull());
+    EXPECT_THAT(c.column.layer, IsNull());
+    EXPECT_THAT(c.column.visible, IsNull());
+    for (int i = 0; i != 200; ++i)
+    {
+        EXPECT_THAT(c.column.x[i], DoubleEq(i + 0.5));
+        EXPECT_THAT(c.column.scale[i], Eq(i % 100));
+    }
+}
+
+TEST_F(NAME, defaults)
+{
+    ASSERT_THAT(parse("[sprite]\n[sprite]\nscale = 5\n"), Eq(0));
+    ASSERT_THAT(c.count, Eq(2));
+    EXPECT_THAT(c.column.x[0], DoubleEq(1.5));
+    EXPECT_THAT(c.column.scale[0], Eq(1));
+    EXPECT_THAT(c.column.scale[1], Eq(5));
+}
+
+TEST_F(NAME, all_columns)
+{
+    columns_struct_columns_deinit(&c);
+    columns_struct_columns_init(&c, NULL, NULL);
+    ASSERT_THAT(
+        parse("[sprite]\ny = 3\nlayer = -2\nvisible = false\n"), Eq(0));
+    EXPECT_THAT(c.column.y[0], DoubleEq(3.0));
+    EXPECT_THAT(c.column.layer[0], Eq(-2));
+    EXPECT_THAT(c.column.visible[0], Eq(0));
+}
+
+TEST_F(NAME, documents_append)
+{
+    ASSERT_THAT(parse(sprites(3)), Eq(0));
+    ASSERT_THAT(parse(sprites(2)), Eq(0));
+    ASSERT_THAT(c.count, Eq(5));
+    EXPECT_THAT(c.column.scale[4], Eq(1));
+}
+
+TEST_F(NAME, constraints_are_checked_after_parsing)
+{
+    std::string ini = sprites(10) + "[sprite]\nscale = 101\n";
+    EXPECT_THAT(parse(ini), Eq(-1));
+    EXPECT_THAT(c.count, Eq(0));
+    /* Rows of later documents are still checked */
+    ASSERT_THAT(parse(sprites(1)), Eq(0));
+    EXPECT_THAT(parse(sprites(1) + "[sprite]\nscale = -1\n"), Eq(-1));
+    EXPECT_THAT(c.count, Eq(1));
+}
+
+TEST_F(NAME, failed_documents_add_no_rows)
+{
+    ASSERT_THAT(parse(sprites(2)), Eq(0));
+    EXPECT_THAT(parse(sprites(3) + "[sprite]\nx = \"a\"\n"), Eq(-1));
+    EXPECT_THAT(c.count, Eq(2));
+}
+
+TEST_F(NAME, deinit_without_rows)
+{
+    struct counter
+    {
+        int frees = 0;
+    } counter;
+    struct c_ini_allocator allocator;
+    allocator.alloc = [](void*, size_t size) -> void* { return malloc(size); };
+    allocator.realloc = [](void*, void* ptr, size_t size) -> void* {
+        return realloc(ptr, size);
+    };
+    allocator.free = [](void* ctx, void* ptr) {
+        EXPECT_THAT(ptr, NotNull());
+        static_cast<struct counter*>(ctx)->frees++;
+        free(ptr);
+    };
+    allocator.ctx = &counter;
+
+    columns_struct_columns_deinit(&c);
+    columns_struct_columns_init(&c, fields, &allocator);
+    columns_struct_columns_deinit(&c);
+    EXPECT_THAT(counter.frees, Eq(0));
+
+    columns_struct_columns_init(&c, fields, &allocator);
+    ASSERT_THAT(parse(sprites(1)), Eq(0));
+    columns_struct_columns_deinit(&c);
+    /* Only the requested columns were allocated */
+    EXPECT_THAT(counter.frees, Eq(2));
+}
+
+TEST_F(NAME, type_range_is_checked_while_parsing)
+{
+    columns_struct_columns_deinit(&c);
+    columns_struct_columns_init(&c, NULL, NULL);
+    EXPECT_THAT(parse("[sprite]\nlayer = 128\n"), Eq(-1));
+}
+
+TEST_F(NAME, unrequested_values_are_still_tokenized)
+{
+    EXPECT_THAT(parse("[sprite]\ny = \"unterminated\n"), Eq(-1));
+    EXPECT_THAT(parse("[sprite]\nunknown = 5\n"), Eq(-1));
+}
@@ -0,0 +1,165 @@
+#include "custom_str.h"
+#include "custom_strlist.h"
+#include "test_copy.h"
+
+#include "gmock/gmock.h"
+
+#define NAME copy
+
+SECTION("copy")
+struct copy_struct
+{
+    char*           str DEFAULT("default");
+    char**          list;
+    struct str*     custom STRING(custom_str);
+    struct strlist* custom_list STRINGLIST(custom_strlist);
+    char            fixed[16];
+    char            fixed_list[4][8];
+    int             value;
+    float           ratio;
+    bool            flag;
+    unsigned        bit : 1;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        copy_struct_init(&a);
+        copy_struct_init(&b);
+    }
+    void TearDown() override
+    {
+        copy_struct_deinit(&a);
+        copy_struct_deinit(&b);
+    }
+
+    void parse(struct copy_struct* s, const char* ini)
+    {
+        ASSERT_THAT(
+            copy_struct_parse(s, "<stdin>", ini, strlen(ini)),
+            testing::Eq(0));
+    }
+
+    struct copy_struct a;
+    struct copy_struct b;
+};
+
+using namespace testing;
+
+static const char* full =
+    "[copy]\n"
+    "str = \"Hello\"\n"
+    "list = \"a\", \"bc\"\n"
+    "custom = \"custom\"\n"
+    "custom_list = \"x\", \"y\"\n"
+    "fixed = \"fixed\"\n"
+    "fixed_list = \"f\", \"g\"\n"
+    "value = 5\n"
+    "ratio = 1.5\n"
+    "flag = true\n"
+    "bit = 1\n";
+
+TEST_F(NAME, copy_is_deep)
+{
+    parse(&a, full);
+    ASSERT_THAT(copy_struct_copy(&b, &a), Eq(0));
+    EXPECT_THAT(copy_struct_equal(&a, &b), Eq(1));
+    EXPECT_THAT(copy_struct_hash(&a), Eq(copy_struct_hash(&b)));
+
+    EXPECT_THAT(b.str, StrEq("Hello"));
+    EXPECT_THAT(b.str, Ne(a.str));
+    EXPECT_THAT(b.list[1], StrEq("bc"));
+    EXPECT_THAT(b.list, Ne(a.list));
+    EXPECT_THAT(custom_str_data(b.custom), StrEq("custom"));
+    EXPECT_THAT(b.fixed_list[1], StrEq("g"));
+    EXPECT_THAT(b.ratio, FloatEq(1.5));
+    EXPECT_THAT(b.bit, Eq(1u));
+
+    /* Changing the source doesn't change the copy */
+    parse(&a, "[copy]\nstr = \"Changed\"\nlist = \"z\"\n");
+    EXPECT_THAT(b.str, StrEq("Hello"));
+    EXPECT_THAT(b.list[0], StrEq("a"));
+    EXPECT_THAT(copy_struct_equal(&a, &b), Eq(0));
+}
+
+TEST_F(NAME, copy_reuses_capacity)
+{
+    parse(&a, full);
+    parse(&b, "[copy]\nstr = \"A longer string\"\nlist = \"1\", \"2\"\n");
+    char*  str = b.str;
+    char** list = b.list;
+
+    /* The string buffer and the list block are kept, list elements are
+     * allocated one by one */
+    ASSERT_THAT(copy_struct_copy(&b, &a), Eq(0));
+    EXPECT_THAT(b.str, Eq(str));
+    EXPECT_THAT(b.list, Eq(list));
+    EXPECT_THAT(copy_struct_equal(&a, &b), Eq(1));
+}
+
+TEST_F(NAME, copy_to_self)
+{
+    parse(&a, full);
+    ASSERT_THAT(copy_struct_copy(&a, &a), Eq(0));
+    EXPECT_THAT(a.str, StrEq("Hello"));
+    EXPECT_THAT(a.list[1], StrEq("bc"));
+}
+
+TEST_F(NAME, move_leaves_source_initialized)
+{
+    parse(&a, full);
+    char* str = a.str;
+    char** list = a.list;
+    ASSERT_THAT(copy_struct_move(&b, &a), Eq(0));
+
+    EXPECT_THAT(b.str, Eq(str));
+    EXPECT_THAT(b.list, Eq(list));
+    EXPECT_THAT(b.value, Eq(5));
+    EXPECT_THAT(custom_strlist_count(b.custom_list), Eq(2));
+    EXPECT_THAT(a.str, StrEq("default"));
+    EXPECT_THAT(a.list[0], IsNull());
+    EXPECT_THAT(a.value, Eq(0));
+}
+
+TEST_F(NAME, failed_move_changes_nothing)
+{
+    parse(&a, full);
+    char* str = a.str;
+    custom_str_fail_next_init();
+    ASSERT_THAT(copy_struct_move(&b, &a), Eq(-1));
+    EXPECT_THAT(a.str, Eq(str));
+    EXPECT_THAT(a.value, Eq(5));
+    EXPECT_THAT(b.str, StrEq("default"));
+    EXPECT_THAT(b.value, Eq(0));
+}
+
+TEST_F(NAME, equal)
+{
+    EXPECT_THAT(copy_struct_equal(&a, &b), Eq(1));
+    parse(&a, "[copy]\nlist = \"a\"\n");
+    EXPECT_THAT(copy_struct_equal(&a, &b), Eq(0));
+    parse(&b, "[copy]\nlist = \"a\"\n");
+    EXPECT_THAT(copy_struct_equal(&a, &b), Eq(1));
+    parse(&b, "[copy]\nfixed_list = \"a\"\n");
+    EXPECT_THAT(copy_struct_equal(&a, &b), Eq(0));
+}
+
+TEST_F(NAME, hash)
+{
+    EXPECT_THAT(copy_struct_hash(&a), Eq(copy_struct_hash(&b)));
+
+    /* Strings in lists are delimited */
+    parse(&a, "[copy]\nlist = \"ab\", \"c\"\n");
+    parse(&b, "[copy]\nlist = \"a\", \"bc\"\n");
+    EXPECT_THAT(copy_struct_hash(&a), Ne(copy_struct_hash(&b)));
+
+    /* -0.0 and 0.0 are equal, so they hash the same */
+    parse(&a, "[copy]\nlist = \"a\", \"bc\"\nratio = -0.0\n");
+    parse(&b, "[copy]\nratio = 0.0\n");
+    ASSERT_THAT(copy_struct_equal(&a, &b), Eq(1));
+    EXPECT_THAT(copy_struct_hash(&a), Eq(copy_struct_hash(&b)));
+
+    parse(&b, "[copy]\nvalue = 1\n");
+    EXPECT_THAT(copy_struct_hash(&a), Ne(copy_struct_hash(&b)));
+}
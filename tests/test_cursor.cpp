@@ -0,0 +1,144 @@
+#include "test_cursor.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdlib>
+#include <string>
+
+#define NAME cursor
+
+SECTION("record")
+struct cursor_struct
+{
+    char* name;
+    int   value DEFAULT(-1);
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        allocator.alloc = [](void* ctx, size_t size) -> void* {
+            static_cast<struct NAME*>(ctx)->allocs++;
+            return malloc(size);
+        };
+        allocator.realloc = [](void* ctx, void* ptr, size_t size) -> void* {
+            static_cast<struct NAME*>(ctx)->allocs++;
+            return realloc(ptr, size);
+        };
+        allocator.free = [](void*, void* ptr) { free(ptr); };
+        allocator.ctx = this;
+        opts.allocator = &allocator;
+        for (auto& s : batch)
+            cursor_struct_init(&s);
+    }
+    void TearDown() override
+    {
+        for (auto& s : batch)
+            cursor_struct_deinit(&s);
+    }
+
+    static std::string records(int count)
+    {
+        std::string ini;
+        for (int i = 0; i != count; ++i)
+            ini += "[record]\nname = \"record " + std::to_string(i % 10) +
+                   "\"\nvalue = " + std::to_string(i) + "\n[other]\nx = 1\n";
+        return ini;
+    }
+
+    void init(const std::string& ini)
+    {
+        cursor_struct_cursor_init(
+            &c, "<stdin>", ini.data(), (int)ini.size(), &opts);
+    }
+
+    struct c_ini_allocator allocator;
+    struct c_ini_options   opts = {};
+    struct c_ini_cursor    c;
+    struct cursor_struct   batch[4];
+    int                    allocs = 0;
+};
+
+using namespace testing;
+
+TEST_F(NAME, next)
+{
+    std::string ini = records(3);
+    init(ini);
+    for (int i = 0; i != 3; ++i)
+    {
+        ASSERT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(1));
+        EXPECT_THAT(batch[0].value, Eq(i));
+        EXPECT_THAT(batch[0].name, StrEq("record " + std::to_string(i)));
+    }
+    EXPECT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(0));
+    EXPECT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(0));
+}
+
+TEST_F(NAME, missing_keys_are_reset)
+{
+    std::string ini = "[record]\nname = \"a\"\nvalue = 5\n[record]\n";
+    init(ini);
+    ASSERT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(1));
+    ASSERT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(1));
+    EXPECT_THAT(batch[0].name, StrEq(""));
+    EXPECT_THAT(batch[0].value, Eq(-1));
+}
+
+TEST_F(NAME, no_allocations_per_record)
+{
+    std::string ini = records(1000);
+    int         count = 0;
+    init(ini);
+    ASSERT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(1));
+    int first = allocs;
+    const char* buffer = batch[0].name;
+    while (cursor_struct_cursor_next(&c, &batch[0]) == 1)
+        count++;
+    EXPECT_THAT(count, Eq(999));
+    EXPECT_THAT(allocs, Eq(first));
+    EXPECT_THAT(batch[0].name, Eq(buffer));
+}
+
+TEST_F(NAME, batch)
+{
+    std::string ini = records(10);
+    init(ini);
+    ASSERT_THAT(cursor_struct_cursor_next_batch(&c, batch, 4), Eq(4));
+    EXPECT_THAT(batch[3].value, Eq(3));
+    ASSERT_THAT(cursor_struct_cursor_next_batch(&c, batch, 4), Eq(4));
+    EXPECT_THAT(batch[0].value, Eq(4));
+    ASSERT_THAT(cursor_struct_cursor_next_batch(&c, batch, 4), Eq(2));
+    EXPECT_THAT(batch[1].value, Eq(9));
+    EXPECT_THAT(cursor_struct_cursor_next_batch(&c, batch, 4), Eq(0));
+}
+
+TEST_F(NAME, error)
+{
+    std::string ini =
+        "[record]\nvalue = 1\n[record]\nvalue = \"x\"\n[record]\nvalue = 3\n";
+    opts.diagnostics = tmpfile();
+    init(ini);
+    ASSERT_THAT(cursor_struct_cursor_next_batch(&c, batch, 4), Eq(1));
+    EXPECT_THAT(batch[0].value, Eq(1));
+    EXPECT_THAT(c.error, Eq(1));
+    EXPECT_THAT(c.offset, Eq((int)ini.find("[record]\nvalue = \"x\"")));
+    EXPECT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(-1));
+    fclose(opts.diagnostics);
+}
+
+TEST_F(NAME, limits_apply_across_batches)
+{
+    struct c_ini_limits limits = {};
+    std::string         ini = records(3);
+    limits.max_sections = 4;
+    opts.limits = &limits;
+    opts.diagnostics = tmpfile();
+    init(ini);
+    /* Every record is followed by an [other] section */
+    ASSERT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(1));
+    ASSERT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(1));
+    EXPECT_THAT(cursor_struct_cursor_next(&c, &batch[0]), Eq(-1));
+    fclose(opts.diagnostics);
+}
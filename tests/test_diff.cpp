@@ -0,0 +1,150 @@
+#include "test_diff.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#define NAME diff
+
+SECTION("diff")
+struct diff_struct
+{
+    char*    str;
+    char**   list;
+    char     fixed[16];
+    int      value;
+    float    ratio;
+    unsigned bit : 1;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        diff_struct_init(&a);
+        diff_struct_init(&b);
+    }
+    void TearDown() override
+    {
+        diff_struct_deinit(&a);
+        diff_struct_deinit(&b);
+    }
+
+    void parse(struct diff_struct* s, const char* ini)
+    {
+        ASSERT_THAT(
+            diff_struct_parse(s, "<stdin>", ini, strlen(ini)), testing::Eq(0));
+    }
+
+    std::string patch()
+    {
+        FILE* f = tmpfile();
+        char  buf[1024];
+        size_t len;
+        diff_struct_write_patch(&a, &b, f);
+        rewind(f);
+        len = fread(buf, 1, sizeof(buf), f);
+        fclose(f);
+        return std::string(buf, len);
+    }
+
+    static int on_change(
+        enum diff_struct_field field,
+        const void*            old_value,
+        const void*            new_value,
+        void*                  user)
+    {
+        auto* self = static_cast<struct NAME*>(user);
+        self->fields.push_back(field);
+        if (field == DIFF_STRUCT_FIELD_VALUE)
+        {
+            self->old_int = *static_cast<const int*>(old_value);
+            self->new_int = *static_cast<const int*>(new_value);
+        }
+        if (field == DIFF_STRUCT_FIELD_BIT)
+            self->new_bit = *static_cast<const int*>(new_value);
+        return 0;
+    }
+
+    struct diff_struct                  a;
+    struct diff_struct                  b;
+    std::vector<enum diff_struct_field> fields;
+    int                                 old_int = 0;
+    int                                 new_int = 0;
+    int                                 new_bit = 0;
+};
+
+using namespace testing;
+
+TEST_F(NAME, no_changes)
+{
+    parse(&a, "[diff]\nstr = \"x\"\nlist = \"a\"\n");
+    parse(&b, "[diff]\nstr = \"x\"\nlist = \"a\"\n");
+    EXPECT_THAT(diff_struct_diff(&a, &b, on_change, this), Eq(0));
+    EXPECT_THAT(fields, IsEmpty());
+    EXPECT_THAT(patch(), StrEq(""));
+}
+
+TEST_F(NAME, reports_changed_fields)
+{
+    parse(&a, "[diff]\nstr = \"x\"\nvalue = 1\nratio = 0.5\n");
+    parse(&b, "[diff]\nstr = \"x\"\nvalue = 2\nlist = \"a\"\nbit = 1\n");
+    EXPECT_THAT(diff_struct_diff(&a, &b, on_change, this), Eq(4));
+    EXPECT_THAT(
+        fields,
+        ElementsAre(
+            DIFF_STRUCT_FIELD_LIST,
+            DIFF_STRUCT_FIELD_VALUE,
+            DIFF_STRUCT_FIELD_RATIO,
+            DIFF_STRUCT_FIELD_BIT));
+    EXPECT_THAT(old_int, Eq(1));
+    EXPECT_THAT(new_int, Eq(2));
+    EXPECT_THAT(new_bit, Eq(1));
+}
+
+TEST_F(NAME, count_only)
+{
+    parse(&b, "[diff]\nfixed = \"f\"\n");
+    EXPECT_THAT(diff_struct_diff(&a, &b, NULL, NULL), Eq(1));
+}
+
+TEST_F(NAME, callback_stops)
+{
+    parse(&b, "[diff]\nstr = \"x\"\nvalue = 1\n");
+    EXPECT_THAT(
+        diff_struct_diff(
+            &a,
+            &b,
+            [](enum diff_struct_field, const void*, const void*, void*) {
+                return 1;
+            },
+            NULL),
+        Eq(-1));
+}
+
+TEST_F(NAME, patch_contains_changed_keys)
+{
+    parse(&a, "[diff]\nstr = \"x\"\nlist = \"a\"\nvalue = 1\n");
+    parse(
+        &b,
+        "[diff]\nstr = \"x\"\nlist = \"a\", \"b\"\nfixed = \"new\"\n"
+        "value = 1\n");
+    EXPECT_THAT(
+        patch(), StrEq("[diff]\nlist = \"a\", \"b\"\nfixed = \"new\"\n\n"));
+}
+
+TEST_F(NAME, patch_applies)
+{
+    parse(&a, "[diff]\nstr = \"x\"\nlist = \"a\"\nvalue = 1\nbit = 1\n");
+    parse(&b, "[diff]\nstr = \"y\"\nlist = \"b\", \"c\"\nvalue = 1\n");
+    std::string p = patch();
+
+    struct diff_struct c;
+    diff_struct_init(&c);
+    ASSERT_THAT(diff_struct_copy(&c, &a), Eq(0));
+    ASSERT_THAT(diff_struct_parse(&c, "<patch>", p.data(), p.size()), Eq(0));
+    EXPECT_THAT(diff_struct_equal(&c, &b), Eq(1));
+    diff_struct_deinit(&c);
+}
@@ -56,6 +56,31 @@ TEST_F(NAME, str_too_long)
     ASSERT_THAT(s.strlist[0], StrEq("")); // Should not have changed
 }
 
+TEST_F(NAME, too_many_strings)
+{
+    const char* ini = "[fixed_strlist]\nstrlist = \"1\", \"2\", \"3\", "
+                      "\"4\", \"5\"\n";
+    internal::CaptureStderr();
+    ASSERT_THAT(
+        fixed_strlist_struct_parse(&s, "<stdin>", ini, strlen(ini)), Eq(-1));
+    EXPECT_THAT(
+        internal::GetCapturedStderr(),
+        HasSubstr("Too many strings in list. Max size is 4 strings."));
+    ASSERT_THAT(s.strlist[3], StrEq("4"));
+}
+
+TEST_F(NAME, str_too_long_reports_the_size)
+{
+    const char* ini =
+        "[fixed_strlist]\nstrlist = \"This string is too long\"\n";
+    internal::CaptureStderr();
+    ASSERT_THAT(
+        fixed_strlist_struct_parse(&s, "<stdin>", ini, strlen(ini)), Eq(-1));
+    EXPECT_THAT(
+        internal::GetCapturedStderr(),
+        HasSubstr("String literal is too large. Max size is 16 bytes."));
+}
+
 TEST_F(NAME, third_str_too_long)
 {
     const char* ini =
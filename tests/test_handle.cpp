@@ -0,0 +1,138 @@
+#include "test_handle.h"
+
+#include "gmock/gmock.h"
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NAME handle
+
+SECTION("handle") WITH(handle)
+struct handle_struct
+{
+    char* name DEFAULT("default");
+    int   value;
+    int   twice;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override { ASSERT_THAT(handle_struct_handle_init(&h), testing::Eq(0)); }
+    void TearDown() override { handle_struct_handle_deinit(&h); }
+
+    int publish(int value)
+    {
+        std::string ini = "[handle]\nname = \"config " + std::to_string(value) +
+                          "\"\nvalue = " + std::to_string(value) +
+                          "\ntwice = " + std::to_string(value * 2) + "\n";
+        return handle_struct_handle_parse(&h, "<stdin>", ini.data(), ini.size());
+    }
+
+    struct handle_struct_handle h;
+};
+
+using namespace testing;
+
+TEST_F(NAME, init_publishes_defaults)
+{
+    int reader = handle_struct_handle_register(&h);
+    ASSERT_THAT(reader, Ge(0));
+    const struct handle_struct* s = handle_struct_handle_read_lock(&h, reader);
+    EXPECT_THAT(s->name, StrEq("default"));
+    EXPECT_THAT(s->value, Eq(0));
+    handle_struct_handle_read_unlock(&h, reader);
+    handle_struct_handle_unregister(&h, reader);
+}
+
+TEST_F(NAME, readers_keep_their_snapshot)
+{
+    int reader = handle_struct_handle_register(&h);
+    ASSERT_THAT(publish(1), Eq(0));
+    const struct handle_struct* s = handle_struct_handle_read_lock(&h, reader);
+
+    /* The snapshot the reader holds is kept until it lets go */
+    ASSERT_THAT(publish(2), Eq(0));
+    ASSERT_THAT(publish(3), Eq(0));
+    EXPECT_THAT(s->value, Eq(1));
+    EXPECT_THAT(s->name, StrEq("config 1"));
+    EXPECT_THAT(handle_struct_handle_reclaim(&h), Eq(2));
+
+    handle_struct_handle_read_unlock(&h, reader);
+    EXPECT_THAT(handle_struct_handle_reclaim(&h), Eq(0));
+    s = handle_struct_handle_read_lock(&h, reader);
+    EXPECT_THAT(s->value, Eq(3));
+    handle_struct_handle_read_unlock(&h, reader);
+    handle_struct_handle_unregister(&h, reader);
+}
+
+TEST_F(NAME, failed_parse_keeps_current)
+{
+    const char* ini = "[handle]\nvalue = \"x\"\n";
+    ASSERT_THAT(publish(1), Eq(0));
+    ASSERT_THAT(
+        handle_struct_handle_parse(&h, "<stdin>", ini, strlen(ini)), Eq(-1));
+
+    int reader = handle_struct_handle_register(&h);
+    EXPECT_THAT(handle_struct_handle_read_lock(&h, reader)->value, Eq(1));
+    handle_struct_handle_read_unlock(&h, reader);
+    handle_struct_handle_unregister(&h, reader);
+}
+
+TEST_F(NAME, publish_moves)
+{
+    struct handle_struct s;
+    handle_struct_init(&s);
+    s.value = 5;
+    ASSERT_THAT(handle_struct_handle_publish(&h, &s), Eq(0));
+    EXPECT_THAT(s.value, Eq(0));
+    handle_struct_deinit(&s);
+
+    int reader = handle_struct_handle_register(&h);
+    EXPECT_THAT(handle_struct_handle_read_lock(&h, reader)->value, Eq(5));
+    handle_struct_handle_read_unlock(&h, reader);
+    handle_struct_handle_unregister(&h, reader);
+}
+
+TEST_F(NAME, reader_slots_run_out)
+{
+    std::vector<int> readers;
+    for (int i = 0; i != C_INI_MAX_READERS; ++i)
+        readers.push_back(handle_struct_handle_register(&h));
+    EXPECT_THAT(handle_struct_handle_register(&h), Eq(-1));
+    handle_struct_handle_unregister(&h, readers[3]);
+    EXPECT_THAT(handle_struct_handle_register(&h), Eq(readers[3]));
+}
+
+TEST_F(NAME, concurrent_readers)
+{
+    std::atomic<bool>        done{false};
+    std::atomic<int>         errors{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t != 4; ++t)
+        threads.emplace_back([&] {
+            int reader = handle_struct_handle_register(&h);
+            int last = 0;
+            while (!done)
+            {
+                const struct handle_struct* s =
+                    handle_struct_handle_read_lock(&h, reader);
+                if (s->twice != s->value * 2 || s->value < last ||
+                    (s->value != 0 &&
+                     std::string(s->name) !=
+                         "config " + std::to_string(s->value)))
+                    ++errors;
+                last = s->value;
+                handle_struct_handle_read_unlock(&h, reader);
+            }
+            handle_struct_handle_unregister(&h, reader);
+        });
+    for (int i = 1; i != 2000; ++i)
+        ASSERT_THAT(publish(i), Eq(0));
+    done = true;
+    for (auto& thread : threads)
+        thread.join();
+    EXPECT_THAT(errors.load(), Eq(0));
+    EXPECT_THAT(handle_struct_handle_reclaim(&h), Eq(0));
+}
@@ -0,0 +1,128 @@
+#include "test_instrumentation.h"
+
+#include "gmock/gmock.h"
+
+#include <string>
+#include <vector>
+
+#define NAME instrumentation
+
+SECTION("instrumentation")
+struct instrumentation_struct
+{
+    char* str;
+    char** list;
+    int value;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        instrumentation_struct_init(&s);
+        hooks.document_begin = on_event<'D'>;
+        hooks.document_end = on_event<'d'>;
+        hooks.section_begin = on_event<'S'>;
+        hooks.section_end = on_event<'s'>;
+        hooks.key_begin = on_event<'K'>;
+        hooks.key_end = on_event<'k'>;
+        hooks.user = this;
+        opts.hooks = &hooks;
+        opts.stats = &stats;
+    }
+    void TearDown() override { instrumentation_struct_deinit(&s); }
+
+    template <char C>
+    static void on_event(void* user, const char* name, uint64_t cycles)
+    {
+        auto* self = static_cast<struct NAME*>(user);
+        EXPECT_THAT(cycles, testing::Ge(self->last_cycles));
+        self->last_cycles = cycles;
+        self->events.push_back(std::string(1, C) + name);
+    }
+
+    struct instrumentation_struct s;
+    struct c_ini_hooks            hooks = {};
+    struct c_ini_stats            stats = {};
+    struct c_ini_options          opts = {};
+    std::vector<std::string>      events;
+    uint64_t                      last_cycles = 0;
+};
+
+using namespace testing;
+
+TEST_F(NAME, hooks_fire_in_order)
+{
+    const char* ini =
+        "[instrumentation]\nvalue = 5\nstr = \"Hello\"\n"
+        "[other]\nvalue = 6\n";
+    ASSERT_THAT(
+        instrumentation_struct_parse_opts(
+            &s, "file.ini", ini, strlen(ini), &opts),
+        Eq(0));
+    ASSERT_THAT(
+        events,
+        ElementsAre(
+            "Dfile.ini",
+            "Sinstrumentation",
+            "Kvalue",
+            "kvalue",
+            "Kstr",
+            "kstr",
+            "sinstrumentation",
+            "dfile.ini"));
+}
+
+TEST_F(NAME, stats_are_counted)
+{
+    const char* ini =
+        "[other]\nvalue = 1\n"
+        "[instrumentation]\nvalue = 5\nlist = \"a\", \"b\", \"c\"\n"
+        "[instrumentation]\nstr = \"Hello\"\n";
+    ASSERT_THAT(
+        instrumentation_struct_parse_all_opts(
+            "<stdin>",
+            ini,
+            strlen(ini),
+            [](struct c_ini_parser* p, void* user) -> int {
+                return instrumentation_struct_parse_section(
+                    static_cast<struct instrumentation_struct*>(user), p);
+            },
+            &s,
+            &opts),
+        Eq(0));
+    EXPECT_THAT(stats.bytes, Eq(strlen(ini)));
+    EXPECT_THAT(stats.sections_matched, Eq(2u));
+    EXPECT_THAT(stats.sections_skipped, Eq(1u));
+    EXPECT_THAT(stats.keys, Eq(3u));
+    EXPECT_THAT(stats.allocations, Eq(4u));
+    EXPECT_THAT(stats.tokens, Gt(20u));
+    EXPECT_THAT(stats.cycles, Gt(0u));
+    ASSERT_THAT(s.value, Eq(5));
+    ASSERT_THAT(s.str, StrEq("Hello"));
+}
+
+TEST_F(NAME, stats_accumulate)
+{
+    const char* ini = "[instrumentation]\nvalue = 5\n";
+    ASSERT_THAT(
+        instrumentation_struct_parse_opts(
+            &s, "<stdin>", ini, strlen(ini), &opts),
+        Eq(0));
+    ASSERT_THAT(
+        instrumentation_struct_parse_opts(
+            &s, "<stdin>", ini, strlen(ini), &opts),
+        Eq(0));
+    EXPECT_THAT(stats.sections_matched, Eq(2u));
+    EXPECT_THAT(stats.keys, Eq(2u));
+}
+
+TEST_F(NAME, no_options)
+{
+    const char* ini = "[instrumentation]\nvalue = 5\n";
+    ASSERT_THAT(
+        instrumentation_struct_parse_opts(&s, "<stdin>", ini, strlen(ini), NULL),
+        Eq(0));
+    ASSERT_THAT(s.value, Eq(5));
+    ASSERT_THAT(events, IsEmpty());
+}
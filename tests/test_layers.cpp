@@ -0,0 +1,114 @@
+#include "test_layers.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdlib>
+#include <vector>
+
+#define NAME layers
+
+SECTION("layers") WITH(layers)
+struct layers_struct
+{
+    char*   str DEFAULT("default");
+    char**  list;
+    int16_t value DEFAULT(7) CONSTRAIN(0, 10);
+    float   ratio;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        allocator.alloc = [](void* ctx, size_t size) -> void* {
+            ++*static_cast<int*>(ctx);
+            return malloc(size);
+        };
+        allocator.realloc = [](void* ctx, void* ptr, size_t size) -> void* {
+            ++*static_cast<int*>(ctx);
+            return realloc(ptr, size);
+        };
+        allocator.free = [](void*, void* ptr) { free(ptr); };
+        allocator.ctx = &allocs;
+        layers_struct_set_allocator(&allocator);
+        layers_struct_init(&s);
+    }
+    void TearDown() override
+    {
+        layers_struct_deinit(&s);
+        layers_struct_set_allocator(NULL);
+    }
+
+    /* Lowest priority first */
+    int parse(std::vector<const char*> docs)
+    {
+        std::vector<const char*> filenames(docs.size(), "<stdin>");
+        std::vector<int>         lens;
+        for (const char* doc : docs)
+            lens.push_back(strlen(doc));
+        return layers_struct_parse_layers(
+            &s, filenames.data(), docs.data(), lens.data(), docs.size());
+    }
+
+    struct layers_struct   s;
+    struct c_ini_allocator allocator;
+    int                    allocs = 0;
+};
+
+using namespace testing;
+
+TEST_F(NAME, higher_layers_win)
+{
+    ASSERT_THAT(
+        parse(
+            {"[layers]\nstr = \"system\"\nvalue = 1\n",
+             "[layers]\nvalue = 2\n",
+             "[layers]\nratio = 0.5\n"}),
+        Eq(0));
+    EXPECT_THAT(s.str, StrEq("system"));
+    EXPECT_THAT(s.value, Eq(2));
+    EXPECT_THAT(s.ratio, FloatEq(0.5f));
+    EXPECT_THAT(s.list[0], IsNull());
+}
+
+TEST_F(NAME, shadowed_values_are_not_decoded)
+{
+    /* The lower layer's value would fail CONSTRAIN() and allocate */
+    ASSERT_THAT(
+        parse(
+            {"[layers]\nstr = \"system\"\nvalue = 50\n",
+             "[layers]\nstr = \"host\"\nvalue = 3\n"}),
+        Eq(0));
+    EXPECT_THAT(s.str, StrEq("host"));
+    EXPECT_THAT(s.value, Eq(3));
+    EXPECT_THAT(allocs, Eq(1));
+}
+
+TEST_F(NAME, last_key_in_a_layer_wins)
+{
+    ASSERT_THAT(
+        parse({"[layers]\nvalue = 1\n", "[layers]\nvalue = 2\nvalue = 3\n"}),
+        Eq(0));
+    EXPECT_THAT(s.value, Eq(3));
+}
+
+TEST_F(NAME, lower_layers_are_skipped_once_every_field_is_set)
+{
+    ASSERT_THAT(
+        parse(
+            {"this is not an INI file [",
+             "[layers]\nstr = \"a\"\nlist = \"b\"\nvalue = 1\nratio = 2\n"}),
+        Eq(0));
+    EXPECT_THAT(s.list[0], StrEq("b"));
+
+    ASSERT_THAT(
+        parse({"this is not an INI file [", "[layers]\nstr = \"a\"\n"}),
+        Eq(-1));
+}
+
+TEST_F(NAME, no_layers)
+{
+    ASSERT_THAT(parse({}), Eq(0));
+    EXPECT_THAT(s.str, StrEq("default"));
+    EXPECT_THAT(s.value, Eq(7));
+}
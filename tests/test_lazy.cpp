@@ -0,0 +1,94 @@
+#include "test_lazy.h"
+
+#include "gmock/gmock.h"
+
+#define NAME lazy
+
+SECTION("lazy") WITH(lazy)
+struct lazy_struct
+{
+    char*   str DEFAULT("default");
+    char**  list;
+    int16_t value DEFAULT(7) CONSTRAIN(0, 10);
+    float   ratio;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override { lazy_struct_init(&s); }
+    void TearDown() override { lazy_struct_deinit(&s); }
+
+    struct lazy_struct      s;
+    struct lazy_struct_lazy l;
+};
+
+using namespace testing;
+
+TEST_F(NAME, parse_only_records_offsets)
+{
+    const char* ini =
+        "[lazy]\nstr = \"Hello\"\nvalue = 5\nlist = \"a\", \"b\"\n";
+    ASSERT_THAT(
+        lazy_struct_parse_lazy(&l, &s, "<stdin>", ini, strlen(ini)), Eq(0));
+    EXPECT_THAT(s.str, StrEq("default"));
+    EXPECT_THAT(s.value, Eq(7));
+    EXPECT_THAT(l.offsets[LAZY_STRUCT_FIELD_RATIO], Eq(-1));
+
+    ASSERT_THAT(lazy_struct_get_value(&l), Eq(0));
+    EXPECT_THAT(s.value, Eq(5));
+    EXPECT_THAT(s.str, StrEq("default"));
+
+    ASSERT_THAT(lazy_struct_get_str(&l), Eq(0));
+    ASSERT_THAT(lazy_struct_get_list(&l), Eq(0));
+    EXPECT_THAT(s.str, StrEq("Hello"));
+    EXPECT_THAT(s.list[0], StrEq("a"));
+    EXPECT_THAT(s.list[1], StrEq("b"));
+    EXPECT_THAT(s.list[2], IsNull());
+}
+
+TEST_F(NAME, values_are_cached)
+{
+    const char* ini = "[lazy]\nvalue = 5\n";
+    ASSERT_THAT(
+        lazy_struct_parse_lazy(&l, &s, "<stdin>", ini, strlen(ini)), Eq(0));
+    ASSERT_THAT(lazy_struct_get_value(&l), Eq(0));
+    s.value = 3;
+    ASSERT_THAT(lazy_struct_get_value(&l), Eq(0));
+    EXPECT_THAT(s.value, Eq(3));
+}
+
+TEST_F(NAME, missing_keys_keep_their_value)
+{
+    const char* ini = "[lazy]\nvalue = 5\n";
+    ASSERT_THAT(
+        lazy_struct_parse_lazy(&l, &s, "<stdin>", ini, strlen(ini)), Eq(0));
+    ASSERT_THAT(lazy_struct_get_ratio(&l), Eq(0));
+    EXPECT_THAT(s.ratio, Eq(0.0f));
+}
+
+TEST_F(NAME, only_the_first_section_is_used)
+{
+    const char* ini = "[lazy]\nvalue = 5\n[other]\n[lazy]\nvalue = 6\n";
+    ASSERT_THAT(
+        lazy_struct_parse_lazy(&l, &s, "<stdin>", ini, strlen(ini)), Eq(0));
+    ASSERT_THAT(lazy_struct_get_value(&l), Eq(0));
+    EXPECT_THAT(s.value, Eq(5));
+}
+
+TEST_F(NAME, constraints_are_checked_on_access)
+{
+    const char* ini = "[lazy]\nvalue = 50\nstr = \"x\"\n";
+    ASSERT_THAT(
+        lazy_struct_parse_lazy(&l, &s, "<stdin>", ini, strlen(ini)), Eq(0));
+    EXPECT_THAT(lazy_struct_get_value(&l), Eq(-1));
+    EXPECT_THAT(lazy_struct_get_str(&l), Eq(0));
+    EXPECT_THAT(s.str, StrEq("x"));
+}
+
+TEST_F(NAME, syntax_errors_are_found_while_parsing)
+{
+    const char* ini = "[lazy]\nvalue = 5\nlist = \"a\",\n";
+    EXPECT_THAT(
+        lazy_struct_parse_lazy(&l, &s, "<stdin>", ini, strlen(ini)),
+        Eq(-1));
+}
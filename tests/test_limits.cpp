@@ -0,0 +1,138 @@
+#include "test_limits.h"
+
+#include "gmock/gmock.h"
+
+#include <string>
+
+#define NAME limits
+
+SECTION("limits")
+struct limits_struct
+{
+    char*  str;
+    char** list;
+    char   fixed[16];
+    int    value;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        limits_struct_init(&s);
+        opts.limits = &caps;
+    }
+    void TearDown() override { limits_struct_deinit(&s); }
+
+    int parse(const std::string& ini)
+    {
+        return limits_struct_parse_opts(
+            &s, "<stdin>", ini.data(), ini.size(), &opts);
+    }
+    int parse_all(const std::string& ini)
+    {
+        return limits_struct_parse_all_opts(
+            "<stdin>",
+            ini.data(),
+            ini.size(),
+            [](struct c_ini_parser* p, void* user) -> int {
+                return limits_struct_parse_section(
+                    static_cast<struct limits_struct*>(user), p);
+            },
+            &s,
+            &opts);
+    }
+
+    struct limits_struct s;
+    struct c_ini_limits  caps = {};
+    struct c_ini_options opts = {};
+};
+
+using namespace testing;
+
+TEST_F(NAME, no_limits)
+{
+    EXPECT_THAT(
+        parse("[limits]\nstr = \"" + std::string(10000, 'x') + "\"\n"), Eq(0));
+    EXPECT_THAT(strlen(s.str), Eq(10000u));
+}
+
+TEST_F(NAME, max_bytes)
+{
+    std::string ini = "[limits]\nvalue = 5\n";
+    caps.max_bytes = ini.size();
+    EXPECT_THAT(parse(ini), Eq(0));
+    caps.max_bytes = ini.size() - 1;
+    EXPECT_THAT(parse(ini), Eq(-1));
+}
+
+TEST_F(NAME, max_sections_counts_skipped_sections)
+{
+    caps.max_sections = 2;
+    EXPECT_THAT(parse_all("[other]\n[limits]\nvalue = 5\n"), Eq(0));
+    EXPECT_THAT(parse_all("[other]\n[other]\n[limits]\nvalue = 5\n"), Eq(-1));
+}
+
+TEST_F(NAME, max_keys_per_section)
+{
+    caps.max_keys_per_section = 2;
+    EXPECT_THAT(
+        parse_all("[limits]\nvalue = 1\nvalue = 2\n[limits]\nvalue = 3\n"),
+        Eq(0));
+    EXPECT_THAT(s.value, Eq(3));
+    EXPECT_THAT(
+        parse_all("[limits]\nvalue = 1\nvalue = 2\nvalue = 3\n"), Eq(-1));
+}
+
+TEST_F(NAME, max_list_elements)
+{
+    caps.max_list_elements = 2;
+    EXPECT_THAT(parse("[limits]\nlist = \"a\", \"b\"\n"), Eq(0));
+    EXPECT_THAT(parse("[limits]\nlist = \"a\", \"b\", \"c\"\n"), Eq(-1));
+}
+
+TEST_F(NAME, max_list_elements_of_skipped_values)
+{
+    uint32_t fields[C_INI_FIELD_WORDS(LIMITS_STRUCT_FIELDS_COUNT)] = {};
+    std::string ini = "[limits]\nlist = \"a\", \"b\", \"c\"\n";
+    caps.max_list_elements = 2;
+    EXPECT_THAT(
+        limits_struct_parse_fields_opts(
+            &s, fields, "<stdin>", ini.data(), ini.size(), &opts),
+        Eq(-1));
+}
+
+TEST_F(NAME, max_string_length)
+{
+    caps.max_string_length = 4;
+    EXPECT_THAT(parse("[limits]\nfixed = \"abcd\"\n"), Eq(0));
+    EXPECT_THAT(parse("[limits]\nfixed = \"abcde\"\n"), Eq(-1));
+    EXPECT_THAT(parse("[limits]\nstr = \"abcde\"\n"), Eq(-1));
+}
+
+TEST_F(NAME, unterminated_strings_stop_at_the_limit)
+{
+    struct c_ini_error error;
+    std::string        ini = "[limits]\nstr = \"" + std::string(100000, 'x');
+    caps.max_string_length = 16;
+    internal::CaptureStderr();
+    EXPECT_THAT(parse(ini), Eq(-1));
+    EXPECT_THAT(
+        internal::GetCapturedStderr(),
+        HasSubstr("String is longer than the limit of 16 bytes"));
+
+    caps.max_string_length = 0;
+    EXPECT_THAT(limits_struct_validate(ini.data(), ini.size(), &error), Eq(-1));
+    EXPECT_THAT(error.message, StrEq("Missing closing quote on string"));
+}
+
+TEST_F(NAME, max_allocated_bytes)
+{
+    /* Each string counts its length plus the terminator */
+    caps.max_allocated_bytes = 8;
+    EXPECT_THAT(parse("[limits]\nstr = \"abc\"\nlist = \"d\", \"e\"\n"), Eq(0));
+    EXPECT_THAT(
+        parse("[limits]\nstr = \"abc\"\nlist = \"d\", \"e\", \"f\"\n"), Eq(-1));
+    /* Fixed strings don't allocate */
+    EXPECT_THAT(parse("[limits]\nfixed = \"0123456789\"\n"), Eq(0));
+}
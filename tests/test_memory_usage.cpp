@@ -0,0 +1,76 @@
+#include "custom_str.h"
+#include "custom_strlist.h"
+#include "test_memory_usage.h"
+
+#include "gmock/gmock.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#define NAME memory_usage
+
+SECTION("memory_usage")
+struct memory_usage_struct
+{
+    char*           str;
+    char**          list;
+    struct str*     custom STRING(custom_str) MEMORY();
+    struct strlist* custom_list STRINGLIST(custom_strlist);
+    char            fixed[16];
+    int             value;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override { memory_usage_struct_init(&s); }
+    void TearDown() override { memory_usage_struct_deinit(&s); }
+
+    static void on_field(const char* name, size_t bytes, void* user)
+    {
+        static_cast<struct NAME*>(user)->fields.emplace_back(name, bytes);
+    }
+
+    struct memory_usage_struct                   s;
+    std::vector<std::pair<std::string, size_t>> fields;
+};
+
+using namespace testing;
+
+/* Built-in strings and lists are prefixed with their allocator, capacity and
+ * string count. Lists start with room for 4 pointers */
+static const size_t header = sizeof(void*) + 2 * sizeof(size_t);
+
+TEST_F(NAME, defaults)
+{
+    /* Empty built-in strings and lists don't allocate */
+    EXPECT_THAT(
+        memory_usage_struct_memory_usage(&s), Eq(custom_str_memory(s.custom)));
+}
+
+TEST_F(NAME, by_field)
+{
+    const char* ini =
+        "[memory_usage]\n"
+        "str = \"Hello\"\n"
+        "list = \"a\", \"bc\"\n"
+        "custom = \"custom\"\n"
+        "custom_list = \"x\", \"y\"\n"
+        "fixed = \"fixed\"\n"
+        "value = 5\n";
+    size_t total;
+    ASSERT_THAT(
+        memory_usage_struct_parse(&s, "<stdin>", ini, strlen(ini)), Eq(0));
+
+    total = memory_usage_struct_memory_usage_by_field(&s, on_field, this);
+    EXPECT_THAT(
+        fields,
+        ElementsAre(
+            Pair("str", header + 6),
+            Pair("list", header + 4 * sizeof(char*) + 2 + 3),
+            Pair("custom", custom_str_memory(s.custom))));
+    EXPECT_THAT(
+        total,
+        Eq(header + 6 + header + 4 * sizeof(char*) + 5 + fields[2].second));
+    EXPECT_THAT(memory_usage_struct_memory_usage(&s), Eq(total));
+}
@@ -0,0 +1,137 @@
+#include "test_parse_fields.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdlib>
+
+#define NAME parse_fields
+
+SECTION("parse_fields")
+struct parse_fields_struct
+{
+    char*  str DEFAULT("default");
+    char** list;
+    char   fixed[16];
+    int    value DEFAULT(7);
+    float  ratio;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        allocator.alloc = [](void* ctx, size_t size) -> void* {
+            ++*static_cast<int*>(ctx);
+            return malloc(size);
+        };
+        allocator.realloc = [](void*, void* ptr, size_t size) -> void* {
+            return realloc(ptr, size);
+        };
+        allocator.free = [](void*, void* ptr) { free(ptr); };
+        allocator.ctx = &allocs;
+        parse_fields_struct_set_allocator(&allocator);
+        parse_fields_struct_init(&s);
+    }
+    void TearDown() override
+    {
+        parse_fields_struct_deinit(&s);
+        parse_fields_struct_set_allocator(NULL);
+    }
+
+    struct parse_fields_struct s;
+    struct c_ini_allocator     allocator;
+    int                        allocs = 0;
+    uint32_t fields[C_INI_FIELD_WORDS(PARSE_FIELDS_STRUCT_FIELDS_COUNT)] = {};
+};
+
+using namespace testing;
+
+static const char* ini =
+    "[parse_fields]\n"
+    "str = \"Hello\"\n"
+    "list = \"a\", \"b\", \"c\"\n"
+    "fixed = \"fixed\"\n"
+    "value = 42\n"
+    "ratio = 0.5\n";
+
+TEST_F(NAME, only_requested_fields_are_written)
+{
+    C_INI_FIELD_SET(fields, PARSE_FIELDS_STRUCT_FIELD_VALUE);
+    C_INI_FIELD_SET(fields, PARSE_FIELDS_STRUCT_FIELD_FIXED);
+    ASSERT_THAT(
+        parse_fields_struct_parse_fields(
+            &s, fields, "<stdin>", ini, strlen(ini)),
+        Eq(0));
+    EXPECT_THAT(s.value, Eq(42));
+    EXPECT_THAT(s.fixed, StrEq("fixed"));
+    EXPECT_THAT(s.str, StrEq("default"));
+    EXPECT_THAT(s.list[0], IsNull());
+    EXPECT_THAT(s.ratio, FloatEq(0.0f));
+    /* Skipped strings and lists are never allocated */
+    EXPECT_THAT(allocs, Eq(0));
+}
+
+TEST_F(NAME, null_means_all_fields)
+{
+    ASSERT_THAT(
+        parse_fields_struct_parse_fields(&s, NULL, "<stdin>", ini, strlen(ini)),
+        Eq(0));
+    EXPECT_THAT(s.str, StrEq("Hello"));
+    EXPECT_THAT(s.list[2], StrEq("c"));
+    EXPECT_THAT(s.ratio, FloatEq(0.5f));
+}
+
+TEST_F(NAME, skipped_values_are_not_converted)
+{
+    const char* ini = "[parse_fields]\nvalue = \"not a number\"\nratio = 2\n";
+    C_INI_FIELD_SET(fields, PARSE_FIELDS_STRUCT_FIELD_RATIO);
+    ASSERT_THAT(
+        parse_fields_struct_parse_fields(
+            &s, fields, "<stdin>", ini, strlen(ini)),
+        Eq(0));
+    EXPECT_THAT(s.value, Eq(7));
+    EXPECT_THAT(s.ratio, FloatEq(2.0f));
+}
+
+TEST_F(NAME, skipped_values_are_tokenized)
+{
+    const char* ini = "[parse_fields]\nstr = \"a\", =\n";
+    EXPECT_THAT(
+        parse_fields_struct_parse_fields(
+            &s, fields, "<stdin>", ini, strlen(ini)),
+        Eq(-1));
+}
+
+TEST_F(NAME, skipped_values_end_where_the_tokenizer_ends_them)
+{
+    const char* ini = "[parse_fields]\n"
+                      "list = \"a,\\\"\n#\", # \"comment\n"
+                      "  \"b\" ; x = 1\n"
+                      "   , -1.5f, true\n"
+                      "str = \"x = 5\"\n"
+                      "ratio = -2.25\n"
+                      "value = 3\n";
+    C_INI_FIELD_SET(fields, PARSE_FIELDS_STRUCT_FIELD_VALUE);
+    C_INI_FIELD_SET(fields, PARSE_FIELDS_STRUCT_FIELD_RATIO);
+    ASSERT_THAT(
+        parse_fields_struct_parse_fields(
+            &s, fields, "<stdin>", ini, strlen(ini)),
+        Eq(0));
+    EXPECT_THAT(s.value, Eq(3));
+    EXPECT_THAT(s.ratio, FloatEq(-2.25f));
+    EXPECT_THAT(s.str, StrEq("default"));
+}
+
+TEST_F(NAME, skipped_values_must_be_values)
+{
+    const char* ini = "[parse_fields]\nstr = value = 3\n";
+    EXPECT_THAT(
+        parse_fields_struct_parse_fields(
+            &s, fields, "<stdin>", ini, strlen(ini)),
+        Eq(-1));
+    ini = "[parse_fields]\nstr = \"a\nvalue = 3\n";
+    EXPECT_THAT(
+        parse_fields_struct_parse_fields(
+            &s, fields, "<stdin>", ini, strlen(ini)),
+        Eq(-1));
+}
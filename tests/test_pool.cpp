@@ -0,0 +1,147 @@
+#include "test_pool.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#define NAME pool
+
+SECTION("pool")
+struct pool_struct
+{
+    char* name;
+    int   value DEFAULT(-1);
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override { pool_struct_pool_init(&records_pool, NULL); }
+    void TearDown() override { pool_struct_pool_deinit(&records_pool); }
+
+    static std::string records(int count)
+    {
+        std::string ini;
+        for (int i = 0; i != count; ++i)
+            ini += "[pool]\nname = \"record " + std::to_string(i) +
+                   "\"\nvalue = " + std::to_string(i) + "\n[other]\nx = 1\n";
+        return ini;
+    }
+
+    struct pool_struct_pool records_pool;
+};
+
+using namespace testing;
+
+TEST_F(NAME, records_are_contiguous_and_in_order)
+{
+    std::string ini = records(100);
+    ASSERT_THAT(
+        pool_struct_parse_all_into_pool(
+            &records_pool, "<stdin>", ini.data(), ini.size(), NULL),
+        Eq(0));
+    ASSERT_THAT(records_pool.count, Eq(100));
+
+    int i = 0;
+    for (struct pool_struct_pool_slab* slab = records_pool.first; slab;
+         slab = slab->next)
+    {
+        EXPECT_THAT(reinterpret_cast<uintptr_t>(slab->records) % 64, Eq(0u));
+        EXPECT_THAT(slab->count, Le(slab->capacity));
+        for (int j = 0; j != slab->count; ++j, ++i)
+        {
+            EXPECT_THAT(slab->records[j].value, Eq(i));
+            EXPECT_THAT(
+                slab->records[j].name, StrEq("record " + std::to_string(i)));
+        }
+    }
+    EXPECT_THAT(i, Eq(100));
+    EXPECT_THAT(records_pool.first->capacity, Eq(16));
+    EXPECT_THAT(records_pool.first->next->capacity, Eq(32));
+}
+
+TEST_F(NAME, for_each)
+{
+    std::string ini = records(40);
+    ASSERT_THAT(
+        pool_struct_parse_all_into_pool(
+            &records_pool, "<stdin>", ini.data(), ini.size(), NULL),
+        Eq(0));
+
+    int sum = 0;
+    ASSERT_THAT(
+        pool_struct_pool_for_each(
+            &records_pool,
+            [](struct pool_struct* s, void* user) -> int {
+                *static_cast<int*>(user) += s->value;
+                return 0;
+            },
+            &sum),
+        Eq(0));
+    EXPECT_THAT(sum, Eq(40 * 39 / 2));
+
+    ASSERT_THAT(
+        pool_struct_pool_for_each(
+            &records_pool,
+            [](struct pool_struct*, void*) -> int { return 1; },
+            NULL),
+        Eq(-1));
+}
+
+TEST_F(NAME, add_initializes_records)
+{
+    struct pool_struct* s = pool_struct_pool_add(&records_pool);
+    ASSERT_THAT(s, NotNull());
+    EXPECT_THAT(s->value, Eq(-1));
+    EXPECT_THAT(s->name, StrEq(""));
+    EXPECT_THAT(records_pool.count, Eq(1));
+}
+
+TEST_F(NAME, deinit_frees_all_slabs)
+{
+    struct counter
+    {
+        int allocs = 0;
+        int frees = 0;
+    } counter;
+    struct c_ini_allocator allocator;
+    allocator.alloc = [](void* ctx, size_t size) -> void* {
+        static_cast<struct counter*>(ctx)->allocs++;
+        return malloc(size);
+    };
+    allocator.realloc = [](void*, void* ptr, size_t size) -> void* {
+        return realloc(ptr, size);
+    };
+    allocator.free = [](void* ctx, void* ptr) {
+        static_cast<struct counter*>(ctx)->frees++;
+        free(ptr);
+    };
+    allocator.ctx = &counter;
+
+    pool_struct_pool_init(&records_pool, &allocator);
+    std::string ini = records(50);
+    ASSERT_THAT(
+        pool_struct_parse_all_into_pool(
+            &records_pool, "<stdin>", ini.data(), ini.size(), NULL),
+        Eq(0));
+    /* 16 + 32 + 64 records */
+    EXPECT_THAT(counter.allocs, Eq(3));
+
+    pool_struct_pool_deinit(&records_pool);
+    EXPECT_THAT(counter.frees, Eq(3));
+    EXPECT_THAT(records_pool.first, IsNull());
+    EXPECT_THAT(records_pool.count, Eq(0));
+}
+
+TEST_F(NAME, parse_error_keeps_parsed_records)
+{
+    const char* ini =
+        "[pool]\nvalue = 1\n[pool]\nvalue = 2\n[pool]\nvalue = \"x\"\n";
+    ASSERT_THAT(
+        pool_struct_parse_all_into_pool(
+            &records_pool, "<stdin>", ini, strlen(ini), NULL),
+        Eq(-1));
+    ASSERT_THAT(records_pool.count, Eq(3));
+    EXPECT_THAT(records_pool.first->records[1].value, Eq(2));
+}
@@ -0,0 +1,117 @@
+#include "test_reentrant.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NAME reentrant
+
+SECTION("reentrant")
+struct reentrant_struct
+{
+    char*  name;
+    char** tags;
+    int    value;
+};
+
+struct NAME : testing::Test
+{
+    static std::string read_all(FILE* f)
+    {
+        std::string str;
+        char        buf[256];
+        size_t      len;
+        rewind(f);
+        while ((len = fread(buf, 1, sizeof(buf), f)) > 0)
+            str.append(buf, len);
+        return str;
+    }
+};
+
+using namespace testing;
+
+TEST_F(NAME, diagnostics_go_to_options)
+{
+    const char*          ini = "[reentrant]\nvalue = \"x\"\n";
+    struct c_ini_options opts = {};
+    struct reentrant_struct s;
+    FILE*                f = tmpfile();
+    ASSERT_THAT(f, NotNull());
+    opts.diagnostics = f;
+    opts.disable_colors = 1;
+
+    ASSERT_THAT(reentrant_struct_init(&s), Eq(0));
+    EXPECT_THAT(
+        reentrant_struct_parse_opts(&s, "file.ini", ini, strlen(ini), &opts),
+        Eq(-1));
+    reentrant_struct_deinit(&s);
+
+    std::string out = read_all(f);
+    fclose(f);
+    EXPECT_THAT(out, StartsWith("file.ini:2:9: error: "));
+    EXPECT_THAT(out, HasSubstr(" 2 | value = \"x\"\n"));
+    EXPECT_THAT(out, Not(HasSubstr("\x1b[")));
+}
+
+TEST_F(NAME, concurrent_parses)
+{
+    const int                threads_count = 8;
+    const int                iterations = 200;
+    std::vector<std::thread> threads;
+    std::vector<FILE*>       files(threads_count);
+    std::vector<int>         failures(threads_count);
+
+    for (int t = 0; t != threads_count; ++t)
+    {
+        files[t] = tmpfile();
+        ASSERT_THAT(files[t], NotNull());
+    }
+    for (int t = 0; t != threads_count; ++t)
+        threads.emplace_back([&, t] {
+            struct c_ini_options opts = {};
+            std::string filename = "thread" + std::to_string(t) + ".ini";
+            opts.diagnostics = files[t];
+            opts.disable_colors = 1;
+            for (int i = 0; i != iterations; ++i)
+            {
+                struct reentrant_struct s;
+                std::string             ini =
+                    "[reentrant]\nname = \"" + std::to_string(t) +
+                    "\"\ntags = \"a\", \"b\"\nvalue = " +
+                    (i % 10 == 0 ? "\"bad\"" : std::to_string(i)) + "\n";
+                int result;
+
+                reentrant_struct_init(&s);
+                result = reentrant_struct_parse_opts(
+                    &s, filename.c_str(), ini.data(), ini.size(), &opts);
+                if (i % 10 == 0)
+                    failures[t] += result == -1;
+                else if (
+                    result != 0 || s.value != i ||
+                    std::string(s.name) != std::to_string(t))
+                    failures[t] += 1000;
+                reentrant_struct_deinit(&s);
+            }
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    for (int t = 0; t != threads_count; ++t)
+    {
+        std::string out = read_all(files[t]);
+        std::string filename = "thread" + std::to_string(t) + ".ini:";
+        fclose(files[t]);
+
+        EXPECT_THAT(failures[t], Eq(iterations / 10));
+        /* Each thread only sees its own errors, one complete message each */
+        size_t count = 0;
+        for (size_t pos = out.find(filename); pos != std::string::npos;
+             pos = out.find(filename, pos + 1))
+            count++;
+        EXPECT_THAT(count, Eq(size_t(iterations / 10)));
+        EXPECT_THAT(out, Not(HasSubstr("\x1b[")));
+    }
+}
@@ -0,0 +1,66 @@
+#include "test_shards.h"
+
+#include "gmock/gmock.h"
+
+#include <cstring>
+
+#define NAME shards
+
+SECTION("player")
+struct shards_player
+{
+    char*  name;
+    char** items;
+    int    level DEFAULT(1);
+};
+
+SECTION("sprite")
+struct shards_sprite
+{
+    char  texture[32];
+    float scale DEFAULT(1.0);
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        shards_player_init(&player);
+        shards_sprite_init(&sprite);
+    }
+    void TearDown() override
+    {
+        shards_player_deinit(&player);
+        shards_sprite_deinit(&sprite);
+    }
+
+    struct shards_player player;
+    struct shards_sprite sprite;
+};
+
+using namespace testing;
+
+TEST_F(NAME, every_shard_parses_its_section)
+{
+    const char* ini =
+        "[player]\nname = \"hero\"\nitems = \"sword\", \"shield\"\n"
+        "[sprite]\ntexture = \"hero.png\"\nscale = 2.5\n";
+    ASSERT_THAT(
+        shards_player_parse(&player, "<stdin>", ini, strlen(ini)), Eq(0));
+    ASSERT_THAT(
+        shards_sprite_parse(&sprite, "<stdin>", ini, strlen(ini)), Eq(0));
+    EXPECT_THAT(player.name, StrEq("hero"));
+    EXPECT_THAT(player.items[1], StrEq("shield"));
+    EXPECT_THAT(player.level, Eq(1));
+    EXPECT_THAT(sprite.texture, StrEq("hero.png"));
+    EXPECT_THAT(sprite.scale, FloatEq(2.5f));
+}
+
+TEST_F(NAME, shards_share_the_runtime)
+{
+    const char* ini = "[player]\nlevel = \"x\"\n";
+    EXPECT_THAT(
+        shards_player_parse(&player, "<stdin>", ini, strlen(ini)), Eq(-1));
+    EXPECT_THAT(
+        shards_sprite_parse(&sprite, "<stdin>", ini, strlen(ini)), Eq(0));
+}
@@ -0,0 +1,213 @@
+#include "custom_str.h"
+#include "custom_strlist.h"
+#include "test_shm.h"
+
+#include "gmock/gmock.h"
+
+#include <string>
+#include <vector>
+
+#if defined(C_INI_SHM)
+#    include <sys/mman.h>
+#    include <unistd.h>
+#endif
+
+#define NAME shared_memory
+
+SECTION("shm") WITH(shm)
+struct shm_struct
+{
+    char*           str DEFAULT("default");
+    char**          list;
+    struct str*     custom STRING(custom_str);
+    struct strlist* custom_list STRINGLIST(custom_strlist);
+    char            fixed[16];
+    char            fixed_list[4][8];
+    int             value;
+    float           ratio;
+    bool            flag;
+    unsigned        bit : 1;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        memory.resize(4096);
+        shm = shm_struct_shm_init(memory.data(), memory.size());
+    }
+
+    std::vector<char> memory;
+    struct c_ini_shm* shm;
+};
+
+using namespace testing;
+
+static const char* full =
+    "[shm]\n"
+    "str = \"Hello\"\n"
+    "list = \"a\", \"bc\"\n"
+    "custom = \"custom\"\n"
+    "custom_list = \"x\", \"y\", \"z\"\n"
+    "fixed = \"fixed\"\n"
+    "fixed_list = \"f\", \"g\"\n"
+    "value = 5\n"
+    "ratio = 1.5\n"
+    "flag = true\n"
+    "bit = 1\n";
+
+TEST_F(NAME, nothing_published)
+{
+    ASSERT_THAT(shm, NotNull());
+    EXPECT_THAT(shm_struct_shm_get_value(shm), Eq(0));
+    EXPECT_THAT(shm_struct_shm_get_str(shm), StrEq(""));
+    EXPECT_THAT(shm_struct_shm_count_list(shm), Eq(0));
+    EXPECT_THAT(shm_struct_shm_get_list(shm, 0), IsNull());
+}
+
+TEST_F(NAME, parse_and_read)
+{
+    ASSERT_THAT(shm_struct_shm_parse(shm, "<stdin>", full, strlen(full)), Eq(0));
+    EXPECT_THAT(shm->sequence, Eq(2u));
+
+    EXPECT_THAT(shm_struct_shm_get_str(shm), StrEq("Hello"));
+    EXPECT_THAT(shm_struct_shm_count_list(shm), Eq(2));
+    EXPECT_THAT(shm_struct_shm_get_list(shm, 0), StrEq("a"));
+    EXPECT_THAT(shm_struct_shm_get_list(shm, 1), StrEq("bc"));
+    EXPECT_THAT(shm_struct_shm_get_list(shm, 2), IsNull());
+    EXPECT_THAT(shm_struct_shm_get_list(shm, -1), IsNull());
+    EXPECT_THAT(shm_struct_shm_get_custom(shm), StrEq("custom"));
+    EXPECT_THAT(shm_struct_shm_count_custom_list(shm), Eq(3));
+    EXPECT_THAT(shm_struct_shm_get_custom_list(shm, 2), StrEq("z"));
+    EXPECT_THAT(shm_struct_shm_get_fixed(shm), StrEq("fixed"));
+    EXPECT_THAT(shm_struct_shm_count_fixed_list(shm), Eq(2));
+    EXPECT_THAT(shm_struct_shm_get_fixed_list(shm, 1), StrEq("g"));
+    EXPECT_THAT(shm_struct_shm_get_value(shm), Eq(5));
+    EXPECT_THAT(shm_struct_shm_get_ratio(shm), DoubleEq(1.5));
+    EXPECT_THAT(shm_struct_shm_get_flag(shm), Eq(1));
+    EXPECT_THAT(shm_struct_shm_get_bit(shm), Eq(1u));
+}
+
+TEST_F(NAME, strings_are_in_the_segment)
+{
+    ASSERT_THAT(shm_struct_shm_parse(shm, "<stdin>", full, strlen(full)), Eq(0));
+    const char* str = shm_struct_shm_get_str(shm);
+    EXPECT_THAT(str, Ge(memory.data()));
+    EXPECT_THAT(str, Lt(memory.data() + shm->size));
+    EXPECT_THAT(shm->size, Le(shm->capacity));
+}
+
+TEST_F(NAME, republish)
+{
+    struct shm_struct s;
+    const char*       ini = "[shm]\nstr = \"Hi\"\nvalue = 7\n";
+    ASSERT_THAT(shm_struct_shm_parse(shm, "<stdin>", full, strlen(full)), Eq(0));
+
+    uint32_t sequence = shm_struct_shm_read_begin(shm);
+    ASSERT_THAT(shm_struct_init(&s), Eq(0));
+    ASSERT_THAT(shm_struct_parse(&s, "<stdin>", ini, strlen(ini)), Eq(0));
+    ASSERT_THAT(shm_struct_shm_publish(shm, &s), Eq(0));
+    shm_struct_deinit(&s);
+
+    /* A reader that started before has to retry */
+    EXPECT_THAT(shm_struct_shm_read_retry(shm, sequence), Ne(0));
+    sequence = shm_struct_shm_read_begin(shm);
+    EXPECT_THAT(shm_struct_shm_get_str(shm), StrEq("Hi"));
+    EXPECT_THAT(shm_struct_shm_get_value(shm), Eq(7));
+    EXPECT_THAT(shm_struct_shm_count_list(shm), Eq(0));
+    EXPECT_THAT(shm_struct_shm_read_retry(shm, sequence), Eq(0));
+}
+
+TEST_F(NAME, publish_in_progress)
+{
+    struct shm_struct s;
+    ASSERT_THAT(shm_struct_init(&s), Eq(0));
+    shm->sequence = 1;
+    EXPECT_THAT(shm_struct_shm_read_retry(shm, 1), Ne(0));
+    EXPECT_THAT(shm_struct_shm_publish(shm, &s), Eq(-1));
+    shm_struct_deinit(&s);
+}
+
+TEST_F(NAME, capacity)
+{
+    struct shm_struct s;
+    ASSERT_THAT(shm_struct_init(&s), Eq(0));
+    ASSERT_THAT(shm_struct_parse(&s, "<stdin>", full, strlen(full)), Eq(0));
+
+    size_t size = shm_struct_shm_size(&s);
+    memory.assign(size - 1, '\0');
+    shm = shm_struct_shm_init(memory.data(), memory.size());
+    ASSERT_THAT(shm, NotNull());
+    EXPECT_THAT(shm_struct_shm_publish(shm, &s), Eq(-1));
+    EXPECT_THAT(shm->sequence, Eq(0u));
+
+    memory.assign(size, '\0');
+    shm = shm_struct_shm_init(memory.data(), memory.size());
+    EXPECT_THAT(shm_struct_shm_publish(shm, &s), Eq(0));
+    EXPECT_THAT(memory.back(), Eq('\0'));
+    EXPECT_THAT(shm_struct_shm_get_custom_list(shm, 1), StrEq("y"));
+    shm_struct_deinit(&s);
+
+    EXPECT_THAT(shm_struct_shm_init(memory.data(), 16), IsNull());
+}
+
+#if defined(C_INI_SHM)
+TEST_F(NAME, posix_segment)
+{
+    std::string name = "/c_ini_test_" + std::to_string(getpid());
+    shm_unlink(name.c_str());
+
+    struct c_ini_shm* writer = shm_struct_shm_create(name.c_str(), 4096);
+    ASSERT_THAT(writer, NotNull());
+    ASSERT_THAT(
+        shm_struct_shm_parse(writer, "<stdin>", full, strlen(full)), Eq(0));
+
+    /* Mapped a second time, like another process would */
+    const struct c_ini_shm* reader = shm_struct_shm_open(name.c_str());
+    ASSERT_THAT(reader, NotNull());
+    EXPECT_THAT(reader, Ne(writer));
+    EXPECT_THAT(shm_struct_shm_get_str(reader), StrEq("Hello"));
+    EXPECT_THAT(shm_struct_shm_get_value(reader), Eq(5));
+
+    /* A publisher that restarts keeps the image */
+    struct c_ini_shm* again = shm_struct_shm_create(name.c_str(), 4096);
+    ASSERT_THAT(again, NotNull());
+    EXPECT_THAT(again->sequence, Eq(2u));
+    EXPECT_THAT(shm_struct_shm_create(name.c_str(), 8192), IsNull());
+
+    shm_struct_shm_close(again);
+    shm_struct_shm_close(reader);
+    shm_struct_shm_close(writer);
+    shm_unlink(name.c_str());
+    EXPECT_THAT(shm_struct_shm_open(name.c_str()), IsNull());
+}
+
+TEST_F(NAME, posix_segment_after_crash)
+{
+    std::string name = "/c_ini_test_crash_" + std::to_string(getpid());
+    shm_unlink(name.c_str());
+
+    struct c_ini_shm* writer = shm_struct_shm_create(name.c_str(), 4096);
+    ASSERT_THAT(writer, NotNull());
+    ASSERT_THAT(
+        shm_struct_shm_parse(writer, "<stdin>", full, strlen(full)), Eq(0));
+    /* The publisher died between starting and finishing a publish */
+    writer->sequence = 3;
+    shm_struct_shm_close(writer);
+
+    struct c_ini_shm* again = shm_struct_shm_create(name.c_str(), 4096);
+    ASSERT_THAT(again, NotNull());
+    EXPECT_THAT(again->sequence, Eq(4u));
+    uint32_t sequence = shm_struct_shm_read_begin(again);
+    EXPECT_THAT(shm_struct_shm_get_value(again), Eq(0));
+    EXPECT_THAT(shm_struct_shm_read_retry(again, sequence), Eq(0));
+
+    ASSERT_THAT(
+        shm_struct_shm_parse(again, "<stdin>", full, strlen(full)), Eq(0));
+    EXPECT_THAT(again->sequence, Eq(6u));
+    EXPECT_THAT(shm_struct_shm_get_value(again), Eq(5));
+
+    shm_struct_shm_close(again);
+    shm_unlink(name.c_str());
+}
+#endif
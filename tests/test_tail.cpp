@@ -0,0 +1,159 @@
+#include "test_tail.h"
+
+#include "gmock/gmock.h"
+
+#include <string>
+#include <vector>
+
+#define NAME tail
+
+SECTION("event")
+struct tail_struct
+{
+    char* name;
+    int   value;
+};
+
+struct NAME : testing::Test
+{
+    static int on_section(struct c_ini_parser* p, void* user_ptr)
+    {
+        struct NAME*       self = static_cast<struct NAME*>(user_ptr);
+        struct tail_struct s;
+        int                tok;
+        tail_struct_init(&s);
+        tok = tail_struct_parse_section(&s, p);
+        self->events.push_back(std::string(s.name) + "=" +
+                               std::to_string(s.value));
+        tail_struct_deinit(&s);
+        return tok;
+    }
+
+    int poll()
+    {
+        return tail_struct_parse_tail(
+            &cursor, "<log>", log.data(), (int)log.size(), on_section, this);
+    }
+
+    std::string              log;
+    struct c_ini_tail        cursor = {};
+    std::vector<std::string> events;
+};
+
+using namespace testing;
+
+TEST_F(NAME, only_new_sections_are_parsed)
+{
+    log = "[event]\nname = \"a\"\nvalue = 1\n";
+    ASSERT_THAT(poll(), Eq(0));
+    /* The section may still grow */
+    EXPECT_THAT(events, IsEmpty());
+    EXPECT_THAT(cursor.offset, Eq(0));
+
+    log += "[event]\nname = \"b\"\nvalue = 2\n[other]\nx = 1\n[event]\n";
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, ElementsAre("a=1", "b=2"));
+    EXPECT_THAT(log.substr(cursor.offset), Eq("[event]\n"));
+
+    events.clear();
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, IsEmpty());
+}
+
+TEST_F(NAME, partial_section_is_held_back)
+{
+    log = "[event]\nname = \"a\"\nvalue = 1\n[event]\nname = \"b";
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, ElementsAre("a=1"));
+
+    log += "c\"\nvalue = 3";
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, ElementsAre("a=1"));
+
+    log += "4\n[event]\n";
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, ElementsAre("a=1", "bc=34"));
+}
+
+TEST_F(NAME, flush)
+{
+    log = "[event]\nname = \"a\"\nvalue = 1\n[event]\nname = \"b\"\n";
+    ASSERT_THAT(poll(), Eq(0));
+    cursor.flush = 1;
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, ElementsAre("a=1", "b=0"));
+    EXPECT_THAT(cursor.offset, Eq((int)log.size()));
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, SizeIs(2));
+}
+
+TEST_F(NAME, error_keeps_handled_sections)
+{
+    struct c_ini_options opts = {};
+    log = "[event]\nvalue = 1\n[event]\nvalue = \"x\"\n[event]\n";
+    opts.diagnostics = tmpfile();
+    ASSERT_THAT(
+        tail_struct_parse_tail_opts(
+            &cursor,
+            "<log>",
+            log.data(),
+            (int)log.size(),
+            on_section,
+            this,
+            &opts),
+        Eq(-1));
+    fclose(opts.diagnostics);
+    EXPECT_THAT(events, SizeIs(2));
+    /* Retries the section that failed, but not the one before */
+    EXPECT_THAT(cursor.offset, Eq((int)log.find("[event]\nvalue = \"x\"")));
+}
+
+TEST_F(NAME, truncated_log_starts_over)
+{
+    log = "[event]\nvalue = 1\n[event]\nvalue = 2\n[event]\n";
+    ASSERT_THAT(poll(), Eq(0));
+    log = "[event]\nvalue = 3\n[event]\n";
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, ElementsAre("=1", "=2", "=3"));
+}
+
+TEST_F(NAME, bracket_within_string_is_not_a_section)
+{
+    log = "[event]\nname = \"a\n[event]\nb\"\nvalue = 1\n";
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, IsEmpty());
+    EXPECT_THAT(cursor.offset, Eq(0));
+
+    log += "[event]\n";
+    ASSERT_THAT(poll(), Eq(0));
+    EXPECT_THAT(events, ElementsAre("a\n[event]\nb=1"));
+}
+
+TEST_F(NAME, limits_apply_across_calls)
+{
+    struct c_ini_limits  limits = {};
+    struct c_ini_options opts = {};
+    limits.max_sections = 2;
+    opts.limits = &limits;
+    opts.diagnostics = tmpfile();
+    auto poll_opts = [&] {
+        return tail_struct_parse_tail_opts(
+            &cursor,
+            "<log>",
+            log.data(),
+            (int)log.size(),
+            on_section,
+            this,
+            &opts);
+    };
+
+    log = "[event]\nvalue = 1\n[event]\n";
+    ASSERT_THAT(poll_opts(), Eq(0));
+    log += "value = 2\n[event]\n";
+    ASSERT_THAT(poll_opts(), Eq(0));
+    EXPECT_THAT(cursor.sections, Eq(2));
+    log += "value = 3\n[event]\n";
+    EXPECT_THAT(poll_opts(), Eq(-1));
+    fclose(opts.diagnostics);
+    EXPECT_THAT(events, ElementsAre("=1", "=2"));
+}
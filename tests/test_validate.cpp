@@ -0,0 +1,107 @@
+#include "test_validate.h"
+
+#include "gmock/gmock.h"
+
+#include <cstdlib>
+
+#define NAME validate
+
+SECTION("validate")
+struct validate_struct
+{
+    char*   str;
+    char**  list;
+    char    fixed[8];
+    int16_t value CONSTRAIN(0, 10);
+    float   ratio CONSTRAIN(0.0, 1.0);
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        allocator.alloc = [](void* ctx, size_t size) -> void* {
+            ++*static_cast<int*>(ctx);
+            return malloc(size);
+        };
+        allocator.realloc = [](void* ctx, void* ptr, size_t size) -> void* {
+            ++*static_cast<int*>(ctx);
+            return realloc(ptr, size);
+        };
+        allocator.free = [](void*, void* ptr) { free(ptr); };
+        allocator.ctx = &allocs;
+        validate_struct_set_allocator(&allocator);
+    }
+    void TearDown() override { validate_struct_set_allocator(NULL); }
+
+    int check(const char* ini)
+    {
+        return validate_struct_validate(ini, strlen(ini), &error);
+    }
+
+    struct c_ini_allocator allocator;
+    int                    allocs = 0;
+    struct c_ini_error     error = {};
+};
+
+using namespace testing;
+
+TEST_F(NAME, valid_document)
+{
+    EXPECT_THAT(
+        check(
+            "[validate]\nstr = \"Hello\"\nlist = \"a\", \"b\"\n"
+            "fixed = \"1234567\"\nvalue = 10\nratio = 0.5\n"),
+        Eq(0));
+    EXPECT_THAT(error.offset, Eq(-1));
+    EXPECT_THAT(allocs, Eq(0));
+}
+
+TEST_F(NAME, constraint_errors)
+{
+    ASSERT_THAT(check("[validate]\nstr = \"x\"\nvalue = 50\n"), Eq(-1));
+    EXPECT_THAT(error.line, Eq(3));
+    EXPECT_THAT(error.column, Eq(9));
+    EXPECT_THAT(error.offset, Eq(29));
+    EXPECT_THAT(error.length, Eq(2));
+    EXPECT_THAT(error.message, StrEq("\"value\" must be 0 to 10"));
+
+    ASSERT_THAT(check("[validate]\nratio = 2\n"), Eq(-1));
+    EXPECT_THAT(error.message, StrEq("\"ratio\" must be 0 to 1"));
+}
+
+TEST_F(NAME, formatted_errors)
+{
+    ASSERT_THAT(check("[validate]\nbogus = 1\n"), Eq(-1));
+    EXPECT_THAT(
+        error.message, StrEq("Unknown key \"bogus\" in section \"validate\""));
+
+    ASSERT_THAT(check("[validate]\nfixed = \"12345678\"\n"), Eq(-1));
+    EXPECT_THAT(
+        error.message, StrEq("\"fixed\" can't be longer than 7 characters"));
+}
+
+TEST_F(NAME, syntax_errors)
+{
+    ASSERT_THAT(check("[validate]\nlist = \"a\",\n"), Eq(-1));
+    EXPECT_THAT(error.message, StrEq("Expected a string literal for list"));
+    ASSERT_THAT(check("[validate]\nstr = \"a\n"), Eq(-1));
+    EXPECT_THAT(error.message, StrEq("Missing closing quote on string"));
+}
+
+TEST_F(NAME, nothing_is_printed)
+{
+    const char* ini = "[validate]\nvalue = 50\n";
+    internal::CaptureStderr();
+    EXPECT_THAT(validate_struct_validate(ini, strlen(ini), NULL), Eq(-1));
+    EXPECT_THAT(check(ini), Eq(-1));
+    EXPECT_THAT(internal::GetCapturedStderr(), IsEmpty());
+}
+
+TEST_F(NAME, long_messages_are_truncated)
+{
+    std::string ini = "[validate]\n" + std::string(300, 'k') + " = 1\n";
+    ASSERT_THAT(
+        validate_struct_validate(ini.data(), ini.size(), &error), Eq(-1));
+    EXPECT_THAT(strlen(error.message), Eq(sizeof(error.message) - 1));
+}
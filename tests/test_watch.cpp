@@ -0,0 +1,124 @@
+#include "test_watch.h"
+
+#include "gmock/gmock.h"
+
+#include <string>
+#include <vector>
+
+#define NAME watch
+
+SECTION("watch") WITH(watch)
+struct watch_struct
+{
+    char*    host;
+    int      port;
+    int      timeout;
+    char**   tags;
+    unsigned verbose : 1;
+};
+
+struct NAME : testing::Test
+{
+    void SetUp() override
+    {
+        watch_struct_init(&s);
+        watch_struct_watch_init(&w, &s);
+    }
+    void TearDown() override { watch_struct_deinit(&s); }
+
+    void parse(const char* ini)
+    {
+        ASSERT_THAT(
+            watch_struct_watch_parse(&w, "<stdin>", ini, strlen(ini)),
+            testing::Eq(0));
+    }
+
+    template <char C>
+    static void on_change(struct watch_struct*, const uint32_t*, void* user)
+    {
+        static_cast<struct NAME*>(user)->calls += C;
+    }
+
+    struct watch_struct              s;
+    struct watch_struct_watch        w;
+    struct watch_struct_subscription network;
+    struct watch_struct_subscription all;
+    std::string                      calls;
+};
+
+using namespace testing;
+
+TEST_F(NAME, dirty_bits_from_parse_opts)
+{
+    uint32_t             dirty[C_INI_FIELD_WORDS(WATCH_STRUCT_FIELDS_COUNT)] = {};
+    struct c_ini_options opts = {};
+    const char*          ini = "[watch]\nport = 80\nverbose = 1\n[other]\nx = 1\n";
+    opts.dirty = dirty;
+    ASSERT_THAT(
+        watch_struct_parse_opts(&s, "<stdin>", ini, strlen(ini), &opts), Eq(0));
+    EXPECT_THAT(C_INI_FIELD_TEST(dirty, WATCH_STRUCT_FIELD_PORT), Eq(1u));
+    EXPECT_THAT(C_INI_FIELD_TEST(dirty, WATCH_STRUCT_FIELD_VERBOSE), Eq(1u));
+    EXPECT_THAT(C_INI_FIELD_TEST(dirty, WATCH_STRUCT_FIELD_HOST), Eq(0u));
+    EXPECT_THAT(C_INI_FIELD_TEST(dirty, WATCH_STRUCT_FIELD_TAGS), Eq(0u));
+}
+
+TEST_F(NAME, subscriptions_fire_for_their_fields)
+{
+    uint32_t fields[C_INI_FIELD_WORDS(WATCH_STRUCT_FIELDS_COUNT)] = {};
+    C_INI_FIELD_SET(fields, WATCH_STRUCT_FIELD_HOST);
+    C_INI_FIELD_SET(fields, WATCH_STRUCT_FIELD_PORT);
+    watch_struct_subscribe(&w, &network, fields, on_change<'n'>, this);
+    watch_struct_subscribe(&w, &all, NULL, on_change<'a'>, this);
+
+    parse("[watch]\ntimeout = 5\n");
+    EXPECT_THAT(calls, StrEq("a"));
+    parse("[watch]\nport = 80\nhost = \"example.com\"\n");
+    EXPECT_THAT(calls, StrEq("ana"));
+    parse("[other]\nport = 80\n");
+    EXPECT_THAT(calls, StrEq("ana"));
+}
+
+TEST_F(NAME, callback_sees_dirty_fields)
+{
+    watch_struct_subscribe(
+        &w,
+        &all,
+        NULL,
+        [](struct watch_struct* s, const uint32_t* dirty, void* user) {
+            EXPECT_THAT(s->port, Eq(80));
+            EXPECT_THAT(C_INI_FIELD_TEST(dirty, WATCH_STRUCT_FIELD_PORT), Eq(1u));
+            EXPECT_THAT(C_INI_FIELD_TEST(dirty, WATCH_STRUCT_FIELD_HOST), Eq(0u));
+            ++*static_cast<int*>(user);
+        },
+        &s.timeout);
+    parse("[watch]\nport = 80\n");
+    EXPECT_THAT(s.timeout, Eq(1));
+    EXPECT_THAT(w.dirty[0], Eq(0u));
+}
+
+TEST_F(NAME, failed_parse_keeps_dirty_bits)
+{
+    const char* ini = "[watch]\nport = 80\ntimeout = \"x\"\n";
+    watch_struct_subscribe(&w, &all, NULL, on_change<'a'>, this);
+    ASSERT_THAT(
+        watch_struct_watch_parse(&w, "<stdin>", ini, strlen(ini)), Eq(-1));
+    EXPECT_THAT(calls, StrEq(""));
+    EXPECT_THAT(C_INI_FIELD_TEST(w.dirty, WATCH_STRUCT_FIELD_PORT), Eq(1u));
+
+    /* The next successful parse reports both */
+    parse("[watch]\nhost = \"a\"\n");
+    EXPECT_THAT(calls, StrEq("a"));
+}
+
+TEST_F(NAME, unsubscribe)
+{
+    watch_struct_subscribe(&w, &network, NULL, on_change<'n'>, this);
+    watch_struct_subscribe(&w, &all, NULL, on_change<'a'>, this);
+    watch_struct_unsubscribe(&w, &network);
+    parse("[watch]\nport = 80\n");
+    EXPECT_THAT(calls, StrEq("a"));
+    watch_struct_unsubscribe(&w, &all);
+    watch_struct_unsubscribe(&w, &all);
+    parse("[watch]\nport = 80\n");
+    EXPECT_THAT(calls, StrEq("a"));
+}